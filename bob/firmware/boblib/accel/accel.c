@@ -5,6 +5,7 @@
 #include <pmc/pmc.h>
 #include <twi/twi.h>
 #include <timer/timer.h>
+#include <sensors/filter.h>
 
 #include <string.h>
 #include <stdio.h>
@@ -28,6 +29,9 @@ int g_AccelX = 0;
 int g_AccelY = 0;
 int g_AccelZ = 0;
 short g_calValues[3] = {-2,19,-23};
+static Filter g_AccelFilter[3] = {
+	FILTER_INIT(FILTER_NONE, 0), FILTER_INIT(FILTER_NONE, 0), FILTER_INIT(FILTER_NONE, 0)
+};
 
 static void AccelCallback(void);
 
@@ -136,6 +140,24 @@ void AccelSetCalibration(void)
 	WriteAccelData(0x10, (char*)g_calValues, 6);
 }
 
+// axis 0-2 is x y z, -1 sets all of them
+void SetAccelFilter(int axis, int type, int size)
+{
+	int i;
+	
+	if(axis == -1) {
+		for(i = 0;i < 3;i++) FilterSet(&(g_AccelFilter[i]), type, size);
+	}
+	else if(axis >= 0 && axis <= 2)
+		FilterSet(&(g_AccelFilter[axis]), type, size);
+}
+
+void GetAccelFilter(int axis, short *config)
+{
+	if(axis < 0 || axis > 2) axis = 0;
+	FilterGet(&(g_AccelFilter[axis]), config);
+}
+
 int Accel_X(void)
 {
 	return g_AccelX;
@@ -158,17 +180,17 @@ static void AccelCallback(void)
 	char value[6];
 	while(!PIO_Get(&(accIntPins[0]))){nop();} // wait for data ready pin
 	ReadAccelData(0x28|(1<<7),value,6); // ST chip
-	g_AccelX = ((signed char)value[1]<<8)|value[0];
-	g_AccelY = ((signed char)value[3]<<8)|value[2];
-	g_AccelZ = ((signed char)value[5]<<8)|value[4];
+	g_AccelX = FilterUpdate(&(g_AccelFilter[0]), ((signed char)value[1]<<8)|value[0]);
+	g_AccelY = FilterUpdate(&(g_AccelFilter[1]), ((signed char)value[3]<<8)|value[2]);
+	g_AccelZ = FilterUpdate(&(g_AccelFilter[2]), ((signed char)value[5]<<8)|value[4]);
 #else
 	char value[3];
 	if(g_idle) return;
 	while(!PIO_Get(&(accIntPins[0]))){nop();} // wait for data ready pin
 	ReadAccelData(0x6,value,3);
-	g_AccelX = (signed char)value[0];
-	g_AccelY = (signed char)value[1];
-	g_AccelZ = (signed char)value[2];
+	g_AccelX = FilterUpdate(&(g_AccelFilter[0]), (signed char)value[0]);
+	g_AccelY = FilterUpdate(&(g_AccelFilter[1]), (signed char)value[1]);
+	g_AccelZ = FilterUpdate(&(g_AccelFilter[2]), (signed char)value[2]);
 #endif
 }
 
@@ -6,6 +6,9 @@ void AccelCalibration(void);
 void GetAccelCal(short *calVal);
 void SetAccelCal(short *calVal);
 void AccelSetCalibration(void);
+// FILTER_* from sensors/filter.h
+void SetAccelFilter(int axis, int type, int size);
+void GetAccelFilter(int axis, short *config);
 
 int Accel_X(void);
 int Accel_Y(void);
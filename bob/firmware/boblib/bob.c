@@ -6,6 +6,8 @@
 #include <servos/servos.h>
 #include <accel/accel.h>
 #include <uart/uart.h>
+#include <events/events.h>
+#include <capture/capture.h>
 
 #include <utility/trace.h>
 #include <pio/pio_it.h>
@@ -21,6 +23,8 @@ void BobInit()
 	MotorsInit();
 	ServosInit();
 	AccelInit();
+	CaptureInit();
+	EventsInit();
 }
 
 void BobTest()
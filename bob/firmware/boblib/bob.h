@@ -11,7 +11,7 @@
 
 #define VERSION_STRING (VERSION " " BUILD_DATE)
 
-#define CBOB_VERSION 219
+#define CBOB_VERSION 228
 
 #define MCK 48054857
 
@@ -35,6 +35,10 @@
 // this will produce about 100kHz PWM
 #define MC_PWM_PERIOD	480
 #define MC_PID_PERIOD	10			// Loop every 10ms
+// Motor loop period in microseconds, runs off TC2 and can be changed with PID_CONFIG
+#define MC_LOOP_PERIOD_US		(MC_PID_PERIOD*1000)
+#define MC_LOOP_PERIOD_MIN_US	2000	// leaves the motors on at least 2/3 of the time
+#define MC_LOOP_PERIOD_MAX_US	30000
 #define MC_INDUCTION_SPIKE	600		// microsecond delay once motors are turned off
 
 #define MC_POSITION_SCALE 44
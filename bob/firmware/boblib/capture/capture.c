@@ -0,0 +1,129 @@
+#include "capture.h"
+
+#include <bob.h>
+#include <pio/pio.h>
+#include <aic/aic.h>
+#include <timer/timer.h>
+
+#include <string.h>
+
+/* Edge capture
+ *
+ * Digital ports with capture on raise a PIOB input change interrupt.  The
+ * handler stamps the edge with the PIT microsecond clock, counts it and
+ * logs it to a ring buffer the CBC drains with CBOB_CMD_CAPTURE_READ.
+ * Levels are the ones Digital() returns, so a rising edge is the port
+ * going from 0 to 1.  The handler replaces the at91lib pio_it dispatch on
+ * PIOB, which only takes 7 sources and looks them up one by one.
+ */
+
+struct CaptureEdge {
+	unsigned int stamp;
+	short port;			// port | level<<8
+};
+
+extern const Pin digitalIns[];
+
+static struct CaptureEdge g_CaptureLog[CAPTURE_LOG_SIZE];
+static volatile int g_CaptureWrite = 0;
+static volatile int g_CaptureRead = 0;
+static volatile int g_CaptureDropped = 0;
+static volatile int g_CaptureCount[8] = {0,0,0,0,0,0,0,0};
+static volatile int g_CaptureEdges[8] = {0,0,0,0,0,0,0,0};
+
+static void ISR_Capture(void);
+
+void CaptureInit(void)
+{
+	AT91C_BASE_PIOB->PIO_IDR = 0xFFFFFFFF;
+	AT91C_BASE_PIOB->PIO_ISR;
+	// the stamp is taken on entry, so this goes ahead of everything else
+	AIC_ConfigureIT(AT91C_ID_PIOB, AT91C_AIC_PRIOR_HIGHEST, ISR_Capture);
+	AIC_EnableIT(AT91C_ID_PIOB);
+}
+
+void SetCapture(int port, int edges)
+{
+	if(port < 0 || port > 7) return;
+	
+	g_CaptureEdges[port] = edges & CAPTURE_BOTH;
+	if(g_CaptureEdges[port])
+		AT91C_BASE_PIOB->PIO_IER = digitalIns[port].mask;
+	else
+		AT91C_BASE_PIOB->PIO_IDR = digitalIns[port].mask;
+}
+
+int GetCapture(int port)
+{
+	if(port < 0 || port > 7) return 0;
+	return g_CaptureEdges[port];
+}
+
+int GetCaptureCount(int port)
+{
+	if(port < 0 || port > 7) return 0;
+	return g_CaptureCount[port];
+}
+
+void ClearCaptureCount(int port)
+{
+	if(port < 0 || port > 7) return;
+	g_CaptureCount[port] = 0;
+}
+
+// edges dropped since the last read because the log was full
+int GetCaptureDropped(void)
+{
+	return g_CaptureDropped;
+}
+
+int CapturePending(void)
+{
+	return g_CaptureWrite != g_CaptureRead;
+}
+
+int ReadCaptures(short *data, int max)
+{
+	int count = 0, read = g_CaptureRead;
+	
+	while(count < max && read != g_CaptureWrite) {
+		memcpy(data, &(g_CaptureLog[read].stamp), 4);
+		data[2] = g_CaptureLog[read].port;
+		data += 3;
+		count++;
+		read = (read + 1) % CAPTURE_LOG_SIZE;
+	}
+	g_CaptureRead = read;
+	g_CaptureDropped = 0;
+	
+	return count;
+}
+
+static void ISR_Capture(void)
+{
+	unsigned int status, pdsr, stamp;
+	int i, level, next;
+	
+	stamp = PitMicroseconds();
+	status = AT91C_BASE_PIOB->PIO_ISR & AT91C_BASE_PIOB->PIO_IMR;
+	pdsr = AT91C_BASE_PIOB->PIO_PDSR;
+	
+	for(i = 0;i < 8;i++) {
+		if(!(status & digitalIns[i].mask))
+			continue;
+		// inputs are active low, like in SensorFrameCallback
+		level = (pdsr & digitalIns[i].mask) ? 0 : 1;
+		if(!(g_CaptureEdges[i] & (level ? CAPTURE_RISING : CAPTURE_FALLING)))
+			continue;
+		
+		g_CaptureCount[i]++;
+		next = (g_CaptureWrite + 1) % CAPTURE_LOG_SIZE;
+		if(next == g_CaptureRead) {
+			g_CaptureDropped++;
+			continue;
+		}
+		g_CaptureLog[g_CaptureWrite].stamp = stamp;
+		g_CaptureLog[g_CaptureWrite].port = i | (level<<8);
+		g_CaptureWrite = next;
+	}
+}
@@ -0,0 +1,25 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+// Edges to capture on a digital port, same as CBOB_CAPTURE_* in cbob_cmd.h
+#define CAPTURE_OFF		0
+#define CAPTURE_RISING	1
+#define CAPTURE_FALLING	2
+#define CAPTURE_BOTH	3
+
+// Edges the log holds before it drops new ones
+#define CAPTURE_LOG_SIZE 128
+
+void CaptureInit(void);
+
+void SetCapture(int port, int edges);
+int GetCapture(int port);
+int GetCaptureCount(int port);
+void ClearCaptureCount(int port);
+int GetCaptureDropped(void);
+int CapturePending(void);
+// Copies up to max edges to data, 3 words each: stamp (2 words, us) and
+// port | level<<8.  Returns the number of edges copied.
+int ReadCaptures(short *data, int max);
+
+#endif
@@ -38,6 +38,19 @@
 #define CBOB_CMD_ACCEL_READ     5
 #define CBOB_CMD_ACCEL_CONFIG   6
 
+/* ANALOG CONFIG(2, port, type, size)->(type, size)  filters port 0-7, 8 the
+ *                                                   battery, -1 all analogs
+ *              (3, port)->(type, size)
+ * ACCEL CONFIG(3, axis, type, size)->(type, size)   axis 0-2, -1 all
+ *             (4, axis)->(type, size)
+ *     The BoB filters every PIT sample, reads return the filtered value.
+ *     size is clamped to what the type supports and the settings used
+ *     are returned. */
+#define CBOB_FILTER_NONE    0
+#define CBOB_FILTER_AVERAGE 1  // mean of the last size samples, up to 40
+#define CBOB_FILTER_MEDIAN  2  // median of the last size samples, up to 9
+#define CBOB_FILTER_IIR     3  // y += (x - y)/2^size, size up to 8
+
 #define CBOB_CMD_ACCEL_CONFIG_SET_SCALE 0
 
 /* READ CONFIG */
@@ -46,10 +59,19 @@
 
 #define CBOB_CMD_SENSORS_CONFIG_PACKET 0
 
-/* READ WRITE CONFIG */
+/* UART READ(uart, max)->(count, bytes...)  uart 0 is USB, 1 the serial port
+ * UART WRITE(uart, count, bytes...)->(written)
+ *     Serial writes go to a ring on the BoB.  Past its high watermark the
+ *     BoB takes what fits and raises CBOB_EVENT_UART once it has drained
+ *     below the low watermark, so the CBC knows when to write again.
+ * UART CONFIG(0, uart, baud(2))->(baud(2))
+ *            (1, uart)->(baud(2), tx free, rx dropped)  dropped since the last call
+ *            (2, uart)->()  empties the rings */
 #define CBOB_CMD_UART_READ      9
 #define CBOB_CMD_UART_WRITE     10
 #define CBOB_CMD_UART_CONFIG    11
+#define CBOB_UART_READ_MAX      240
+#define CBOB_UART_WRITE_MAX     240
 
 /* READ WRITE CONFIG */
 #define CBOB_CMD_PWM_READ       12
@@ -68,4 +90,67 @@
 
 #define CBOB_CMD_STATUS_READ 21
 
+/* BATCH(n, cmd1, count1, data1..., cmd2, ...)->(replycount1, reply1..., ...)
+ *     Runs n commands in order in one transaction.  Each reply is
+ *     prefixed with its length.  Stops early if the replies would not
+ *     fit, BATCH may not be nested. */
+#define CBOB_CMD_BATCH          23
+// STATUS_READ version of the first firmware with BATCH
+#define CBOB_BATCH_VERSION      220
+
+/* READ()->(version, count, stamp(2), sensors(14), counter(8), speed(4),
+ *          pwm(4), servo(4), moving, pad)
+ *     Everything the CBC polls in one transaction, laid out like
+ *     struct cbob_robot_state.  count is the reply length so older
+ *     readers can tell a newer layout apart, stamp is the BoB clock in
+ *     ms when the reply was packed. */
+#define CBOB_CMD_STATE_READ     24
+#define CBOB_STATE_READ_VERSION 1
+#define CBOB_STATE_READ_COUNT   40
+
+/* EVENT READ()->(events, changed, digitals)
+ *     Returns the pending events and clears them.  changed has a bit set
+ *     for each digital (bit 8 the black button) that changed since the
+ *     last read, digitals is laid out like sensor_data.digitals.
+ * EVENT CONFIG(mask)->()
+ *     SS1 is pulsed every PIT tick while an event in mask is pending. */
+#define CBOB_CMD_EVENT_READ     25
+#define CBOB_CMD_EVENT_CONFIG   26
+
+#define CBOB_EVENT_MOTOR_DONE(n) (1<<(n))
+#define CBOB_EVENT_MOTORS_DONE   0x0F
+#define CBOB_EVENT_DIGITAL       0x10
+#define CBOB_EVENT_BUTTON        0x20
+#define CBOB_EVENT_UART          0x40
+#define CBOB_EVENT_CAPTURE       0x80
+#define CBOB_EVENT_STREAM        0x100
+
+/* CAPTURE READ(max)->(count, dropped, edges...)
+ *     Drains up to max captured edges, 3 words each: the BoB clock in us
+ *     (2 words) and port | level<<8.  dropped is the number of edges lost
+ *     to a full log since the last read.
+ * CAPTURE CONFIG(0, port, edges)->()  capture CBOB_CAPTURE_* on port 0-7
+ *                (1, port)->(edges)
+ *                (2, port)->(count(2))  edges seen since the last clear
+ *                (3, port)->()          clears the count, -1 for all */
+#define CBOB_CMD_CAPTURE_READ   27
+#define CBOB_CMD_CAPTURE_CONFIG 28
+#define CBOB_CAPTURE_READ_MAX   40
+
+#define CBOB_CAPTURE_OFF     0
+#define CBOB_CAPTURE_RISING  1
+#define CBOB_CAPTURE_FALLING 2
+#define CBOB_CAPTURE_BOTH    3
+
+/* STREAM READ(max)->(count, dropped, first(2), samples...)
+ *     Drains up to max samples in whole frames, one sample per streamed
+ *     port in port order.  first is the number of the first frame since
+ *     the stream started, dropped the frames lost since the last read.
+ * STREAM CONFIG(0, mask, rate)->(rate)  samples the analog ports in mask
+ *                                       rate times a second, 0 stops
+ *              (1)->(mask, rate) */
+#define CBOB_CMD_STREAM_READ    29
+#define CBOB_CMD_STREAM_CONFIG  30
+#define CBOB_STREAM_READ_MAX    120
+
 #endif
@@ -9,6 +9,10 @@
 #include <accel/accel.h>
 #include <uart/uart.h>
 #include <servos/servos.h>
+#include <timer/timer.h>
+#include <events/events.h>
+#include <capture/capture.h>
+#include <sensors/stream.h>
 #include <string.h>
 
 #include <usb/device/cdc-serial/CDCDSerialDriver.h>
@@ -30,14 +34,21 @@ static Pin g_ChumbySS1 = CHUMBY_SS1;
 volatile short g_ChumbyCmd[CHUMBY_CMD_COUNT];
 volatile short g_ChumbyData[CHUMBY_MAX_DATA_COUNT];
 volatile uchar  g_ChumbyState = -1;
+// Reply buffer, laid out like g_ChumbyData.  Points at a sensor frame
+// while one is being sent.
+volatile short *g_ChumbyReply = g_ChumbyData;
 
 static void ChumbyCallback();
 
 static void ChumbySetStateCmd();
 static void ChumbySetStateData(short count);
 static void ChumbyHandleCmd(short cmd, short *data, short count);
+static short ChumbyExecCmd(short cmd, short *data, short length);
+static short ChumbyExecBatch(short *data, short length);
 static void ChumbySetStateWriteData();
 static void ChumbySetStateWriteLen(short count);
+static void ChumbyResetReply();
+static short ChumbyPackState(short *data);
 
 void ChumbyInit()
 {
@@ -56,6 +67,7 @@ void ChumbyInit()
 static void ChumbySetStateCmd()
 {
 	ChumbySpiReset();
+	ChumbyResetReply();
 
 	g_ChumbyState = CHUMBY_STATE_RXT_CMD;
 	g_ChumbyCmd[0] = 0;
@@ -76,11 +88,11 @@ static void ChumbySetStateWriteLen(short count)
 {
 	if(count < 1) {
 		count = 1;
-		g_ChumbyData[1] = 0;
+		g_ChumbyReply[1] = 0;
 	}
 
-	g_ChumbyData[0] = count;
-	ChumbySpiWrite((void *)g_ChumbyData, 2);
+	g_ChumbyReply[0] = count;
+	ChumbySpiWrite((void *)g_ChumbyReply, 2);
 // BUG: Why does this only work with
 //      count = 2?  Something is broken
 //      When count = 1, ChumbyBend(0)
@@ -93,14 +105,68 @@ static void ChumbySetStateWriteData()
 {
 // Also really weird. The TX circuitry on this chip
 // Is totally fubared.  Oh well
-	ChumbySpiWrite((void *)&(g_ChumbyData[1]), g_ChumbyData[0]+1);
+	ChumbySpiWrite((void *)&(g_ChumbyReply[1]), g_ChumbyReply[0]+1);
 
 	g_ChumbyState = CHUMBY_STATE_TXT_DATA;
 }
 
+static void ChumbyResetReply()
+{
+	if(g_ChumbyReply != g_ChumbyData) {
+		SensorFrameRelease();
+		g_ChumbyReply = g_ChumbyData;
+	}
+}
+
 static void ChumbyHandleCmd(short cmd, short *data, short length)
 {
-	int tmp, outcount = 0;
+	ChumbySetStateWriteLen(ChumbyExecCmd(cmd, data, length));
+}
+
+// Runs each sub-command on a copy of its arguments in g_ChumbyData and
+// appends (count, reply...) to the batch reply
+static short ChumbyExecBatch(short *data, short length)
+{
+	static short in[CHUMBY_MAX_DATA_COUNT];
+	static short out[CHUMBY_MAX_DATA_COUNT];
+	short cmd, count, replies;
+	int i, n, outcount = 0;
+
+	if(length < 1 || length > CHUMBY_MAX_DATA_COUNT)
+		return 0;
+	memcpy(in, data, length*sizeof(short));
+
+	n = in[0];
+	for(i = 1;n > 0 && i+2 <= length;n--) {
+		cmd = in[i];
+		count = in[i+1];
+		i += 2;
+		if(cmd == CBOB_CMD_BATCH || count < 0 || i+count > length)
+			break;
+
+		memcpy(data, &(in[i]), count*sizeof(short));
+		i += count;
+
+		replies = ChumbyExecCmd(cmd, data, count);
+		// reply is sent from g_ChumbyData[1], leave room for the length word
+		if(outcount+1+replies > CHUMBY_MAX_DATA_COUNT-2) {
+			ChumbyResetReply();
+			break;
+		}
+		out[outcount++] = replies;
+		memcpy(&(out[outcount]), (short*)&(g_ChumbyReply[1]), replies*sizeof(short));
+		outcount += replies;
+		ChumbyResetReply();
+	}
+
+	memcpy(&(data[1]), out, outcount*sizeof(short));
+	return outcount;
+}
+
+static short ChumbyExecCmd(short cmd, short *data, short length)
+{
+	int tmp, tmp2, outcount = 0;
+	unsigned int utmp;
 
 	switch(cmd) {
 	case CBOB_CMD_DIGITAL_READ:
@@ -151,6 +217,15 @@ static void ChumbyHandleCmd(short cmd, short *data, short length)
 			data[1] = GetAnalogPullups();
 			outcount += 1;
 		}
+		else if(data[0] == 2) {
+			SetAnalogFilter(data[1], data[2], data[3]);
+			GetAnalogFilter(data[1], &(data[1]));
+			outcount += 2;
+		}
+		else if(data[0] == 3) {
+			GetAnalogFilter(data[1], &(data[1]));
+			outcount += 2;
+		}
 		break;
 	case CBOB_CMD_ACCEL_READ:
 		if(data[0] == 0) {
@@ -184,17 +259,20 @@ static void ChumbyHandleCmd(short cmd, short *data, short length)
 		else if(data[0] == 2) {
 			SetAccelCal(&(data[1]));
 		}
+		else if(data[0] == 3) {
+			SetAccelFilter(data[1], data[2], data[3]);
+			GetAccelFilter(data[1], &(data[1]));
+			outcount += 2;
+		}
+		else if(data[0] == 4) {
+			GetAccelFilter(data[1], &(data[1]));
+			outcount += 2;
+		}
 		break;
 	case CBOB_CMD_SENSORS_READ:
-		g_ChumbyData[1] = AllDigitals() | (BlackButton()<<8);
-		for(outcount = 2;outcount <= 9;outcount++) {
-			g_ChumbyData[outcount] = Analog(outcount-2);
-		}
-		g_ChumbyData[outcount] = BattVoltage();
-		g_ChumbyData[++outcount] = Accel_X();
-		g_ChumbyData[++outcount] = Accel_Y();
-		g_ChumbyData[++outcount] = Accel_Z();
-		g_ChumbyData[++outcount] = GetAnalogPullups();
+		// already packed by the PIT, send it from where it is
+		g_ChumbyReply = SensorFrame();
+		outcount = SENSOR_FRAME_COUNT;
 		break;
 	case CBOB_CMD_SENSORS_CONFIG:
 		break;
@@ -299,6 +377,40 @@ static void ChumbyHandleCmd(short cmd, short *data, short length)
 		else if(data[0] == 8) {
 			SetMotorCal(&(data[1]));
 		}
+		else if(data[0] == 9) {
+				// Set motor loop period in us, replies with the period used
+			data[1] = SetMotorPeriod(data[1]);
+			outcount = 1;
+		}
+		else if(data[0] == 10) {
+				// Get motor loop period in us
+			data[1] = GetMotorPeriod();
+			outcount = 1;
+		}
+		else if(data[0] == 11) {
+				// Set motion profile, accel and jerk as ints
+			if(data[1] >= 0 && data[1] <= 3) {
+				memcpy(&tmp, (void*)&data[2], 4);
+				memcpy(&tmp2, (void*)&data[4], 4);
+				SetMotorProfile(data[1], tmp, tmp2);
+			}
+		}
+		else if(data[0] == 12) {
+				// Get motion profile
+			if(data[1] >= 0 && data[1] <= 3) {
+				GetMotorProfile(data[1], &tmp, &tmp2);
+				memcpy((void*)&data[1], &tmp, 4);
+				memcpy((void*)&data[3], &tmp2, 4);
+				outcount = 4;
+			}
+		}
+		else if(data[0] == 13) {
+				// Profiled move to position: speed, position as int
+			if(data[1] >= 0 && data[1] <= 3) {
+				memcpy(&tmp, (void*)&data[3], 4);
+				MoveProfiled(data[1], data[2], tmp);
+			}
+		}
 		break;
 	case CBOB_CMD_SERVO_READ:
 		if(data[0] >= 0 && data[0] < 4) {
@@ -318,32 +430,136 @@ static void ChumbyHandleCmd(short cmd, short *data, short length)
 		}
 		break;
 	case CBOB_CMD_UART_READ:
+		// BATCH can hand us short or bad commands
+		if(length < 2 || data[1] < 0) data[1] = 0;
+		if(data[1] > CBOB_UART_READ_MAX) data[1] = CBOB_UART_READ_MAX;
 		data[1] = UartRead(data[0], (char*)(&(data[2])), data[1]);
 		outcount = (data[1]>>1)+2;
 		break;
 	case CBOB_CMD_UART_WRITE:
+		// never past the bytes that came with the command
+		if(data[1] > (length-2)*2) data[1] = (length-2)*2;
+		if(length < 2 || data[1] < 0) data[1] = 0;
 		data[1] = UartWrite(data[0], (char*)&(data[2]), data[1]);
 		outcount += 1;
 		break;
 	case CBOB_CMD_UART_CONFIG:
-		UartSetSigmask(data[0]);
-			/*if(data[0] == 0) {
-		UartSetSigmask(data[1]);
-	}
-	else if(data[0] == 1) {
-		data[1] = UartGetSigmask();
-		outcount += 1;
-	}
-	else if(data[0] == 2) {
-		UartReset(data[1]);
-		}*/
-			break;
+		if(data[0] == 0) {
+			memcpy(&tmp, (void*)&data[2], 4);
+			tmp = UartSetBaud(data[1], tmp);
+			memcpy((void*)&data[1], &tmp, 4);
+			outcount += 2;
+		}
+		else if(data[0] == 1) {
+			tmp = UartGetBaud(data[1]);
+			tmp2 = UartTxFree(data[1]);
+			data[4] = UartDropped(data[1]);
+			memcpy((void*)&data[1], &tmp, 4);
+			data[3] = tmp2;
+			outcount += 4;
+		}
+		else if(data[0] == 2) {
+			UartReset(data[1]);
+		}
+		break;
 	case CBOB_CMD_STATUS_READ:
 		data[1] = CBOB_VERSION;
 		outcount += 1;
 		break;
+	case CBOB_CMD_BATCH:
+		outcount = ChumbyExecBatch(data, length);
+		break;
+	case CBOB_CMD_STATE_READ:
+		outcount = ChumbyPackState(data);
+		break;
+	case CBOB_CMD_EVENT_READ:
+		data[1] = ReadEvents(&tmp, &tmp2);
+		data[2] = tmp;
+		data[3] = tmp2;
+		outcount = 3;
+		break;
+	case CBOB_CMD_EVENT_CONFIG:
+		SetEventMask(data[0]);
+		break;
+	case CBOB_CMD_CAPTURE_READ:
+		tmp = data[0];
+		if(tmp < 0 || tmp > CBOB_CAPTURE_READ_MAX) tmp = CBOB_CAPTURE_READ_MAX;
+		data[2] = GetCaptureDropped();
+		data[1] = ReadCaptures(&(data[3]), tmp);
+		outcount = 2 + 3*data[1];
+		break;
+	case CBOB_CMD_CAPTURE_CONFIG:
+		if(data[0] == 0)
+			SetCapture(data[1], data[2]);
+		else if(data[0] == 1) {
+			data[1] = GetCapture(data[1]);
+			outcount = 1;
+		}
+		else if(data[0] == 2) {
+			tmp = GetCaptureCount(data[1]);
+			memcpy(&(data[1]), &tmp, 4);
+			outcount = 2;
+		}
+		else if(data[0] == 3) {
+			if(data[1] == -1) {
+				for(tmp = 0;tmp < 8;tmp++)
+					ClearCaptureCount(tmp);
+			}
+			else
+				ClearCaptureCount(data[1]);
+		}
+		break;
+	case CBOB_CMD_STREAM_READ:
+		tmp = data[0];
+		if(tmp < 0 || tmp > CBOB_STREAM_READ_MAX) tmp = CBOB_STREAM_READ_MAX;
+		data[1] = ReadAnalogStream(&(data[5]), tmp, &utmp, &tmp2);
+		data[2] = tmp2;
+		memcpy(&(data[3]), &utmp, 4);
+		outcount = 4 + data[1];
+		break;
+	case CBOB_CMD_STREAM_CONFIG:
+		if(data[0] == 0) {
+			data[1] = StartAnalogStream(data[1], data[2]);
+			outcount = 1;
+		}
+		else if(data[0] == 1) {
+			data[1] = GetAnalogStreamMask();
+			data[2] = GetAnalogStreamRate();
+			outcount = 2;
+		}
+		break;
 	}
-	ChumbySetStateWriteLen(outcount);
+	return outcount;
+}
+
+// Fills data[1..] for CBOB_CMD_STATE_READ
+static short ChumbyPackState(short *data)
+{
+	unsigned int stamp;
+	short *frame;
+	int i, tmp;
+
+	data[1] = CBOB_STATE_READ_VERSION;
+	data[2] = CBOB_STATE_READ_COUNT;
+	stamp = PitMilliseconds();
+	memcpy(&(data[3]), &stamp, 4);
+
+	// the sensors are packed by the PIT already
+	frame = SensorFrame();
+	memcpy(&(data[5]), &(frame[1]), SENSOR_FRAME_COUNT*sizeof(short));
+	SensorFrameRelease();
+
+	for(i = 0;i < 4;i++) {
+		tmp = GetMotorCounter(i);
+		memcpy(&(data[19+2*i]), &tmp, 4);
+		data[27+i] = GetMotorTPC(i);
+		data[31+i] = GetMotor(i);
+		data[35+i] = GetServoPosition(i);
+	}
+	data[39] = GetMotorsInMotion();
+	data[40] = 0;
+
+	return CBOB_STATE_READ_COUNT;
 }
 
 void ChumbyBend(int value)
@@ -178,8 +178,10 @@ void DMA_WriteBlock(struct dma_dev *channel, uint8 *data, int count)
 		channel->base->PDC_TPR = (uint32)(channel->tx_buf[channel->tx_current]);
 		channel->base->PDC_TCR = count;
 		channel->tx_current ^= 1;
+		return;
 	}
 	
+	// the current buffer is going out, queue behind it
 	while(channel->base->PDC_TNCR) nop();
 	
 	memcpy((void*)(channel->tx_buf[channel->tx_current]), data, count);
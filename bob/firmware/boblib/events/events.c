@@ -0,0 +1,92 @@
+#include "events.h"
+
+#include <bob.h>
+#include <timer/timer.h>
+#include <motors/motors.h>
+#include <sensors/sensors.h>
+#include <chumby/chumby.h>
+#include <capture/capture.h>
+#include <sensors/stream.h>
+
+/* Events
+ *
+ * Things the CBC would otherwise poll for are latched here, and while any
+ * enabled event is pending SS1 is pulsed once per PIT tick.  The CBC reads
+ * and clears them with CBOB_CMD_EVENT_READ.
+ */
+
+static volatile int g_EventsPending = 0;
+static volatile int g_EventMask = EVENT_UART;	// the UART signal used to be always on
+static volatile int g_EventDigitalsChanged = 0;
+static int g_EventLastMoving = 0;
+static int g_EventLastDigitals = 0;
+
+static void EventsCallback(void);
+
+// Sensors and Motors must be initialized first
+void EventsInit(void)
+{
+	g_EventLastMoving = GetMotorsInMotion() & 0xF;
+	g_EventLastDigitals = SensorFrameDigitals();
+	
+	SetPitCallback(EventsCallback, 5);
+}
+
+void Event(int events)
+{
+	g_EventsPending |= events;
+}
+
+void SetEventMask(int mask)
+{
+	g_EventMask = mask & EVENT_ALL;
+}
+
+int GetEventMask(void)
+{
+	return g_EventMask;
+}
+
+int ReadEvents(int *changed, int *digitals)
+{
+	int events = g_EventsPending;
+	
+	*changed = g_EventDigitalsChanged;
+	*digitals = g_EventLastDigitals;
+	g_EventsPending = 0;
+	g_EventDigitalsChanged = 0;
+	
+	return events;
+}
+
+// runs after the sensor frame is packed (PIT slot 4)
+static void EventsCallback(void)
+{
+	int moving, digitals, changed;
+	
+	moving = GetMotorsInMotion() & 0xF;
+	// a motor dropping out of motion has reached its position
+	Event(g_EventLastMoving & ~moving);
+	g_EventLastMoving = moving;
+	
+	digitals = SensorFrameDigitals();
+	changed = (digitals ^ g_EventLastDigitals) & 0x1FF;
+	if(changed) {
+		g_EventDigitalsChanged |= changed;
+		Event(EVENT_DIGITAL);
+	}
+	if(digitals & ~g_EventLastDigitals & (1<<8))
+		Event(EVENT_BUTTON);
+	g_EventLastDigitals = digitals;
+	
+	if(CapturePending())
+		Event(EVENT_CAPTURE);
+	if(AnalogStreamPending())
+		Event(EVENT_STREAM);
+	
+	if(g_EventsPending & g_EventMask) {
+		ChumbySS1(0);
+		ChumbySS1(1);
+		ChumbySS1(0);
+	}
+}
@@ -0,0 +1,22 @@
+#ifndef __EVENTS_H__
+#define __EVENTS_H__
+
+// Event bits, same as CBOB_EVENT_* in cbob_cmd.h
+#define EVENT_MOTOR_DONE(n)	(1<<(n))	// motor n reached its position
+#define EVENT_DIGITAL		(1<<4)		// a digital input changed
+#define EVENT_BUTTON		(1<<5)		// the black button was pressed
+#define EVENT_UART			(1<<6)		// UART data is waiting
+#define EVENT_CAPTURE		(1<<7)		// captured edges are waiting
+#define EVENT_STREAM		(1<<8)		// analog stream samples are waiting
+#define EVENT_ALL			0x1FF
+
+void EventsInit(void);
+void Event(int events);
+
+void SetEventMask(int mask);
+int GetEventMask(void);
+// Returns the pending events and clears them.  changed gets the digitals
+// (bit 8 the button) that changed since the last read, digitals their levels.
+int ReadEvents(int *changed, int *digitals);
+
+#endif
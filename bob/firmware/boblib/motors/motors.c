@@ -6,6 +6,8 @@
 #include <pwmc/pwmc.h>
 #include <timer/timer.h>
 #include <adc/adc.h>
+#include <tc/tc.h>
+#include <aic/aic.h>
 
 #include <stdio.h>
 
@@ -20,7 +22,21 @@
 #define M3_RIGHT_ADC
 
 #define MAXIERROR	 10000
-#define MINIERROR	-10000
+
+// Motor loop states, see MotorCallback
+#define MC_STATE_IDLE	0
+#define MC_STATE_SETTLE	1		// motors off, TC1 timing the induction spike
+								// then the ADC converting the back EMF
+
+// TC1 counts at MCK/2, its TIOA triggers the ADC0 conversion
+#define MC_SETTLE_TICKS	((MCK/2000000)*MC_INDUCTION_SPIKE)
+
+// TC2 counts at MCK/32 and interrupts once per loop
+#define MC_LOOP_TICKS(us)	(((MCK/32000)*(us))/1000)
+
+// PID gains are kept in Q16 fixed point.  They were tuned for a loop every
+// MC_LOOP_PERIOD_US, the I and D gains are rescaled for other periods.
+#define MC_FIX_SHIFT	16
 
 Pin g_Motor[] = {MC_PWM};
 Pin g_MotorOff[] = {MC_PWM_OFF};
@@ -43,9 +59,43 @@ volatile int g_MotorIError[4] = {0,0,0,0};		// Accumulated speed error for Integ
 volatile int g_MotorLastTPC[4] = {0,0,0,0};		// Previous speed error for Derivative term
 volatile int g_MotorGains[4][6];                // Proportional Mult,Integral Mult,Derivative Mult,
 												// Proportional Divi,Integral Divi,Derivative Divi
+volatile int g_MotorState = MC_STATE_IDLE;
+volatile unsigned int g_MotorOverruns = 0;		// PID ticks skipped because the last one was still settling
+
+volatile int g_MotorPeriod = MC_LOOP_PERIOD_US;	// loop period in microseconds
+volatile int g_MotorCounterScale;				// Q16 period/MC_LOOP_PERIOD_US, back EMF to counter ticks
+volatile int g_MotorCounterFrac[4] = {0,0,0,0};	// counter fraction carried between loops
+volatile int g_MotorFixGains[4][3];				// Q16 P, I and D gains, divisions and period folded in
+volatile int g_MotorMaxIError = MAXIERROR;		// integral limit at this period
+
+// Motion profile of a motor in control type 3.  Velocities are TPC and
+// accelerations TPC per MC_LOOP_PERIOD_US, all Q16, positions are Q16
+// counter units.  A jerk of 0 gives a trapezoid, otherwise an S-curve.
+typedef struct {
+	int accelLimit;		// as set, in ticks/s^2 and ticks/s^3
+	int jerkLimit;
+	int accel;			// Q16 limits derived from the above
+	int jerk;
+	long long stopScale;	// Q16 1/(2*accel), so stopping distance is v*v*stopScale
+	long long jerkScale;	// Q16 accel/(2*jerk), the S-curve's extra stopping time
+	int maxVel;
+	int vel;			// where the profile is now
+	int acc;
+	long long pos;
+	int target;			// counter units
+	int dir;
+} MotorProfile;
+
+volatile MotorProfile g_MotorProfile[4];
+
 static void MotorCallback(void);
+static void ISR_MotorADC(void);
+static void MotorControl(void);
+static void ISR_MotorLoop(void);
+static void MotorUpdateGains(int motor);
 
 int MotorPositionControl(int motor);
+static int MotorProfileControl(int motor);
 int PIDSpeedControl(int motor, int err);
 void SetPWM(int motor, int pwm);
 void AllOn(void);
@@ -60,11 +110,22 @@ void MotorsInit(void)
 	PIO_Configure(motorFeedback, PIO_LISTSIZE(motorFeedback));
 	
 	PMC_EnablePeripheral(AT91C_ID_ADC0);
-	ADC_Initialize(AT91C_BASE_ADC0, AT91C_ID_ADC0, AT91C_ADC_TRGEN_DIS, \
-				   0, AT91C_ADC_SLEEP_NORMAL_MODE, AT91C_ADC_LOWRES_10_BIT, \
+	ADC_Initialize(AT91C_BASE_ADC0, AT91C_ID_ADC0, AT91C_ADC_TRGEN_EN, \
+				   AT91C_ADC_TRGSEL_TIOA1, AT91C_ADC_SLEEP_NORMAL_MODE, AT91C_ADC_LOWRES_10_BIT, \
 				   MCK, BOARD_ADC_FREQ, 10, 600);
 	for(i = 0;i < 8;i++) ADC_EnableChannel(AT91C_BASE_ADC0, i);
 	
+	// channel 7 is the last in the sequence, its end of conversion means all 8 are in
+	AIC_ConfigureIT(AT91C_ID_ADC0, AT91C_AIC_PRIOR_LOWEST, ISR_MotorADC);
+	ADC_EnableIt(AT91C_BASE_ADC0, AT91C_ADC_EOC7);
+	AIC_EnableIT(AT91C_ID_ADC0);
+	
+	// one-shot: software trigger drops TIOA1, RC compare raises it and stops the clock
+	PMC_EnablePeripheral(AT91C_ID_TC1);
+	TC_Configure(AT91C_BASE_TC1, AT91C_TC_CLKS_TIMER_DIV1_CLOCK | AT91C_TC_CPCSTOP | AT91C_TC_WAVE | \
+				 AT91C_TC_WAVESEL_UP_AUTO | AT91C_TC_ACPC_SET | AT91C_TC_ASWTRG_CLEAR);
+	AT91C_BASE_TC1->TC_RC = MC_SETTLE_TICKS;
+	
 	// enable the PWM peripheral if it has not already been
 	if(!PMC_IsPeriphEnabled(AT91C_ID_PWMC)) PMC_EnablePeripheral(AT91C_ID_PWMC);
 
@@ -85,11 +146,18 @@ void MotorsInit(void)
 	PWMC_EnableChannel(6);
 	PWMC_EnableChannel(7);
 
-	SetPitCallback(MotorCallback,0);
-	
 	// intialize the motor PID gains;
 	for(i=0;i<4;i++) SetPIDGainsDefault(i);
 	
+	// TC2 paces the loop so its period doesn't move the PIT users
+	PMC_EnablePeripheral(AT91C_ID_TC2);
+	TC_Configure(AT91C_BASE_TC2, AT91C_TC_CLKS_TIMER_DIV3_CLOCK | AT91C_TC_WAVE | AT91C_TC_WAVESEL_UP_AUTO);
+	AIC_ConfigureIT(AT91C_ID_TC2, AT91C_AIC_PRIOR_LOWEST, ISR_MotorLoop);
+	SetMotorPeriod(MC_LOOP_PERIOD_US);
+	AT91C_BASE_TC2->TC_IER = AT91C_TC_CPCS;
+	AIC_EnableIT(AT91C_ID_TC2);
+	AT91C_BASE_TC2->TC_CCR = AT91C_TC_CLKEN | AT91C_TC_SWTRG;
+	
 	usleep(1000000); // wait for power up spike to pass and all motors stop moving before calibrating
 	
 	// make sure the motors calibrate properly, DO NOT SPIN MOTORS DURING CALIBRATION !!
@@ -140,13 +208,9 @@ void AllOn(void)
 	PIO_Configure(g_Motor, PIO_LISTSIZE(g_Motor));
 }	
 
+// reads the back EMF from the last ADC0 conversion
 void UpdateBEMF(void)
 {
-	ADC_StartConversion(AT91C_BASE_ADC0);
-	while((ADC_GetStatus(AT91C_BASE_ADC0) & 0x80) != 0x80) nop();
-	
-	PIO_Set(&(g_MotorDirection[4])); // ENABLE ALL MOTORS
-	
 	g_MotorADC[0] = ADC_GetConvertedData(AT91C_BASE_ADC0,0);
 	g_MotorADC[1] = ADC_GetConvertedData(AT91C_BASE_ADC0,1);
 	g_MotorADC[2] = ADC_GetConvertedData(AT91C_BASE_ADC0,2);
@@ -209,22 +273,61 @@ void SetMotorCal(short *calVal)
 	g_MotorCal[3] = calVal[3];
 }
 
+/* Motor loop
+ *
+ * Nothing in the loop waits.  TC2 turns the motors off and starts
+ * TC1; when the induction spike has settled TC1 raises TIOA1, which
+ * starts the ADC0 conversion in hardware; the end of conversion interrupt
+ * reads the back EMF, turns the motors back on and runs the PID.
+ */
 static void MotorCallback(void)
 {
-	static int i;
-
+	// the last tick never finished, start over
+	if(g_MotorState != MC_STATE_IDLE)
+		g_MotorOverruns++;
+	
 	PIO_Clear(&(g_MotorDirection[4]));	// turn off motors
 	
-	// the following sleep must not be longer than the period of the PIT timer (< 10ms)
-	usleep(MC_INDUCTION_SPIKE); // wait for induction spike to settle
+	g_MotorState = MC_STATE_SETTLE;
+	AT91C_BASE_TC1->TC_CCR = AT91C_TC_CLKEN | AT91C_TC_SWTRG;
+}
+
+static void ISR_MotorLoop(void)
+{
+	AT91C_BASE_TC2->TC_SR;
+	MotorCallback();
+}
+
+static void ISR_MotorADC(void)
+{
+	ADC_GetStatus(AT91C_BASE_ADC0);
+	
+	// a conversion nobody asked for
+	if(g_MotorState != MC_STATE_SETTLE) {
+		ADC_GetConvertedData(AT91C_BASE_ADC0,7);
+		return;
+	}
 	
 	UpdateBEMF();			// read in back EMF analog readings
+	PIO_Set(&(g_MotorDirection[4])); // ENABLE ALL MOTORS
+	
+	MotorControl();
+	g_MotorState = MC_STATE_IDLE;
+}
+
+static void MotorControl(void)
+{
+	static int i;
+	int ticks;
 	
 	// update all counters and speeds
 	for(i=0;i<4;i++){
 		if(g_BackEMF[i] > 3 || g_BackEMF[i] < -3){
 			g_MotorTPC[i] = g_BackEMF[i];
-			g_MotorCounter[i] += g_BackEMF[i];
+			// back EMF is a speed, scale it to the distance covered this period
+			ticks = g_BackEMF[i]*g_MotorCounterScale + g_MotorCounterFrac[i];
+			g_MotorCounter[i] += ticks >> MC_FIX_SHIFT;
+			g_MotorCounterFrac[i] = ticks & ((1<<MC_FIX_SHIFT)-1);
 		}
 		else g_MotorTPC[i] = 0;
 	}
@@ -248,6 +351,11 @@ static void MotorCallback(void)
 				g_MotorInMotion |= (1<<i); // set motor in motion bit
 				g_MotorPWM[i] = MotorPositionControl(i);
 				break;
+			case 3:
+				// motor is following a motion profile to a position
+				g_MotorInMotion |= (1<<i); // set motor in motion bit
+				g_MotorPWM[i] = MotorProfileControl(i);
+				break;
 			default:
 				g_MotorInMotion &= ~(1<<i);
 				g_MotorPWM[i] = 0;
@@ -283,35 +391,138 @@ int MotorPositionControl(int motor)
 	return speed;
 }
 
-int PIDSpeedControl(int motor, int err)
+// a*b >> 16 without overflowing for the a of a stopping distance
+static inline long long MulQ16(long long a, long long b)
 {
-	int Pterm=0, Iterm=0, Dterm=0, PIDterm;
+	return (a >> MC_FIX_SHIFT)*b + (((a & ((1<<MC_FIX_SHIFT)-1))*b) >> MC_FIX_SHIFT);
+}
+
+/* Motion profiles
+ *
+ * Every loop the profile accelerates toward the move speed until the
+ * distance left is what it takes to stop, then decelerates.  With a jerk
+ * limit the acceleration itself ramps, and stopping takes v*a/2j longer.
+ * The motor's speed loop follows the profile speed plus the error to the
+ * profile position.  Once the profile arrives, position control takes
+ * over for the last few ticks.
+ */
+static int MotorProfileControl(int motor)
+{
+	volatile MotorProfile *p = &g_MotorProfile[motor];
+	long long remaining, stopping, step;
+	int want, limit, speed;
+	
+	remaining = (((long long)p->target) << MC_FIX_SHIFT) - p->pos;
+	if(p->dir < 0) remaining = -remaining;
+	
+	// v*v/2a + v*a/2j with the divisions done in SetMotorProfile
+	stopping = MulQ16(((long long)p->vel*p->vel) >> MC_FIX_SHIFT, p->stopScale);
+	if(p->jerk) stopping += MulQ16(p->vel, p->jerkScale);
+	
+	if(stopping >= remaining) want = -p->accel;
+	else if(p->vel < p->maxVel) want = p->accel;
+	else want = 0;
+	
+	if(p->jerk) {
+		limit = ((long long)p->jerk*g_MotorCounterScale) >> MC_FIX_SHIFT;
+		if(want > p->acc + limit) p->acc += limit;
+		else if(want < p->acc - limit) p->acc -= limit;
+		else p->acc = want;
+	}
+	else p->acc = want;
+	
+	p->vel += ((long long)p->acc*g_MotorCounterScale) >> MC_FIX_SHIFT;
+	if(p->vel > p->maxVel) p->vel = p->maxVel;
+	step = ((long long)p->vel*g_MotorCounterScale) >> MC_FIX_SHIFT;
+	
+	// arrived, or stopped short: hold the target with position control
+	if(p->vel <= 0 || step >= remaining) {
+		g_TargetTPC[motor] = p->maxVel >> MC_FIX_SHIFT;
+		g_TargetPosition[motor] = p->target;
+		g_MotorCtrlType[motor] = 2;
+		return MotorPositionControl(motor);
+	}
+	p->pos += p->dir < 0 ? -step : step;
 	
-	// Proportional Term
-	////////////////////////////////////////////////////////////////////////////////
-	Pterm = (g_MotorGains[motor][0] * err)/g_MotorGains[motor][3];
+	speed = p->dir*(p->vel >> MC_FIX_SHIFT) + (int)(p->pos >> MC_FIX_SHIFT) - g_MotorCounter[motor];
+	limit = p->maxVel >> MC_FIX_SHIFT;
+	if(speed > limit) speed = limit;
+	else if(speed < -limit) speed = -limit;
+	
+	return PIDSpeedControl(motor, speed - g_MotorTPC[motor]);
+}
+
+int PIDSpeedControl(int motor, int err)
+{
+	long long PIDterm;
 	
 	// Integral Term
 	////////////////////////////////////////////////////////////////////////////////
 	g_MotorIError[motor] += err;
 	// is the error within the maximum or minimum motor power range?
-	if(g_MotorIError[motor] > MAXIERROR) g_MotorIError[motor] = MAXIERROR;
-	else if(g_MotorIError[motor] < MINIERROR) g_MotorIError[motor] = MINIERROR;
-	
-	Iterm = (g_MotorGains[motor][1] * g_MotorIError[motor])/g_MotorGains[motor][4];
+	if(g_MotorIError[motor] > g_MotorMaxIError) g_MotorIError[motor] = g_MotorMaxIError;
+	else if(g_MotorIError[motor] < -g_MotorMaxIError) g_MotorIError[motor] = -g_MotorMaxIError;
 	
-	// Derivative Term
+	// Proportional, Integral and Derivative terms in Q16, no divides in the loop
 	////////////////////////////////////////////////////////////////////////////////
-	Dterm = (g_MotorGains[motor][2] * (g_MotorTPC[motor] - g_MotorLastTPC[motor]))/g_MotorGains[motor][5];
+	PIDterm = (long long)g_MotorFixGains[motor][0] * err;
+	PIDterm += (long long)g_MotorFixGains[motor][1] * g_MotorIError[motor];
+	PIDterm += (long long)g_MotorFixGains[motor][2] * (g_MotorTPC[motor] - g_MotorLastTPC[motor]);
 	g_MotorLastTPC[motor] = g_MotorTPC[motor];
 	
-	PIDterm = Pterm + Iterm + Dterm;
+	PIDterm = (PIDterm + (1<<(MC_FIX_SHIFT-1))) >> MC_FIX_SHIFT;
 	
 	if(PIDterm > MC_PWM_PERIOD) return MC_PWM_PERIOD;
 	else if(PIDterm < -MC_PWM_PERIOD) return -MC_PWM_PERIOD;
 	else return PIDterm;
 }
 
+// mult/div*num/den in Q16, 0 for a zero divisor
+static int MotorFixGain(int mult, int div, int num, int den)
+{
+	long long gain;
+	
+	if(div == 0) return 0;
+	gain = (((long long)mult << MC_FIX_SHIFT)*num)/((long long)div*den);
+	if(gain > 0x7FFFFFFF) gain = 0x7FFFFFFF;
+	else if(gain < -0x7FFFFFFF) gain = -0x7FFFFFFF;
+	return gain;
+}
+
+// Recomputes the fixed point gains of a motor, the I and D gains are
+// scaled so the loop behaves the same at any period
+static void MotorUpdateGains(int motor)
+{
+	g_MotorFixGains[motor][0] = MotorFixGain(g_MotorGains[motor][0], g_MotorGains[motor][3], 1, 1);
+	g_MotorFixGains[motor][1] = MotorFixGain(g_MotorGains[motor][1], g_MotorGains[motor][4], g_MotorPeriod, MC_LOOP_PERIOD_US);
+	g_MotorFixGains[motor][2] = MotorFixGain(g_MotorGains[motor][2], g_MotorGains[motor][5], MC_LOOP_PERIOD_US, g_MotorPeriod);
+}
+
+// Sets the motor loop period in microseconds, returns the period used
+int SetMotorPeriod(int period)
+{
+	int i;
+	
+	if(period < MC_LOOP_PERIOD_MIN_US) period = MC_LOOP_PERIOD_MIN_US;
+	else if(period > MC_LOOP_PERIOD_MAX_US) period = MC_LOOP_PERIOD_MAX_US;
+	
+	g_MotorPeriod = period;
+	g_MotorCounterScale = (period << MC_FIX_SHIFT)/MC_LOOP_PERIOD_US;
+	// the same most integral contribution as at the reference period
+	g_MotorMaxIError = (MAXIERROR*MC_LOOP_PERIOD_US)/period;
+	for(i=0;i<4;i++) MotorUpdateGains(i);
+	
+	// takes effect at the next RC compare
+	AT91C_BASE_TC2->TC_RC = MC_LOOP_TICKS(period);
+	
+	return period;
+}
+
+int GetMotorPeriod(void)
+{
+	return g_MotorPeriod;
+}
+
 int GetMotorError(int motor)
 {
 	return g_MotorIError[motor];
@@ -350,16 +561,12 @@ void SetPIDGains(int num, short PM, short IM, short DM, short PD, short ID, shor
 	g_MotorGains[num][3] = PD;
 	g_MotorGains[num][4] = ID;
 	g_MotorGains[num][5] = DD;
+	MotorUpdateGains(num);
 }
 
 void SetPIDGainsDefault(int num)
 {
-	g_MotorGains[num][0] = 3;
-	g_MotorGains[num][1] = 3;
-	g_MotorGains[num][2] = -2;
-	g_MotorGains[num][3] = 1;
-	g_MotorGains[num][4] = 2;// 5;
-	g_MotorGains[num][5] = 3;
+	SetPIDGains(num, 3, 3, -2, 1, 2/* 5*/, 3);
 }
 
 void SetPIDAllGains(short PM, short IM, short DM, short PD, short ID, short DD)
@@ -382,6 +589,57 @@ void MoveToPosition(int motor, int speed, int position)
 	g_TargetPosition[motor] = position * MC_POSITION_SCALE;
 }
 
+// Acceleration in ticks/s^2 and jerk in ticks/s^3 for MoveProfiled, an
+// acceleration of 0 turns the profile off and a jerk of 0 gives a trapezoid
+void SetMotorProfile(int motor, int accel, int jerk)
+{
+	volatile MotorProfile *p = &g_MotorProfile[motor];
+	
+	if(accel < 0) accel = -accel;
+	if(jerk < 0) jerk = -jerk;
+	
+	// speeds are TPC = ticks/s >> 1, per MC_LOOP_PERIOD_US of 10ms
+	p->accelLimit = accel;
+	p->jerkLimit = jerk;
+	p->accel = ((long long)accel << MC_FIX_SHIFT)/200;
+	p->jerk = ((long long)jerk << MC_FIX_SHIFT)/20000;
+	if(accel && p->accel == 0) p->accel = 1;
+	if(jerk && p->jerk == 0) p->jerk = 1;
+	// keep the divisions out of the motor interrupt, rounded to nearest
+	p->stopScale = p->accel ? ((1LL << (2*MC_FIX_SHIFT)) + p->accel)/(2*(long long)p->accel) : 0;
+	p->jerkScale = p->jerk ? ((((long long)p->accel) << MC_FIX_SHIFT) + p->jerk)/(2*(long long)p->jerk) : 0;
+}
+
+void GetMotorProfile(int motor, int *accel, int *jerk)
+{
+	*accel = g_MotorProfile[motor].accelLimit;
+	*jerk = g_MotorProfile[motor].jerkLimit;
+}
+
+// MoveToPosition along the motor's profile, starting from rest
+void MoveProfiled(int motor, int speed, int position)
+{
+	volatile MotorProfile *p = &g_MotorProfile[motor];
+	
+	if(p->accel == 0) {
+		MoveToPosition(motor, speed, position);
+		return;
+	}
+	
+	if(speed < 0) speed = -speed;
+	
+	// stop the loop using the profile while it is set up
+	g_MotorCtrlType[motor] = 0;
+	p->maxVel = (speed >> 1) << MC_FIX_SHIFT;
+	p->vel = 0;
+	p->acc = 0;
+	p->pos = ((long long)g_MotorCounter[motor]) << MC_FIX_SHIFT;
+	p->target = position * MC_POSITION_SCALE;
+	p->dir = p->target < g_MotorCounter[motor] ? -1 : 1;
+	g_MotorIError[motor] = 0;
+	g_MotorCtrlType[motor] = 3;
+}
+
 void MoveAtVelocity(int motor, int speed)
 {
 	g_MotorCtrlType[motor] = 1;
@@ -417,6 +675,12 @@ int IsMotorDone(int motor)
 	else return 1;
 }
 
+// bit n is set while motor n is still moving to a position
+int GetMotorsInMotion(void)
+{
+	return g_MotorInMotion;
+}
+
 int GetMotorCounter(int motor)
 {
 	return (g_MotorCounter[motor]/MC_POSITION_SCALE);
@@ -6,6 +6,9 @@ void MotorsInit(void);
 int MotorCalibration(void);
 void MoveToPosition(int motor, int speed, int position);
 void MoveAtVelocity(int motor, int speed);
+void SetMotorProfile(int motor, int accel, int jerk);
+void GetMotorProfile(int motor, int *accel, int *jerk);
+void MoveProfiled(int motor, int speed, int position);
 void Motor(int motor, int power);
 int GetMotor(int motor);
 int GetMotorCounter(int motor);
@@ -13,6 +16,7 @@ int ClearMotorCounter(int motor);
 int SetMotorCounter(int motor, int counter);
 int BlockMotorDone(int motor);
 int IsMotorDone(int motor);
+int GetMotorsInMotion(void);
 void GetPIDGains(short num, short *PM, short *IM, short *DM, short *PD, short *ID, short *DD);
 void SetPIDGains(int num, short PM, short IM, short DM, short PD, short ID, short DD);
 void SetPIDGainsDefault(int num);
@@ -23,4 +27,6 @@ int GetMotorError(int motor);
 int GetMotorTPC(int motor);
 int GetTargetTPC(int motor);
 int GetMotorControlState(int motor);
+int SetMotorPeriod(int period);
+int GetMotorPeriod(void);
 #endif
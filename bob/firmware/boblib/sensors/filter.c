@@ -0,0 +1,90 @@
+#include "filter.h"
+
+/* Sensor filters
+ *
+ * The PIT samples every sensor each tick, so smoothing here costs the CBC
+ * nothing and a single read returns the filtered value.  The average keeps
+ * a running sum instead of adding up its window every sample, the median
+ * sorts a copy of its (small) window and the IIR is a shift, no divides.
+ * Until a window fills, the average and median use the samples they have.
+ */
+
+void FilterSet(Filter *f, int type, int size)
+{
+	switch(type) {
+		case FILTER_AVERAGE:
+			if(size > FILTER_WINDOW_MAX) size = FILTER_WINDOW_MAX;
+			break;
+		case FILTER_MEDIAN:
+			if(size > FILTER_MEDIAN_MAX) size = FILTER_MEDIAN_MAX;
+			break;
+		case FILTER_IIR:
+			if(size > FILTER_SHIFT_MAX) size = FILTER_SHIFT_MAX;
+			break;
+		default:
+			type = FILTER_NONE;
+			size = 0;
+	}
+	if(type != FILTER_NONE && size < 1) size = 1;
+	
+	f->type = type;
+	f->size = size;
+}
+
+void FilterGet(Filter *f, short *config)
+{
+	config[0] = f->type;
+	config[1] = f->size;
+}
+
+static int FilterMedian(Filter *f)
+{
+	short sorted[FILTER_MEDIAN_MAX];
+	int i, j, x;
+	
+	for(i = 0;i < f->count;i++) {
+		x = f->window[i];
+		for(j = i;j > 0 && sorted[j-1] > x;j--)
+			sorted[j] = sorted[j-1];
+		sorted[j] = x;
+	}
+	return sorted[f->count/2];
+}
+
+int FilterUpdate(Filter *f, int x)
+{
+	if(f->activeType != f->type || f->activeSize != f->size) {
+		f->activeType = f->type;
+		f->activeSize = f->size;
+		f->count = 0;
+		f->index = 0;
+		f->sum = 0;
+	}
+	
+	switch(f->activeType) {
+		case FILTER_AVERAGE:
+			if(f->count < f->activeSize)
+				f->count++;
+			else
+				f->sum -= f->window[f->index];
+			f->sum += x;
+			f->window[f->index] = x;
+			if(++f->index >= f->activeSize) f->index = 0;
+			return f->sum/f->count;
+		case FILTER_MEDIAN:
+			if(f->count < f->activeSize) f->count++;
+			f->window[f->index] = x;
+			if(++f->index >= f->activeSize) f->index = 0;
+			return FilterMedian(f);
+		case FILTER_IIR:
+			if(f->count == 0) {
+				f->sum = x<<8;
+				f->count = 1;
+			}
+			else
+				f->sum += ((x<<8) - f->sum) >> f->activeSize;
+			return (f->sum + 128) >> 8;
+		default:
+			return x;
+	}
+}
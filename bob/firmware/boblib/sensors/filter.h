@@ -0,0 +1,36 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+// Filter types, match CBOB_FILTER_* in cbob_cmd.h
+#define FILTER_NONE    0
+#define FILTER_AVERAGE 1	// mean of the last size samples
+#define FILTER_MEDIAN  2	// median of the last size samples
+#define FILTER_IIR     3	// y += (x - y)/2^size
+
+#define FILTER_WINDOW_MAX 40
+#define FILTER_MEDIAN_MAX 9
+#define FILTER_SHIFT_MAX  8
+
+// One filtered sensor.  FilterSet only records the new settings, the
+// sampling side switches over and starts from scratch on its next
+// FilterUpdate, so settings can change from any interrupt.
+typedef struct {
+	volatile short type;
+	volatile short size;
+	short activeType;
+	short activeSize;
+	int count;		// samples in window, up to activeSize
+	int index;		// next slot in window
+	int sum;		// running sum, or the IIR output << 8
+	short window[FILTER_WINDOW_MAX];
+} Filter;
+
+#define FILTER_INIT(type, size) {(type), (size), -1, 0, 0, 0, 0, {0}}
+
+// Clamps size to what type supports
+void FilterSet(Filter *f, int type, int size);
+void FilterGet(Filter *f, short *config);
+// Adds sample x and returns the filtered value
+int FilterUpdate(Filter *f, int x);
+
+#endif
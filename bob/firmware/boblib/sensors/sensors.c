@@ -6,6 +6,9 @@
 #include <pmc/pmc.h>
 #include <twi/twi.h>
 #include <timer/timer.h>
+#include <accel/accel.h>
+#include "stream.h"
+#include "filter.h"
 
 #include <stdio.h>
 
@@ -26,31 +29,38 @@ char g_DigitalPullups = 0;
 short g_DigitalConfigMask = 0;
 volatile int g_AnalogReading[8];
 volatile int g_BatteryCounter = 0;
-volatile int g_BatteryVoltage[40];
-volatile int g_BatteryVoltageIndex = -1;
 volatile int g_BatteryAverage;
+// analog ports 0-7, then the battery which averages 40 samples (2.4s) by default
+static Filter g_AnalogFilter[9] = {
+	FILTER_INIT(FILTER_NONE, 0), FILTER_INIT(FILTER_NONE, 0),
+	FILTER_INIT(FILTER_NONE, 0), FILTER_INIT(FILTER_NONE, 0),
+	FILTER_INIT(FILTER_NONE, 0), FILTER_INIT(FILTER_NONE, 0),
+	FILTER_INIT(FILTER_NONE, 0), FILTER_INIT(FILTER_NONE, 0),
+	FILTER_INIT(FILTER_AVERAGE, 40)
+};
 static void SensorsCallback(void);
+static void SensorFrameCallback(void);
+
+// Double buffered sensor frame.  Each buffer is laid out the way the chumby
+// reply goes out: [0] the length word, [1..SENSOR_FRAME_COUNT] the data and
+// a pad word, since the reply DMA sends length+1 words from [1].  The PIT
+// builds the back buffer and swaps, skipping a tick if the back buffer is
+// still being sent.
+#define SENSOR_FRAME_SIZE (SENSOR_FRAME_COUNT+2)
+static short g_SensorFrame[2][SENSOR_FRAME_SIZE];
+static volatile int g_SensorFrameFront = 0;
+static volatile int g_SensorFrameBusy = -1;
 
 void CalculateBatteryPower(int voltage)
 {
-	int i, sum;
-	
 	voltage = (9990*voltage)/1023;
 	
-	if(g_BatteryVoltageIndex == -1) {
-		for(i = 0;i < 40;i++)
-			g_BatteryVoltage[i] = voltage;
-		g_BatteryVoltageIndex = 0;
-	}
-	else {
-		g_BatteryVoltage[g_BatteryVoltageIndex++] = voltage;
-		if(g_BatteryVoltageIndex >= 40) g_BatteryVoltageIndex = 0;
-	}
-	
-	for(i = 0;i < 40;i++)
-		sum += g_BatteryVoltage[i];
-	
-	g_BatteryAverage = sum/40;
+	g_BatteryAverage = FilterUpdate(&(g_AnalogFilter[8]), voltage);
+}
+
+static void UpdateAnalog(int port)
+{
+	g_AnalogReading[port] = FilterUpdate(&(g_AnalogFilter[port]), ADC_GetConvertedData(AT91C_BASE_ADC1, port));
 }
 
 void SensorsTestInit()
@@ -100,8 +110,11 @@ void SensorsInit()
 				   0, AT91C_ADC_SLEEP_NORMAL_MODE, AT91C_ADC_LOWRES_10_BIT, \
 				   MCK, BOARD_ADC_FREQ, 10, 3000);
 	for(i = 0;i < 8;i++) ADC_EnableChannel(AT91C_BASE_ADC1, i);
+	StreamInit();
 
 	SetPitCallback(SensorsCallback,1);
+	// after the accelerometer callback so the frame has this tick's values
+	SetPitCallback(SensorFrameCallback,4);
 	
 	SelectAng0();		// select analog port 0 to be mesured instead of BattVoltage
 	SensorPowerOn();	// turn on the Vcc line
@@ -128,6 +141,52 @@ static void SensorsCallback(void)
 	UpdateAnalogs();
 }
 
+static void SensorFrameCallback(void)
+{
+	int back = !g_SensorFrameFront;
+	unsigned int pdsr;
+	short *frame;
+	int i;
+	
+	if(back == g_SensorFrameBusy)
+		return;
+	frame = g_SensorFrame[back];
+	
+	// digitals and the black button all live on PIOB, one read for all of them
+	pdsr = ~AT91C_BASE_PIOB->PIO_PDSR;
+	frame[1] = (pdsr & sensorsPower[3].mask) ? (1<<8) : 0;
+	for(i = 0;i < 8;i++)
+		if(pdsr & digitalIns[i].mask) frame[1] |= 1<<i;
+	
+	for(i = 0;i < 8;i++)
+		frame[2+i] = g_AnalogReading[i];
+	frame[10] = g_BatteryAverage;
+	frame[11] = Accel_X();
+	frame[12] = Accel_Y();
+	frame[13] = Accel_Z();
+	frame[14] = g_AnalogPullupMask;
+	
+	g_SensorFrameFront = back;
+}
+
+// Returns the newest frame and keeps it from being rebuilt until released
+short *SensorFrame(void)
+{
+	g_SensorFrameBusy = g_SensorFrameFront;
+	return g_SensorFrame[g_SensorFrameBusy];
+}
+
+void SensorFrameRelease(void)
+{
+	g_SensorFrameBusy = -1;
+}
+
+// digitals word of the newest frame, bits 0-7 digital ports, bit 8 black button
+int SensorFrameDigitals(void)
+{
+	return g_SensorFrame[g_SensorFrameFront][1];
+}
+
 void DigitalInit()
 {
 	PIO_Configure(digitalIns, PIO_LISTSIZE(digitalIns));
@@ -272,21 +331,24 @@ short GetDigitalConfig()
 
 void UpdateAnalogs(void)
 {
-	ADC_StartConversion(AT91C_BASE_ADC1);
-	while((ADC_GetStatus(AT91C_BASE_ADC1) & 0x80) != 0x80) nop();
-	//g_AnalogReading[0] = ADC_GetConvertedData(AT91C_BASE_ADC1,0);
-	g_AnalogReading[1] = ADC_GetConvertedData(AT91C_BASE_ADC1,1);
-	g_AnalogReading[2] = ADC_GetConvertedData(AT91C_BASE_ADC1,2);
-	g_AnalogReading[3] = ADC_GetConvertedData(AT91C_BASE_ADC1,3);
-	g_AnalogReading[4] = ADC_GetConvertedData(AT91C_BASE_ADC1,4);
-	g_AnalogReading[5] = ADC_GetConvertedData(AT91C_BASE_ADC1,5);
-	g_AnalogReading[6] = ADC_GetConvertedData(AT91C_BASE_ADC1,6);
-	g_AnalogReading[7] = ADC_GetConvertedData(AT91C_BASE_ADC1,7);
+	int streaming = GetAnalogStreamMask();
+	int i;
+	
+	// a running stream converts far more often, use its latest results
+	if(!streaming) {
+		ADC_StartConversion(AT91C_BASE_ADC1);
+		while((ADC_GetStatus(AT91C_BASE_ADC1) & 0x80) != 0x80) nop();
+	}
+	// port 0 shares its channel with the battery, see below
+	for(i = 1;i < 8;i++)
+		UpdateAnalog(i);
 	
 	
 	switch(g_BatteryCounter) {
 		case 0:
-			g_AnalogReading[0] = ADC_GetConvertedData(AT91C_BASE_ADC1, 0);
+			UpdateAnalog(0);
+			// port 0 would stream the battery voltage, measure it later
+			if(streaming & 1) return;
 			SelectBattV();
 			break;
 		case 1:
@@ -296,7 +358,7 @@ void UpdateAnalogs(void)
 		case BATTV_PERIOD:
 			g_BatteryCounter = -1;
 		default:
-			g_AnalogReading[0] = ADC_GetConvertedData(AT91C_BASE_ADC1, 0);
+			UpdateAnalog(0);
 	}
 	g_BatteryCounter++;
 }
@@ -371,6 +433,25 @@ short GetAnalogPullups()
 	return g_AnalogPullupMask;
 }
 
+// port 0-7 or 8 for the battery, -1 sets analogs 0-7
+void SetAnalogFilter(int port, int type, int size)
+{
+	int i;
+	
+	if(port == -1) {
+		for(i = 0;i < 8;i++) FilterSet(&(g_AnalogFilter[i]), type, size);
+	}
+	else if(port >= 0 && port <= 8)
+		FilterSet(&(g_AnalogFilter[port]), type, size);
+}
+
+// config gets the type and size, -1 returns port 0's
+void GetAnalogFilter(int port, short *config)
+{
+	if(port < 0 || port > 8) port = 0;
+	FilterGet(&(g_AnalogFilter[port]), config);
+}
+
 void SensorPowerOn(void)
 {
 	PIO_Clear(&(sensorsPower[0]));
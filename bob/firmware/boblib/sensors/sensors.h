@@ -22,6 +22,9 @@ int Analog(int port);
 void AnalogPullup(int port, int state);
 void SetAnalogPullups(short mask);
 short GetAnalogPullups();
+// FILTER_* from filter.h, port 8 is the battery
+void SetAnalogFilter(int port, int type, int size);
+void GetAnalogFilter(int port, short *config);
 
 void SensorPowerOn(void);
 void SensorPowerOff(void);
@@ -31,6 +34,14 @@ void SelectBattV(void);
 void SelectAng0(void);
 
 int BattVoltage(void);
+
+// Packed CBOB_CMD_SENSORS_READ reply, rebuilt every PIT tick: digitals,
+// analog 0-7, battery, accel x y z, analog pullups
+#define SENSOR_FRAME_COUNT 14
+
+short *SensorFrame(void);
+void SensorFrameRelease(void);
+int SensorFrameDigitals(void);
 int Charging();
 unsigned char WritePullupData(unsigned int iaddress, char *bytes, unsigned int num);
 
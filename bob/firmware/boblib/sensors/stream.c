@@ -0,0 +1,158 @@
+#include "stream.h"
+
+#include <bob.h>
+#include <adc/adc.h>
+#include <aic/aic.h>
+#include <pmc/pmc.h>
+#include <tc/tc.h>
+
+/* Analog streaming
+ *
+ * TC3 raises TIOA3 rate times a second and each rising edge makes ADC1
+ * convert all 8 channels.  The end of channel 7's conversion stores the
+ * selected ports as one frame in a ring of samples, which the CBC drains
+ * with CBOB_CMD_STREAM_READ.  While the stream runs UpdateAnalogs only
+ * reads the results instead of starting its own conversions.
+ *
+ * Frames in the ring are always consecutive: once a frame doesn't fit,
+ * new frames are dropped until the ring has been emptied.
+ */
+
+// TC3 counts MCK/32
+#define STREAM_TC_CLOCK (MCK/32)
+
+static short g_StreamRing[STREAM_RING_SIZE];
+static volatile int g_StreamWrite = 0;
+static volatile int g_StreamRead = 0;
+static volatile int g_StreamMask = 0;
+static volatile int g_StreamPorts = 0;			// samples per frame
+static volatile int g_StreamRate = 0;
+static volatile unsigned int g_StreamIndex = 0;	// frames triggered so far
+static volatile unsigned int g_StreamFirst = 0;	// frame number at g_StreamRead
+static volatile int g_StreamDropped = 0;
+static volatile int g_StreamOverflow = 0;
+
+static void ISR_AnalogStream(void);
+
+void StreamInit(void)
+{
+	PMC_EnablePeripheral(AT91C_ID_TC3);
+	// TIOA3 drops at RA and rises at RC, one ADC trigger per period
+	TC_Configure(AT91C_BASE_TC3, AT91C_TC_CLKS_TIMER_DIV3_CLOCK | AT91C_TC_WAVE | \
+				 AT91C_TC_WAVESEL_UP_AUTO | AT91C_TC_ACPA_CLEAR | AT91C_TC_ACPC_SET);
+	
+	AIC_ConfigureIT(AT91C_ID_ADC1, AT91C_AIC_PRIOR_LOWEST, ISR_AnalogStream);
+	AIC_EnableIT(AT91C_ID_ADC1);
+}
+
+int StartAnalogStream(int mask, int rate)
+{
+	int i, ports = 0;
+	
+	StopAnalogStream();
+	
+	mask &= 0xFF;
+	if(mask == 0) return 0;
+	
+	if(rate < STREAM_RATE_MIN) rate = STREAM_RATE_MIN;
+	if(rate > STREAM_RATE_MAX) rate = STREAM_RATE_MAX;
+	
+	for(i = 0;i < 8;i++)
+		if(mask & (1<<i)) ports++;
+	
+	g_StreamWrite = g_StreamRead = 0;
+	g_StreamIndex = g_StreamFirst = 0;
+	g_StreamDropped = g_StreamOverflow = 0;
+	g_StreamPorts = ports;
+	g_StreamMask = mask;
+	
+	AT91C_BASE_TC3->TC_RC = STREAM_TC_CLOCK/rate;
+	AT91C_BASE_TC3->TC_RA = AT91C_BASE_TC3->TC_RC/2;
+	g_StreamRate = STREAM_TC_CLOCK/AT91C_BASE_TC3->TC_RC;
+	
+	AT91C_BASE_ADC1->ADC_MR = (AT91C_BASE_ADC1->ADC_MR & ~AT91C_ADC_TRGSEL) | \
+							  AT91C_ADC_TRGEN_EN | AT91C_ADC_TRGSEL_TIOA3;
+	ADC_EnableIt(AT91C_BASE_ADC1, AT91C_ADC_EOC7);
+	AT91C_BASE_TC3->TC_CCR = AT91C_TC_CLKEN | AT91C_TC_SWTRG;
+	
+	return g_StreamRate;
+}
+
+void StopAnalogStream(void)
+{
+	AT91C_BASE_TC3->TC_CCR = AT91C_TC_CLKDIS;
+	ADC_DisableIt(AT91C_BASE_ADC1, AT91C_ADC_EOC7);
+	AT91C_BASE_ADC1->ADC_MR &= ~AT91C_ADC_TRGEN_EN;
+	g_StreamMask = 0;
+	g_StreamRate = 0;
+}
+
+int GetAnalogStreamMask(void)
+{
+	return g_StreamMask;
+}
+
+int GetAnalogStreamRate(void)
+{
+	return g_StreamRate;
+}
+
+int AnalogStreamPending(void)
+{
+	return g_StreamWrite != g_StreamRead;
+}
+
+int ReadAnalogStream(short *data, int max, unsigned int *first, int *dropped)
+{
+	int count = 0, read = g_StreamRead, ports = g_StreamPorts;
+	
+	*first = g_StreamFirst;
+	*dropped = g_StreamDropped;
+	g_StreamDropped = 0;
+	if(ports == 0) return 0;
+	
+	max -= max % ports;
+	while(count < max && read != g_StreamWrite) {
+		data[count++] = g_StreamRing[read];
+		read = (read + 1) % STREAM_RING_SIZE;
+	}
+	g_StreamFirst += count/ports;
+	g_StreamRead = read;
+	
+	return count;
+}
+
+static void ISR_AnalogStream(void)
+{
+	int i, used, next;
+	short sample[8];
+	
+	ADC_GetStatus(AT91C_BASE_ADC1);
+	// reading every channel clears all the end of conversion flags
+	for(i = 0;i < 8;i++)
+		sample[i] = ADC_GetConvertedData(AT91C_BASE_ADC1, i);
+	if(g_StreamMask == 0) return;
+	
+	g_StreamIndex++;
+	if(g_StreamWrite == g_StreamRead) {
+		// empty, start over from this frame
+		g_StreamFirst = g_StreamIndex - 1;
+		g_StreamOverflow = 0;
+	}
+	
+	used = (g_StreamWrite - g_StreamRead + STREAM_RING_SIZE) % STREAM_RING_SIZE;
+	if(g_StreamOverflow || used + g_StreamPorts >= STREAM_RING_SIZE) {
+		g_StreamOverflow = 1;
+		g_StreamDropped++;
+		return;
+	}
+	
+	next = g_StreamWrite;
+	for(i = 0;i < 8;i++) {
+		if(g_StreamMask & (1<<i)) {
+			g_StreamRing[next] = sample[i];
+			next = (next + 1) % STREAM_RING_SIZE;
+		}
+	}
+	g_StreamWrite = next;
+}
@@ -0,0 +1,26 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+// Sample rates the stream runs at, in Hz
+#define STREAM_RATE_MIN 100
+#define STREAM_RATE_MAX 10000
+
+// Samples the BoB buffers, about 100ms of all 8 ports at 2kHz
+#define STREAM_RING_SIZE 2048
+
+void StreamInit(void);
+
+// Samples the analog ports in mask (bit n = port n) rate times a second,
+// returns the rate used.  mask 0 stops the stream.
+int StartAnalogStream(int mask, int rate);
+void StopAnalogStream(void);
+int GetAnalogStreamMask(void);
+int GetAnalogStreamRate(void);
+int AnalogStreamPending(void);
+
+// Copies whole frames, one sample per port in the mask in port order, up
+// to max samples.  first gets the number of the first frame since the
+// stream started, dropped the frames lost since the last read.
+int ReadAnalogStream(short *data, int max, unsigned int *first, int *dropped);
+
+#endif
@@ -11,6 +11,9 @@
 volatile PITCallback g_Callbacks[10] = {0,0,0,0,0,0,0,0,0,0};
 volatile unsigned int mseconds = 0;
 volatile unsigned int InterruptTicks = 0;
+// PIT periods since PitInit, and the period length in ms
+volatile unsigned int g_PitTicks = 0;
+static unsigned int g_PitPeriod = 0;
 
 static void ISR_Pit(void);
 static void ISR_TC0();
@@ -24,6 +27,7 @@ void PitInit(unsigned int msperiod)
 	// calculates the PIT Value accurate to a Millisecond interrupt
 	// msperiod can not be larget than 349 because PIV is at a 20bit limit
 	if(msperiod > 349) msperiod = 349;
+	g_PitPeriod = msperiod;
     PIT_SetPIV((MCK/(16*1000))*msperiod);
 	
     // Configure interrupt on PIT
@@ -56,16 +60,48 @@ static void ISR_Pit(void)
 	int i=0;
 	
 	time = PIT_GetPIVR();
+	// PICNT is the number of periods since the last acknowledge
+	g_PitTicks += time >> 20;
 	
 	for(i=0;i<9;i++){
 		if(g_Callbacks[i])
 			((PITCallback)g_Callbacks[i])();
 	}
 	
+	// this read acknowledges any period that ended during the callbacks,
+	// count it too or the clock falls behind
 	time = PIT_GetPIVR();
+	g_PitTicks += time >> 20;
 	InterruptTicks = time;
 }
 
+// milliseconds since PitInit, from the PIT tick count and its current value
+unsigned int PitMilliseconds(void)
+{
+	unsigned int ticks, value;
+	
+	// retry if the PIT interrupt acknowledged a period in between
+	do {
+		ticks = g_PitTicks;
+		value = PIT_GetPIIR();
+	} while(ticks != g_PitTicks);
+	
+	return (ticks + (value >> 20))*g_PitPeriod + (value & 0xFFFFF)/(MCK/(16*1000));
+}
+
+// microseconds since PitInit, wraps after about 71 minutes
+unsigned int PitMicroseconds(void)
+{
+	unsigned int ticks, value;
+	
+	do {
+		ticks = g_PitTicks;
+		value = PIT_GetPIIR();
+	} while(ticks != g_PitTicks);
+	
+	return (ticks + (value >> 20))*g_PitPeriod*1000 + (value & 0xFFFFF)/(MCK/(16*1000000));
+}
+
 int SetPitCallback(PITCallback c, int num)
 {
 	if(num < 0 || num > 9) return -1;
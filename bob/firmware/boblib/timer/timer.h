@@ -7,6 +7,8 @@ typedef void (*PITCallback)();
 void PitInit(unsigned int msperiod);
 unsigned int GetPITValueReset(void);
 unsigned int GetPITValue(void);
+unsigned int PitMilliseconds(void);
+unsigned int PitMicroseconds(void);
 int SetPitCallback(PITCallback c, int num);
 
 void usleep(unsigned int usecs);
@@ -6,6 +6,7 @@
 #include <chumby/chumby.h>
 #include <stdio.h>
 #include <timer/timer.h>
+#include <events/events.h>
 
 #include <pmc/pmc.h>
 #include <pio/pio.h>
@@ -29,6 +30,17 @@ volatile int g_Uart0ReadIndex = 0;
 unsigned char g_Uart1Buffer[UART_BUFFER_SIZE];
 volatile int g_Uart1BufferIndex = 0;
 volatile int g_Uart1BufferReadIndex = 0;
+volatile int g_Uart1Dropped = 0;
+
+// Bytes waiting for the DMA, the PIT and UartWrite hand them over a DMA
+// buffer at a time
+unsigned char g_Uart1TxBuffer[UART_BUFFER_SIZE];
+volatile int g_Uart1TxWrite = 0;
+volatile int g_Uart1TxRead = 0;
+volatile int g_Uart1TxBlocked = 0;
+unsigned char g_Uart1TxBlock[DMA_BUFFER_SIZE];
+
+volatile int g_Uart1Baud = UART_BAUD_DEFAULT;
 
 struct dma_dev g_Uart1DMA;
 
@@ -48,6 +60,8 @@ static void UartUsbWrite(void *pArg,
 												 unsigned int remaining);
 static void UartRefresh();
 static void UartWiggle();
+static void UartFeed();
+static void UartConfigure(int baud);
 
 int UartInit()
 {
@@ -56,11 +70,7 @@ int UartInit()
 	PIO_Configure(g_UartPins, PIO_LISTSIZE(g_UartPins));
 	PMC_EnablePeripheral(AT91C_ID_US0);
 	
-	USART_Configure(AT91C_BASE_US0, AT91C_US_USMODE_NORMAL | AT91C_US_CLKS_CLOCK | 
-																	AT91C_US_CHRL_8_BITS | AT91C_US_PAR_NONE | 
-																	AT91C_US_NBSTOP_1_BIT, 57600, MCK);
-	USART_SetReceiverEnabled(AT91C_BASE_US0, 1);
-	USART_SetTransmitterEnabled(AT91C_BASE_US0, 1);
+	UartConfigure(g_Uart1Baud);
 	
 	DMA_Init(&g_Uart1DMA, AT91C_BASE_PDC_US0);
 	
@@ -76,20 +86,114 @@ void UartStartRead()
 	CDCDSerialDriver_Read(g_UartUsbReadBuffer, USB_BUFFER_SIZE, UartUsbRead, 0);
 }
 
+static void UartConfigure(int baud)
+{
+	USART_Configure(AT91C_BASE_US0, AT91C_US_USMODE_NORMAL | AT91C_US_CLKS_CLOCK | 
+																	AT91C_US_CHRL_8_BITS | AT91C_US_PAR_NONE | 
+																	AT91C_US_NBSTOP_1_BIT, baud, MCK);
+	USART_SetReceiverEnabled(AT91C_BASE_US0, 1);
+	USART_SetTransmitterEnabled(AT91C_BASE_US0, 1);
+}
+
+// Takes effect right away, bytes already in the DMA go out at the new rate
+int UartSetBaud(int uart, int baud)
+{
+	if(uart != 1)
+		return 0;
+	if(baud < UART_BAUD_MIN) baud = UART_BAUD_MIN;
+	if(baud > UART_BAUD_MAX) baud = UART_BAUD_MAX;
+	
+	g_Uart1Baud = baud;
+	UartConfigure(baud);
+	return baud;
+}
+
+int UartGetBaud(int uart)
+{
+	return uart == 1 ? g_Uart1Baud : 0;
+}
+
+#define BUFF_USED(readIndex,writeIndex,size) \
+				    ((writeIndex - readIndex + size) % size)
+#define BUFF_FREE(readIndex,writeIndex,size) \
+				    (size - 1 - BUFF_USED(readIndex,writeIndex,size))
+
+// Drains everything the DMA has received, the DMA buffers only cover a few
+// PIT ticks at 115200.  Bytes that don't fit in the ring are dropped.
 static void UartRefresh()
 {
-	if(g_Uart1BufferIndex + 64 >= UART_BUFFER_SIZE) {
-		g_Uart1BufferIndex += DMA_Read(&g_Uart1DMA, &(g_Uart1Buffer[g_Uart1BufferIndex]), UART_BUFFER_SIZE-g_Uart1BufferIndex);
-	}
-	else g_Uart1BufferIndex += DMA_Read(&g_Uart1DMA, &(g_Uart1Buffer[g_Uart1BufferIndex]), 64);
+	unsigned char discard[64];
+	int space, count;
 	
-	if(g_Uart1BufferIndex == UART_BUFFER_SIZE) {
-		g_Uart1BufferIndex = 0;
+	do {
+		space = BUFF_FREE(g_Uart1BufferReadIndex, g_Uart1BufferIndex, UART_BUFFER_SIZE);
+		if(space == 0) {
+			count = DMA_Read(&g_Uart1DMA, discard, sizeof(discard));
+			g_Uart1Dropped += count;
+			continue;
+		}
+		if(space > UART_BUFFER_SIZE - g_Uart1BufferIndex)
+			space = UART_BUFFER_SIZE - g_Uart1BufferIndex;
+		
+		count = DMA_Read(&g_Uart1DMA, &(g_Uart1Buffer[g_Uart1BufferIndex]), space);
+		if(g_Uart1BufferIndex + count >= UART_BUFFER_SIZE)
+			g_Uart1BufferIndex = 0;
+		else
+			g_Uart1BufferIndex += count;
+	} while(count > 0);
+	
+	UartFeed();
+	
+	// the CBC stopped writing at the high watermark, tell it there's room
+	if(g_Uart1TxBlocked &&
+	   BUFF_USED(g_Uart1TxRead, g_Uart1TxWrite, UART_BUFFER_SIZE) < UART_TX_LOW_WATER) {
+		g_Uart1TxBlocked = 0;
+		Event(EVENT_UART);
 	}
 	
 	UartWiggle();
 }
 
+// Hands the next DMA buffer's worth of the TX ring to the PDC once its
+// next buffer is free
+static void UartFeed()
+{
+	int count, first;
+	
+	if(g_Uart1TxRead == g_Uart1TxWrite || g_Uart1DMA.base->PDC_TNCR)
+		return;
+	
+	count = BUFF_USED(g_Uart1TxRead, g_Uart1TxWrite, UART_BUFFER_SIZE);
+	if(count > DMA_BUFFER_SIZE) count = DMA_BUFFER_SIZE;
+	
+	first = UART_BUFFER_SIZE - g_Uart1TxRead;
+	if(first > count) first = count;
+	memcpy(g_Uart1TxBlock, &(g_Uart1TxBuffer[g_Uart1TxRead]), first);
+	memcpy(&(g_Uart1TxBlock[first]), g_Uart1TxBuffer, count - first);
+	g_Uart1TxRead = (g_Uart1TxRead + count) % UART_BUFFER_SIZE;
+	
+	DMA_WriteBlock(&g_Uart1DMA, g_Uart1TxBlock, count);
+}
+
+int UartTxFree(int uart)
+{
+	if(uart != 1)
+		return 0;
+	return BUFF_FREE(g_Uart1TxRead, g_Uart1TxWrite, UART_BUFFER_SIZE);
+}
+
+// bytes dropped because the receive ring was full, since the last call
+int UartDropped(int uart)
+{
+	int dropped;
+	
+	if(uart != 1)
+		return 0;
+	dropped = g_Uart1Dropped;
+	g_Uart1Dropped = 0;
+	return dropped;
+}
+
 void UartSetSigmask(int mask)
 {
 	g_UartSigmask = mask;
@@ -105,15 +209,18 @@ static void UartWiggle()
 	if(g_Uart1BufferIndex != g_Uart1BufferReadIndex)
 		data_ready = 1;
 		
-	if(data_ready) {
-		ChumbySS1(0);
-		ChumbySS1(1);
-		ChumbySS1(0);
-	}
+	// the events callback does the SS1 pulse
+	if(data_ready)
+		Event(EVENT_UART);
 }
 
 int UartWrite(int uart, char *data, int len)
 {
+	int space, first;
+	
+	if(len <= 0)
+		return 0;
+	
 	if(uart == 0) {
 		if(g_UartUsbWriteBufferBusy)
 			return 0;
@@ -124,50 +231,54 @@ int UartWrite(int uart, char *data, int len)
 		return len;
 	}
 	else {
-		return DMA_Write(&g_Uart1DMA, (void*)data, len);
+		// take what fits, the CBC retries the rest once UartRefresh
+		// signals that the ring drained below the low watermark
+		space = BUFF_FREE(g_Uart1TxRead, g_Uart1TxWrite, UART_BUFFER_SIZE);
+		if(len > space) {
+			len = space;
+			g_Uart1TxBlocked = 1;
+		}
+		
+		first = UART_BUFFER_SIZE - g_Uart1TxWrite;
+		if(first > len) first = len;
+		memcpy(&(g_Uart1TxBuffer[g_Uart1TxWrite]), data, first);
+		memcpy(g_Uart1TxBuffer, data + first, len - first);
+		g_Uart1TxWrite = (g_Uart1TxWrite + len) % UART_BUFFER_SIZE;
+		
+		if(BUFF_USED(g_Uart1TxRead, g_Uart1TxWrite, UART_BUFFER_SIZE) >= UART_TX_HIGH_WATER)
+			g_Uart1TxBlocked = 1;
+		
+		UartFeed();
+		return len;
 	}
 }
 
-#define BUFF_COUNT(readIndex,writeIndex,size) \
-				    (readIndex <= writeIndex ? writeIndex-readIndex : size-readIndex+writeIndex+1)
+// Copies up to len bytes from a receive ring, across the wrap
+static int UartRingRead(unsigned char *ring, volatile int *readIndex, int writeIndex, char *data, int len)
+{
+	int count, first;
+	
+	if(len <= 0)
+		return 0;
+	
+	count = BUFF_USED(*readIndex, writeIndex, UART_BUFFER_SIZE);
+	if(len > count) len = count;
+	
+	first = UART_BUFFER_SIZE - *readIndex;
+	if(first > len) first = len;
+	memcpy(data, &(ring[*readIndex]), first);
+	memcpy(data + first, ring, len - first);
+	*readIndex = (*readIndex + len) % UART_BUFFER_SIZE;
+	
+	return len;
+}
 
 int UartRead(int uart, char *data, int len)
 {
-	if(uart == 0) {
-		if(g_Uart0ReadIndex == g_Uart0WriteIndex) {
-			return 0;
-		}
-		
-		if(g_Uart0WriteIndex < g_Uart0ReadIndex) {
-			if(UART_BUFFER_SIZE - g_Uart0ReadIndex < len)
-				len = UART_BUFFER_SIZE - g_Uart0ReadIndex;
-		} 
-		else {
-			if(g_Uart0WriteIndex - g_Uart0ReadIndex < len)
-				len = g_Uart0WriteIndex - g_Uart0ReadIndex;
-		}
-		memcpy(data, &(g_Uart0Buffer[g_Uart0ReadIndex]), len);
-		g_Uart0ReadIndex += len;
-		if(g_Uart0ReadIndex >= UART_BUFFER_SIZE) g_Uart0ReadIndex = 0;
-		return len;
-	}
-	else if(uart == 1){
-		if(g_Uart1BufferReadIndex == g_Uart1BufferIndex)
-			return 0;
-		if(g_Uart1BufferIndex < g_Uart1BufferReadIndex) {
-			if(UART_BUFFER_SIZE - g_Uart1BufferReadIndex < len)
-				len = UART_BUFFER_SIZE - g_Uart1BufferReadIndex;
-		}
-		else {
-			if(g_Uart1BufferIndex - g_Uart1BufferReadIndex < len)
-				len = g_Uart1BufferIndex - g_Uart1BufferReadIndex;
-		}
-		
-		memcpy(data, &(g_Uart1Buffer[g_Uart1BufferReadIndex]), len);
-		g_Uart1BufferReadIndex += len;
-		if(g_Uart1BufferReadIndex >= UART_BUFFER_SIZE) g_Uart1BufferReadIndex = 0;
-		return len;
-	}
+	if(uart == 0)
+		return UartRingRead(g_Uart0Buffer, &g_Uart0ReadIndex, g_Uart0WriteIndex, data, len);
+	else if(uart == 1)
+		return UartRingRead(g_Uart1Buffer, &g_Uart1BufferReadIndex, g_Uart1BufferIndex, data, len);
 	return 0;
 }
 
@@ -181,6 +292,10 @@ int UartReset(int uart)
 	else {
 		g_Uart1BufferIndex = 0;
 		g_Uart1BufferReadIndex = 0;
+		g_Uart1TxWrite = 0;
+		g_Uart1TxRead = 0;
+		g_Uart1TxBlocked = 0;
+		g_Uart1Dropped = 0;
 		return 0;
 	}
 }
@@ -3,11 +3,25 @@
 
 #define UART_BUFFER_SIZE 2048
 
+// The Create talks 57600 until told otherwise
+#define UART_BAUD_DEFAULT 57600
+#define UART_BAUD_MIN     1200
+#define UART_BAUD_MAX     230400
+
+// UartWrite flags the CBC to stop above the high watermark and raises
+// EVENT_UART once the TX ring drains below the low one
+#define UART_TX_HIGH_WATER (UART_BUFFER_SIZE*3/4)
+#define UART_TX_LOW_WATER  (UART_BUFFER_SIZE/4)
+
 int UartInit();
 int UartWrite(int uart, char *data, int len);
 int UartRead(int uart, char *data, int len);
 int UartReset(int uart);
 void UartSetSigmask(int mask);
+int UartSetBaud(int uart, int baud);
+int UartGetBaud(int uart);
+int UartTxFree(int uart);
+int UartDropped(int uart);
 void UartStartRead();
 
 #endif
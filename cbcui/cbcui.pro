@@ -47,6 +47,7 @@ HEADERS += src/MainWindow.h \
     src/MotorTest.h \
     src/Brightness.h \
     src/Volume.h \
+    src/ConfigStore.h \
     src/Wireless/Wireless.h \
     src/Wireless/WifiDialog.h \
     src/Wireless/WifiItem.h \
@@ -112,6 +113,7 @@ SOURCES += src/main.cpp \
     src/MotorTest.cpp \
     src/Brightness.cpp \
     src/Volume.cpp \
+    src/ConfigStore.cpp \
     src/Wireless/Wireless.cpp \
     src/Wireless/WifiDialog.cpp \
     src/Wireless/WifiItem.cpp \
@@ -21,6 +21,7 @@
 // Author: Braden McDorman <bmcdorman@gmail.com>
 
 #include "Brightness.h"
+#include "ConfigStore.h"
 
 #define DIM_AFTER_KEY   "Dim_After"
 #define BRIGHTNESS_KEY  "Brightness"
@@ -30,17 +31,16 @@
 
 Brightness::Brightness(QWidget *parent) :
     Page(parent),
-    m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat),
     m_mouseUpdate(this),
     m_dimmer(this),
     m_dimmed(true)
 {
     setupUi(this);
 
-    m_dimAfter = m_settings.value(DIM_AFTER_KEY, 3).toInt();        // set dim delay value
-    m_brightness = m_settings.value(BRIGHTNESS_KEY, 500).toInt();   // brightness values range from 0-512
-    m_dimOff = m_settings.value(DIM_OFF_KEY,false).toBool();            // when screen goes dim it is turned off
-    m_settings.sync();
+    ConfigStore *config = ConfigStore::instance();
+    m_dimAfter = config->value(DIM_AFTER_KEY, 3).toInt();        // set dim delay value
+    m_brightness = config->value(BRIGHTNESS_KEY, 500).toInt();   // brightness values range from 0-512
+    m_dimOff = config->value(DIM_OFF_KEY,false).toBool();            // when screen goes dim it is turned off
 
     m_blocked = true; // when adding an item to the combo box it registers an event, ignore these events so settings can take place
     ui_dimCombo->addItem("10 Seconds"); // 0
@@ -70,8 +70,7 @@ Brightness::~Brightness()
 void Brightness::on_ui_dimCombo_currentIndexChanged(int i)
 {
     if(m_blocked) return;
-    m_settings.setValue(DIM_AFTER_KEY, i);
-    m_settings.sync();
+    ConfigStore::instance()->setValue(DIM_AFTER_KEY, i);
     
     static const int interval[] = {
         MINUTE/6, MINUTE/2, MINUTE, MINUTE*5, MINUTE*10
@@ -89,15 +88,13 @@ void Brightness::on_ui_brightness_valueChanged(int i)
     if(i<15) i=15; // dont let the user turn the screen completely off
     if(i<DIM_LEVEL) m_dimmer.stop();
     setBrightness(i);
-    m_settings.setValue(BRIGHTNESS_KEY, i);
-    m_settings.sync();
+    ConfigStore::instance()->setValue(BRIGHTNESS_KEY, i);
     m_brightness = i;
 }
 
 void Brightness::on_ui_dimCheckBox_clicked(bool checked)
 {
-    m_settings.setValue(DIM_OFF_KEY, checked);
-    m_settings.sync();
+    ConfigStore::instance()->setValue(DIM_OFF_KEY, checked);
     m_dimOff = checked;
 }
 
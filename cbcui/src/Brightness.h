@@ -26,7 +26,6 @@
 #include <QtGui/QWidget>
 #include "Page.h"
 #include "ui_Brightness.h"
-#include <QSettings>
 #include <QTimer>
 #include <QPoint>
 
@@ -47,7 +46,6 @@ protected:
     void setBrightness(int i);
 
 private:
-    QSettings m_settings;
     int m_brightness;
     int m_dimAfter;
     QTimer m_mouseUpdate;
@@ -19,13 +19,15 @@
  **************************************************************************/
 
 #include "CbobData.h"
-#include <QSettings>
+#include "ConfigStore.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/ioctl.h>
 #include "../../kernel/cbob/cbob.h"
+#include "../../kernel/cbob/sensor_data.h"
 
 CbobData::CbobData()
 {
@@ -33,6 +35,8 @@ CbobData::CbobData()
     char devname[32];
 
     m_sensors = open("/dev/cbc/sensors", O_RDONLY);
+    m_robotState = true;
+    memset(m_motorSpeed, 0, sizeof(m_motorSpeed));
     m_angPullups = open("/dev/cbc/analog0", O_RDWR);
 
     // motor control
@@ -152,6 +156,8 @@ float CbobData::batteryVoltage()
 
 int CbobData::motorVelocity(int motor)
 {
+    if(motor >= 0 && motor <= 3)
+      return m_motorSpeed[motor];
     return 0;
 }
 int CbobData::motorPosition(int motor)
@@ -236,18 +242,14 @@ void CbobData::defaultPIDgains(int motor)
     ioctl(m_pid[motor], CBOB_PID_RESET_GAINS);
     this->motorGains(motor,PIDgains);
 
-    QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
-    m_settings.beginGroup(QString("PIDgainsMotor%1").arg(motor));
-    m_settings.setValue("ProportionalMult",PIDgains[0]);
-    m_settings.setValue("IntegralMult",PIDgains[1]);
-    m_settings.setValue("DerivativeMult",PIDgains[2]);
-    m_settings.setValue("ProportionalDiv",PIDgains[3]);
-    m_settings.setValue("IntegralDiv",PIDgains[4]);
-    m_settings.setValue("DerivativeDiv",PIDgains[5]);
-    m_settings.endGroup();
-    m_settings.sync();
-    ::system("sync");
-    ::system("sync");
+    ConfigStore *config = ConfigStore::instance();
+    QString group = QString("PIDgainsMotor%1/").arg(motor);
+    config->setValue(group + "ProportionalMult",PIDgains[0]);
+    config->setValue(group + "IntegralMult",PIDgains[1]);
+    config->setValue(group + "DerivativeMult",PIDgains[2]);
+    config->setValue(group + "ProportionalDiv",PIDgains[3]);
+    config->setValue(group + "IntegralDiv",PIDgains[4]);
+    config->setValue(group + "DerivativeDiv",PIDgains[5]);
 }
 
 void CbobData::disableServos()
@@ -295,7 +297,22 @@ void CbobData::setSlowRefresh()
 
 void CbobData::updateSensors()
 {
-    int error;
+    struct cbob_robot_state state;
+    int i, error;
+
+    // everything in one BoB transaction if the firmware has it
+    if(m_robotState && ioctl(m_sensors, CBOB_SENSORS_GET_ROBOT_STATE, &state) == 0) {
+        memcpy(m_sensorData, &state.sensors, sizeof(m_sensorData));
+        for(i=0;i<4;i++) {
+            m_pidData[i] = state.motor_counter[i];
+            m_pwmData[i] = state.pwm[i];
+            m_motorSpeed[i] = state.motor_speed[i];
+        }
+        emit refresh();
+        return;
+    }
+    if(errno == ENOSYS || errno == ENOTTY) m_robotState = false;
+
     error = read(m_sensors, m_sensorData, 28);
     if(error < 0) perror("Got an error reading the sensor data");
     error = read(m_allPID, m_pidData, 16);
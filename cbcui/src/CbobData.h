@@ -103,6 +103,8 @@ private:
     short m_sensorData[14];
     int   m_pidData[4];
     signed char   m_pwmData[4];
+    int   m_motorSpeed[4];
+    bool  m_robotState;
     QTimer m_timer;
 
     //static CbobData *inst;
@@ -0,0 +1,197 @@
+/**************************************************************************
+ *  Copyright 2008,2009 KISS Institute for Practical Robotics             *
+ *                                                                        *
+ *  This file is part of CBC Firmware.                                    *
+ *                                                                        *
+ *  CBC Firmware is free software: you can redistribute it and/or modify  *
+ *  it under the terms of the GNU General Public License as published by  *
+ *  the Free Software Foundation, either version 2 of the License, or     *
+ *  (at your option) any later version.                                   *
+ *                                                                        *
+ *  CBC Firmware is distributed in the hope that it will be useful,       *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *  GNU General Public License for more details.                          *
+ *                                                                        *
+ *  You should have received a copy of the GNU General Public License     *
+ *  along with this copy of CBC Firmware.  Check the LICENSE file         *
+ *  in the project root.  If not, see <http://www.gnu.org/licenses/>.     *
+ **************************************************************************/
+
+#include "ConfigStore.h"
+#include <QSettings>
+#include <QStringList>
+#include <QFile>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+ConfigStore::ConfigStore() :
+    m_fileName(CONFIG_FILE),
+    m_generation(0),
+    m_written(0),
+    m_flushNow(false),
+    m_quit(false)
+{
+    QSettings settings(m_fileName, QSettings::NativeFormat);
+    QStringList keys = settings.allKeys();
+
+    for(int i = 0;i < keys.size();i++)
+        m_values[keys[i]] = settings.value(keys[i]);
+
+    start(QThread::LowPriority);
+}
+
+ConfigStore::~ConfigStore()
+{
+    m_mutex.lock();
+    m_quit = true;
+    m_changed.wakeAll();
+    m_mutex.unlock();
+
+    wait();
+}
+
+ConfigStore *ConfigStore::instance()
+{
+    static ConfigStore store;
+
+    return &store;
+}
+
+QVariant ConfigStore::value(const QString &key, const QVariant &defaultValue)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QMap<QString, QVariant>::const_iterator it = m_values.find(key);
+    if(it == m_values.end()) return defaultValue;
+    return it.value();
+}
+
+bool ConfigStore::contains(const QString &key)
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_values.contains(key);
+}
+
+void ConfigStore::setValue(const QString &key, const QVariant &value)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QMap<QString, QVariant>::iterator it = m_values.find(key);
+    if(it != m_values.end() && it.value() == value) return;
+
+    m_values[key] = value;
+    markDirty();
+}
+
+void ConfigStore::remove(const QString &key)
+{
+    QMutexLocker locker(&m_mutex);
+    QString group = key + "/";
+    bool removed = false;
+
+    QMap<QString, QVariant>::iterator it = m_values.begin();
+    while(it != m_values.end()) {
+        if(it.key() == key || it.key().startsWith(group)) {
+            it = m_values.erase(it);
+            removed = true;
+        }
+        else ++it;
+    }
+
+    if(removed) markDirty();
+}
+
+void ConfigStore::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    unsigned int generation = m_generation;
+
+    if(m_written == generation) return;
+
+    m_flushNow = true;
+    m_changed.wakeAll();
+    // a later setValue can make the writer skip past generation
+    while((int)(m_written - generation) < 0 && isRunning())
+        m_flushed.wait(&m_mutex);
+}
+
+// called with m_mutex held
+void ConfigStore::markDirty()
+{
+    m_generation++;
+    m_changed.wakeAll();
+}
+
+void ConfigStore::run()
+{
+    m_mutex.lock();
+    for(;;) {
+        while(!m_quit && m_written == m_generation)
+            m_changed.wait(&m_mutex);
+        if(m_written == m_generation) break;
+
+        // let a burst of writes (slider drags, readSettings loops) settle
+        unsigned int generation;
+        do {
+            generation = m_generation;
+            if(m_quit || m_flushNow) break;
+            m_changed.wait(&m_mutex, CONFIG_FLUSH_DELAY);
+        } while(generation != m_generation);
+        m_flushNow = false;
+
+        QMap<QString, QVariant> values = m_values;
+        generation = m_generation;
+        m_mutex.unlock();
+
+        writeFile(values);
+
+        m_mutex.lock();
+        m_written = generation;
+        m_flushed.wakeAll();
+    }
+    m_mutex.unlock();
+}
+
+void ConfigStore::writeFile(const QMap<QString, QVariant> &values)
+{
+    QString tmpName = m_fileName + ".tmp";
+
+    QFile::remove(tmpName);
+    {
+        QSettings settings(tmpName, QSettings::NativeFormat);
+        settings.clear();
+
+        QMap<QString, QVariant>::const_iterator it;
+        for(it = values.begin();it != values.end();++it)
+            settings.setValue(it.key(), it.value());
+
+        settings.sync();
+        if(settings.status() != QSettings::NoError) {
+            qWarning("ConfigStore: could not write %s", qPrintable(tmpName));
+            return;
+        }
+    }
+
+    commitFile(tmpName, m_fileName);
+}
+
+bool ConfigStore::commitFile(const QString &tmpName, const QString &fileName)
+{
+    int fd = ::open(QFile::encodeName(tmpName), O_WRONLY);
+
+    if(fd < 0) {
+        perror("ConfigStore:open");
+        return false;
+    }
+    if(::fsync(fd) < 0) perror("ConfigStore:fsync");
+    ::close(fd);
+
+    if(::rename(QFile::encodeName(tmpName), QFile::encodeName(fileName)) < 0) {
+        perror("ConfigStore:rename");
+        return false;
+    }
+    return true;
+}
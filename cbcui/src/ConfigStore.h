@@ -0,0 +1,77 @@
+/**************************************************************************
+ *  Copyright 2008,2009 KISS Institute for Practical Robotics             *
+ *                                                                        *
+ *  This file is part of CBC Firmware.                                    *
+ *                                                                        *
+ *  CBC Firmware is free software: you can redistribute it and/or modify  *
+ *  it under the terms of the GNU General Public License as published by  *
+ *  the Free Software Foundation, either version 2 of the License, or     *
+ *  (at your option) any later version.                                   *
+ *                                                                        *
+ *  CBC Firmware is distributed in the hope that it will be useful,       *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *  GNU General Public License for more details.                          *
+ *                                                                        *
+ *  You should have received a copy of the GNU General Public License     *
+ *  along with this copy of CBC Firmware.  Check the LICENSE file         *
+ *  in the project root.  If not, see <http://www.gnu.org/licenses/>.     *
+ **************************************************************************/
+
+#ifndef __CONFIG_STORE_H__
+#define __CONFIG_STORE_H__
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QMap>
+#include <QString>
+#include <QVariant>
+
+#define CONFIG_FILE         "/mnt/kiss/config/cbc_v2.config"
+#define CONFIG_FLUSH_DELAY  500     // ms of quiet before pending writes hit flash
+
+// Single owner of cbc_v2.config.  Reads are served from memory; writes are
+// coalesced and written back by a background thread once they stop arriving,
+// using write-to-temp, fsync and rename so a power cut never leaves a
+// half-written config behind.  Keys use QSettings "Group/Key" notation.
+class ConfigStore : public QThread
+{
+public:
+    static ConfigStore *instance();
+
+    QVariant value(const QString &key, const QVariant &defaultValue = QVariant());
+    bool contains(const QString &key);
+    void setValue(const QString &key, const QVariant &value);
+    // removes key and, if key names a group, everything under it
+    void remove(const QString &key);
+
+    // blocks until every pending write is on disk
+    void flush();
+
+    // fsyncs tmpName and renames it over fileName
+    static bool commitFile(const QString &tmpName, const QString &fileName);
+
+protected:
+    void run();
+
+private:
+    ConfigStore();
+    ~ConfigStore();
+
+    void markDirty();
+    void writeFile(const QMap<QString, QVariant> &values);
+
+    QString                 m_fileName;
+    QMap<QString, QVariant> m_values;
+
+    QMutex          m_mutex;
+    QWaitCondition  m_changed;
+    QWaitCondition  m_flushed;
+    unsigned int    m_generation;
+    unsigned int    m_written;
+    bool            m_flushNow;
+    bool            m_quit;
+};
+
+#endif
@@ -25,7 +25,13 @@
 #include <QDir>
 #include <QTextStream>
 
-Console::Console(QWidget *parent) : Page(parent), m_uiData("/tmp/cbc_uidata")
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Console::Console(QWidget *parent) : Page(parent), m_uiData("/tmp/cbc_uidata"), m_commandNotifier(0)
 {
     setupUi(this);
     
@@ -43,6 +49,22 @@ Console::Console(QWidget *parent) : Page(parent), m_uiData("/tmp/cbc_uidata")
     m_uiData.shared().state = 0;
     m_uiData.shared().playing = 0;
     m_uiData.shared().recording = 0;
+    m_uiData.shared().ack = 0;
+
+    // sound and UI commands from user programs
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, UI_COMMAND_SOCKET);
+    unlink(UI_COMMAND_SOCKET);
+    m_commandSocket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if(m_commandSocket < 0 || bind(m_commandSocket, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        qWarning(UI_COMMAND_SOCKET " not open");
+    else {
+        chmod(UI_COMMAND_SOCKET, 0666);
+        m_commandNotifier = new QSocketNotifier(m_commandSocket, QSocketNotifier::Read, this);
+        QObject::connect(m_commandNotifier, SIGNAL(activated(int)), this, SLOT(readCommands()));
+    }
 
     m_btinput = new QFile("/tmp/.btplay-cmdin");
     if(!m_btinput->open(QIODevice::WriteOnly | QIODevice::Text)) qWarning("tmp/.btplay-cmdin not open");
@@ -59,6 +81,11 @@ Console::Console(QWidget *parent) : Page(parent), m_uiData("/tmp/cbc_uidata")
 
 Console::~Console()
 {
+    delete m_commandNotifier;
+    if(m_commandSocket >= 0) {
+        ::close(m_commandSocket);
+        unlink(UI_COMMAND_SOCKET);
+    }
     m_btinput->close();
     delete m_btinput;
     delete m_btoutput;
@@ -83,11 +110,6 @@ void Console::invertColors()
 
 void Console::updateText(QString text)
 {
-    if(text.contains("\a",Qt::CaseInsensitive)){
-        this->manageSound();
-        text.remove("\a");
-    }
-
     ui_console->insertPlainText(text);
     ui_console->verticalScrollBar()->triggerAction(QScrollBar::SliderToMaximum);
 }
@@ -129,16 +151,28 @@ void Console::recordChange(QProcess::ProcessState newState)
         m_uiData.shared().recording = 1;
 }
 
-void Console::manageSound()
+void Console::readCommands()
+{
+    UICommand cmd;
+
+    // take everything queued, a burst of commands costs one wakeup
+    while(recv(m_commandSocket, &cmd, sizeof(cmd), MSG_DONTWAIT) == sizeof(cmd)) {
+        cmd.filename[sizeof(cmd.filename) - 1] = 0;
+        this->manageSound(cmd);
+        m_uiData.shared().ack = cmd.seq;
+    }
+}
+
+void Console::manageSound(const UICommand &cmd)
 {
-    switch(m_uiData.shared().state)
+    switch(cmd.command)
     {
-    case 1: //the beep signal is emitted
+    case UI_BEEP: //the beep signal is emitted
         {
             this->bell();
             break;
         }
-    case 2: // play sound from file on USB stick
+    case UI_PLAY_SOUND: // play sound from file on USB stick
         if(m_uiData.shared().recording) break;
         else {
             QDir usbDir("/mnt/browser/usb/sound");  // make sure the sound directory is there
@@ -147,20 +181,20 @@ void Console::manageSound()
                 break;
             }
             // play a song here
-            this->playSoundFile(QString("/mnt/browser/usb/sound/") + m_uiData.shared().filename);
+            this->playSoundFile(QString("/mnt/browser/usb/sound/") + cmd.filename);
             break;
         }
-    case 3: // is playing sound?
+    case UI_PLAYING_SOUND: // is playing sound?
         {
             this->playChange();
             break;
         }
-    case 4: // stop playing the song
+    case UI_STOP_SOUND: // stop playing the song
         {
             this->stopSoundFile();
             break;
         }
-    case 5: // record from the mic if not currently playing
+    case UI_START_RECORDING: // record from the mic if not currently playing
         if(m_uiData.shared().playing && m_recdProc.state() != QProcess::NotRunning) break;
         else {
             QDir usbDir("/mnt/browser/usb");
@@ -170,12 +204,12 @@ void Console::manageSound()
             }
             usbDir.mkpath("/mnt/browser/usb/sound/"); // create the sound directory if not there
             // start recording from the mic
-            QString wavFile = QString("arecord -d %1 -f cd /mnt/browser/usb/sound/").arg(m_uiData.shared().recordTime);
-            m_recdProc.start(wavFile + m_uiData.shared().filename);
-            ui_console->insertPlainText(QString("recording to -") + m_uiData.shared().filename + "\n");
+            QString wavFile = QString("arecord -d %1 -f cd /mnt/browser/usb/sound/").arg(cmd.recordTime);
+            m_recdProc.start(wavFile + cmd.filename);
+            ui_console->insertPlainText(QString("recording to -") + cmd.filename + "\n");
             break;
         }
-    case 6: // stop recording
+    case UI_STOP_RECORDING: // stop recording
         if(m_recdProc.state() != QProcess::NotRunning) m_recdProc.kill(); // stop recording
         break;
 
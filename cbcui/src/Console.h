@@ -26,6 +26,7 @@
 #include <QString>
 #include <QProcess>
 #include <QFile>
+#include <QSocketNotifier>
 
 #include "SharedMem.h"
 #include "UIData.h"
@@ -63,13 +64,16 @@ public slots:
    void stopSoundFile();
    void playChange();
    void recordChange(QProcess::ProcessState newState);
-   void manageSound();
+   void readCommands();
 
 protected:
     void setViewportColors(Qt::GlobalColor text, Qt::GlobalColor background);
 private:
+   void manageSound(const UICommand &cmd);
 
    SharedMem<UIData>    m_uiData;
+   int                  m_commandSocket;
+   QSocketNotifier      *m_commandNotifier;
    
     QProcess            m_recdProc;
     QFile               *m_btinput;
@@ -20,7 +20,7 @@
 
 #include "MotorTuning.h"
 #include "Keyboard/Keypad.h"
-#include <QSettings>
+#include "ConfigStore.h"
 
 MotorTuning::MotorTuning(QWidget *parent) : Page(parent)
 {   
@@ -262,20 +262,18 @@ void MotorTuning::motorCheckBoxes()
 void MotorTuning::readSettings()
 {
     int i;
-    QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
+    ConfigStore *config = ConfigStore::instance();
 
-    //qWarning("%s",qPrintable(m_settings.fileName()));
     // reads in the PID settings that have been saved to memory
     // if no settings file is located the defaults are input
     for(i=0;i<4;i++){
-        m_settings.beginGroup(QString("PIDgainsMotor%1").arg(i));
-        PIDgains[0] = m_settings.value("ProportionalMult",4).toInt();
-        PIDgains[1] = m_settings.value("IntegralMult",1).toInt();
-        PIDgains[2] = m_settings.value("DerivativeMult",-1).toInt();
-        PIDgains[3] = m_settings.value("ProportionalDiv",1).toInt();
-        PIDgains[4] = m_settings.value("IntegralDiv",1).toInt();
-        PIDgains[5] = m_settings.value("DerivativeDiv",3).toInt();
-        m_settings.endGroup();
+        QString group = QString("PIDgainsMotor%1/").arg(i);
+        PIDgains[0] = config->value(group + "ProportionalMult",4).toInt();
+        PIDgains[1] = config->value(group + "IntegralMult",1).toInt();
+        PIDgains[2] = config->value(group + "DerivativeMult",-1).toInt();
+        PIDgains[3] = config->value(group + "ProportionalDiv",1).toInt();
+        PIDgains[4] = config->value(group + "IntegralDiv",1).toInt();
+        PIDgains[5] = config->value(group + "DerivativeDiv",3).toInt();
         // write each of the saved settings to the BoB
         m_cbobData->motorSetGains(i,PIDgains);
     }
@@ -283,17 +281,13 @@ void MotorTuning::readSettings()
 
 void MotorTuning::writeSettings(int motor)
 {
-    QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
-
-    m_settings.beginGroup(QString("PIDgainsMotor%1").arg(motor));
-    m_settings.setValue("ProportionalMult",PIDgains[0]);
-    m_settings.setValue("IntegralMult",PIDgains[1]);
-    m_settings.setValue("DerivativeMult",PIDgains[2]);
-    m_settings.setValue("ProportionalDiv",PIDgains[3]);
-    m_settings.setValue("IntegralDiv",PIDgains[4]);
-    m_settings.setValue("DerivativeDiv",PIDgains[5]);
-    m_settings.endGroup();
-    m_settings.sync();
-    ::system("sync");
-    ::system("sync");
+    ConfigStore *config = ConfigStore::instance();
+    QString group = QString("PIDgainsMotor%1/").arg(motor);
+
+    config->setValue(group + "ProportionalMult",PIDgains[0]);
+    config->setValue(group + "IntegralMult",PIDgains[1]);
+    config->setValue(group + "DerivativeMult",PIDgains[2]);
+    config->setValue(group + "ProportionalDiv",PIDgains[3]);
+    config->setValue(group + "IntegralDiv",PIDgains[4]);
+    config->setValue(group + "DerivativeDiv",PIDgains[5]);
 }
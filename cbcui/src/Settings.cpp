@@ -20,13 +20,13 @@
 
 #include "Settings.h"
 #include "CbobData.h"
+#include "ConfigStore.h"
 #include <QFile>
 #include <QMessageBox>
 #include <QDir>
 
 Settings::Settings(QWidget *parent) :
         Page(parent),
-        m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat),
         m_brightness(parent),
         m_volume(parent)
 {
@@ -40,18 +40,15 @@ Settings::Settings(QWidget *parent) :
     QObject::connect(ui_brightnessButton, SIGNAL(clicked()), &m_brightness, SLOT(raisePage()));
     QObject::connect(ui_volumeButton, SIGNAL(clicked()), &m_volume, SLOT(raisePage()));
 
-    if(m_settings.contains("motorCal0")) loadPidCal();
+    ConfigStore *config = ConfigStore::instance();
+
+    if(config->contains("motorCal0")) loadPidCal();
     else storePidCal();
-    if(m_settings.contains("accelCal0")) loadAccelCal();
+    if(config->contains("accelCal0")) loadAccelCal();
     else storeAccelCal();
-    m_settings.beginGroup("PIDgainsMotor0");
-    if(!m_settings.contains("ProportionalMult")) resetPID();
-    m_settings.endGroup();
-
-    ::system("sync");
-    ::system("sync");
+    if(!config->contains("PIDgainsMotor0/ProportionalMult")) resetPID();
 
-    ui_consoleShowBox->setChecked(m_settings.value("consoleShowOnRun", true).toBool());
+    ui_consoleShowBox->setChecked(config->value("consoleShowOnRun", true).toBool());
 }
 
 Settings::~Settings()
@@ -125,10 +122,7 @@ void Settings::setCameraDefault()
 
 void Settings::on_ui_consoleShowBox_clicked(bool checked)
 {
-    m_settings.setValue("consoleShowOnRun",checked);
-    m_settings.sync();
-    ::system("sync");
-    ::system("sync");
+    ConfigStore::instance()->setValue("consoleShowOnRun",checked);
 }
 
 void Settings::loadAccelCal()
@@ -136,7 +130,7 @@ void Settings::loadAccelCal()
     short data[3];
 
     for(int i = 0;i < 3;i++) {
-        data[i] = m_settings.value("accelCal" + QString::number(i)).toInt();
+        data[i] = ConfigStore::instance()->value("accelCal" + QString::number(i)).toInt();
     }
 
     CbobData::instance()->accelerometerSetCal(data);
@@ -149,9 +143,8 @@ void Settings::storeAccelCal()
     CbobData::instance()->accelerometerGetCal(data);
 
     for(int i = 0;i < 3;i++) {
-        m_settings.setValue("accelCal" + QString::number(i), data[i]);
+        ConfigStore::instance()->setValue("accelCal" + QString::number(i), data[i]);
     }
-    m_settings.sync();
 }
 
 void Settings::loadPidCal()
@@ -159,7 +152,7 @@ void Settings::loadPidCal()
     short data[4];
 
     for(int i = 0;i < 4;i++) {
-        data[i] = m_settings.value("motorCal" + QString::number(i)).toInt();
+        data[i] = ConfigStore::instance()->value("motorCal" + QString::number(i)).toInt();
     }
 
     CbobData::instance()->motorsSetCal(data);
@@ -172,8 +165,7 @@ void Settings::storePidCal()
     CbobData::instance()->motorsGetCal(data);
 
     for(int i = 0;i < 4;i++) {
-        m_settings.setValue("motorCal"+QString::number(i), data[i]);
+        ConfigStore::instance()->setValue("motorCal"+QString::number(i), data[i]);
     }
-    m_settings.sync();
 }
 
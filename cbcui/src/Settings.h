@@ -21,7 +21,6 @@
 #ifndef __SETTINGS_H__
 #define __SETTINGS_H__
 
-#include <QSettings>
 #include "ui_Settings.h"
 #include "Page.h"
 #include "Brightness.h"
@@ -50,7 +49,6 @@ public slots:
     void loadAccelCal();
 
 private:
-    QSettings   m_settings;
     Brightness  m_brightness;
     Volume      m_volume;
 };
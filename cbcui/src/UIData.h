@@ -10,11 +10,31 @@ typedef struct __UIData
   int left_button;
   int right_button;
 
-  int state;    // 1 = beep, 2 = play sound file, 3 = is playing sound?, 4 = stop playing, 5 = record from mic, 6 = stop recording
+  int state;    // unused, commands go through UI_COMMAND_SOCKET
   int recording;
   int playing;
   int recordTime;
   char filename[80];
+  int ack;      // seq of the last command the UI handled
 } UIData;
 
+// Sound and UI commands from libcbc, one UICommand per datagram on a unix
+// socket the console page listens on
+#define UI_COMMAND_SOCKET "/tmp/cbc_ui_commands"
+
+#define UI_BEEP             1
+#define UI_PLAY_SOUND       2
+#define UI_PLAYING_SOUND    3   // refreshes UIData.playing
+#define UI_STOP_SOUND       4
+#define UI_START_RECORDING  5
+#define UI_STOP_RECORDING   6
+
+typedef struct __UICommand
+{
+  int command;
+  int seq;
+  int recordTime;
+  char filename[80];
+} UICommand;
+
 #endif
@@ -1,6 +1,7 @@
 #include "UserProgram.h"
 #include <QFileInfo>
-#include <QSettings>
+#include <QRegExp>
+#include "ConfigStore.h"
 #include "CbobData.h"
 
 
@@ -30,6 +31,7 @@ void UserProgram::toggleState()
   
   if(m_userProgram.state() == QProcess::NotRunning) {
     if(robot.exists()) {
+      m_userProgram.setEnvironment(launchEnvironment());
       m_userProgram.start("/mnt/kiss/usercode/bin/robot");
     }
     else {
@@ -43,6 +45,33 @@ void UserProgram::toggleState()
   }
 }
 
+// The real-time launch profile lives under realtime/ in the config, and
+// realtime/<program name>/<key> overrides realtime/<key> for one program
+QVariant UserProgram::realtimeValue(const QString &key, const QVariant &defaultValue)
+{
+  ConfigStore *config = ConfigStore::instance();
+  QString programKey = "realtime/" + m_programName + "/" + key;
+
+  if(config->contains(programKey))
+    return config->value(programKey);
+  return config->value("realtime/" + key, defaultValue);
+}
+
+// libcbc_init applies the profile from these, see __realtime_init
+QStringList UserProgram::launchEnvironment()
+{
+  QStringList env = QProcess::systemEnvironment().filter(QRegExp("^(?!CBC_RT_)"));
+
+  if(!realtimeValue("enabled", false).toBool())
+    return env;
+
+  env << "CBC_RT_POLICY=" + realtimeValue("policy", "fifo").toString();
+  env << "CBC_RT_PRIORITY=" + QString::number(realtimeValue("priority", 20).toInt());
+  env << "CBC_RT_CPU=" + QString::number(realtimeValue("cpu", -1).toInt());
+  env << "CBC_RT_MLOCK=" + QString(realtimeValue("lockMemory", true).toBool() ? "1" : "0");
+  return env;
+}
+
 void UserProgram::readStdout()
 {
   emit consoleOutput(QString(m_userProgram.readAllStandardOutput()));
@@ -58,8 +87,7 @@ void UserProgram::programStarted()
   emit stateChange(1);
   emit started();
 
-  QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
-  if(m_settings.value("consoleShowOnRun", true).toBool())
+  if(ConfigStore::instance()->value("consoleShowOnRun", true).toBool())
       emit consoleRaise();
 }
 
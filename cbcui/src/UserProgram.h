@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QProcess>
 #include <QString>
+#include <QStringList>
+#include <QVariant>
 
 class UserProgram : public QObject
 {
@@ -43,6 +45,9 @@ private slots:
   void programStarted();
 
 private:
+  QVariant realtimeValue(const QString &key, const QVariant &defaultValue);
+  QStringList launchEnvironment();
+
   QProcess m_userProgram;
   QString m_programName;
 };
@@ -19,16 +19,16 @@
  **************************************************************************/
 
 #include "Volume.h"
+#include "ConfigStore.h"
 
 #define VOLUME_KEY   "Volume"
 
 Volume::Volume(QWidget *parent) :
-    Page(parent),
-    m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat)
+    Page(parent)
 {
     setupUi(this);
 
-    int volume = m_settings.value(VOLUME_KEY, 90).toInt();   // volume values range from 0-100
+    int volume = ConfigStore::instance()->value(VOLUME_KEY, 90).toInt();   // volume values range from 0-100
     on_ui_volume_valueChanged(volume);
 }
 
@@ -39,6 +39,5 @@ Volume::~Volume()
 void Volume::on_ui_volume_valueChanged(int i)
 {
     system(QString("chumby_set_volume %1" ).arg(i).toAscii());
-    m_settings.setValue(VOLUME_KEY,i);
-    m_settings.sync();
+    ConfigStore::instance()->setValue(VOLUME_KEY,i);
 }
@@ -24,7 +24,6 @@
 #include <QtGui/QWidget>
 #include "Page.h"
 #include "ui_Volume.h"
-#include <QSettings>
 
 class Volume : public Page, public Ui::Volume {
     Q_OBJECT
@@ -37,9 +36,6 @@ protected slots:
 
 protected:
     void setVolume(int i);
-
-private:
-    QSettings m_settings;
 };
 
 #endif // VOLUME_H
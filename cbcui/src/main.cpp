@@ -22,6 +22,7 @@
 #include <QCursor>
 
 #include "MainWindow.h"
+#include "ConfigStore.h"
 
 int main(int argc, char **argv)
 {
@@ -36,5 +37,8 @@ int main(int argc, char **argv)
 
     dialog->show();
 
-    return app.exec();
+    int ret = app.exec();
+
+    ConfigStore::instance()->flush();
+    return ret;
 }
@@ -28,6 +28,7 @@
 // Local includes
 #include "DrawBlobs.h"
 #include "ctdebug.h"
+#include "ConfigStore.h"
 
 // Self
 #include "ColorTracker.h"
@@ -108,7 +109,8 @@ bool ColorTracker::loadModels()
 
 bool ColorTracker::saveModels()
 {
-    ofstream out(this->modelSaveFile().c_str());
+    std::string tmpFile = this->modelSaveFile() + ".tmp";
+    ofstream out(tmpFile.c_str());
 
     for (unsigned ch = 0; ch < m_assemblers.size(); ch++)
     {
@@ -122,10 +124,11 @@ bool ColorTracker::saveModels()
     out << "# max hue (0-360)\n";
     out << "# min saturation (0-255)\n";
     out << "# min brightness (or value) (0-255)\n";
-    out.flush();
-    system("sync");
-    system("sync");
-    return out.good();
+    out.close();
+    if(out.fail()) return false;
+
+    return ConfigStore::commitFile(QString::fromStdString(tmpFile),
+                                   QString::fromStdString(this->modelSaveFile()));
 }
 
 void ColorTracker::loadDefaultModels()
@@ -22,10 +22,10 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <linux/videodev2.h>
-#include <QSettings>
 
 // Local includes
 #include "ctdebug.h"
+#include "ConfigStore.h"
 
 // Self
 #include "MicrodiaCamera.h"
@@ -268,35 +268,28 @@ int MicrodiaCamera::getParameter(enum cam_parms id)
 
 void MicrodiaCamera::readSettings()
 {
-    QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
+    ConfigStore *config = ConfigStore::instance();
 
-    //qWarning("%s",qPrintable(m_settings.fileName()));
     // reads in the Camera settings that have been saved to memory
     // if no settings file is located the defaults are input
     // write each of the saved settings to the Camera
-    m_settings.beginGroup(QString("Camera"));
-    this->setParameter(BRIGHTNESS,m_settings.value("Brightness",32767).toInt());
-    this->setParameter(CONTRAST,m_settings.value("Contrast",32767).toInt());
-    this->setParameter(AUTO_WHITE_BALANCE, m_settings.value("AutoBalance",false).toInt());
-    this->setParameter(RED_BALANCE, m_settings.value("RedBalance",31).toInt());
-    this->setParameter(BLUE_BALANCE, m_settings.value("BlueBalance",31).toInt());
-    this->setParameter(GAMMA, m_settings.value("Gamma",13107).toInt());
-    this->setParameter(EXPOSURE, m_settings.value("Exposure",512).toInt());
-    this->setParameter(H_FLIP, m_settings.value("H_flip",false).toInt());
-    this->setParameter(V_FLIP, m_settings.value("V_flip",false).toInt());
-    this->setParameter(SHARPNESS, m_settings.value("Sharpness",31).toInt());
-    this->setParameter(AUTO_EXPOSURE, m_settings.value("AutoExposure",false).toInt());
-    m_settings.endGroup();
-    m_settings.sync();
-    ::system("sync");
-    ::system("sync");
+    this->setParameter(BRIGHTNESS,config->value("Camera/Brightness",32767).toInt());
+    this->setParameter(CONTRAST,config->value("Camera/Contrast",32767).toInt());
+    this->setParameter(AUTO_WHITE_BALANCE, config->value("Camera/AutoBalance",false).toInt());
+    this->setParameter(RED_BALANCE, config->value("Camera/RedBalance",31).toInt());
+    this->setParameter(BLUE_BALANCE, config->value("Camera/BlueBalance",31).toInt());
+    this->setParameter(GAMMA, config->value("Camera/Gamma",13107).toInt());
+    this->setParameter(EXPOSURE, config->value("Camera/Exposure",512).toInt());
+    this->setParameter(H_FLIP, config->value("Camera/H_flip",false).toInt());
+    this->setParameter(V_FLIP, config->value("Camera/V_flip",false).toInt());
+    this->setParameter(SHARPNESS, config->value("Camera/Sharpness",31).toInt());
+    this->setParameter(AUTO_EXPOSURE, config->value("Camera/AutoExposure",false).toInt());
 }
 
 void MicrodiaCamera::setDefaultParams()
 {
-    QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
     // remove all camera settings from settings file
-    m_settings.remove("Camera");
+    ConfigStore::instance()->remove("Camera");
     // reset all to default values because the settings are not there
     this->readSettings();
 }
@@ -341,11 +334,5 @@ void MicrodiaCamera::writeSetting(enum cam_parms id, int value)
         break;
     }
 
-    QSettings m_settings("/mnt/kiss/config/cbc_v2.config",QSettings::NativeFormat);
-    m_settings.beginGroup("Camera");
-    m_settings.setValue(name,value);
-    m_settings.endGroup();
-    m_settings.sync();
-    ::system("sync");
-    ::system("sync");
+    ConfigStore::instance()->setValue("Camera/" + name,value);
 }
@@ -12,11 +12,22 @@
 #define CBOB_ACCEL_MAJOR   226
 #define CBOB_UART_MAJOR    227
 #define CBOB_STATUS_MAJOR  228
+#define CBOB_STATE_MAJOR   229
 
 // ioctls
 //Digitals
 #define CBOB_DIGITAL_SET_DIR _IOW(CBOB_DIGITAL_MAJOR, 0, int*) 
 #define CBOB_DIGITAL_GET_DIR _IOR(CBOB_DIGITAL_MAJOR, 1, int*)
+#define CBOB_DIGITAL_SET_LIVE _IOW(CBOB_DIGITAL_MAJOR, 2, int*)
+// blocks until the port reads the given value
+#define CBOB_DIGITAL_WAIT     _IOW(CBOB_DIGITAL_MAJOR, 3, int*)
+// edge capture, see CBOB_CMD_CAPTURE_*.  SET_CAPTURE takes CBOB_CAPTURE_*,
+// the count is of captured edges since the last clear.
+#define CBOB_DIGITAL_SET_CAPTURE  _IOW(CBOB_DIGITAL_MAJOR, 4, int*)
+#define CBOB_DIGITAL_GET_COUNT    _IOR(CBOB_DIGITAL_MAJOR, 5, int*)
+#define CBOB_DIGITAL_CLEAR_COUNT  _IO (CBOB_DIGITAL_MAJOR, 6)
+// edges from every port, count in is the most to return
+#define CBOB_DIGITAL_READ_EDGES   _IOWR(CBOB_DIGITAL_MAJOR, 7, struct cbob_edges*)
 
 //PID
 #define CBOB_PID_CLEAR_COUNTER _IO (CBOB_PID_MAJOR, 0)
@@ -28,9 +39,33 @@
 #define CBOB_PID_RECALIBRATE   _IO (CBOB_PID_MAJOR, 6)
 #define CBOB_PID_GET_CAL       _IOR(CBOB_PID_MAJOR, 7, short*)
 #define CBOB_PID_SET_CAL       _IOW(CBOB_PID_MAJOR, 8, short*)
+// motor loop period in microseconds, SET writes back the period the BoB used
+#define CBOB_PID_SET_PERIOD    _IOWR(CBOB_PID_MAJOR, 9, int*)
+#define CBOB_PID_GET_PERIOD    _IOR(CBOB_PID_MAJOR, 10, int*)
+// int[2]: acceleration in ticks/s^2 (0 = no profile), jerk in ticks/s^3 (0 = trapezoid)
+#define CBOB_PID_SET_PROFILE   _IOW(CBOB_PID_MAJOR, 11, int*)
+#define CBOB_PID_GET_PROFILE   _IOR(CBOB_PID_MAJOR, 12, int*)
+// int[2]: speed, goal position.  Follows the profile on the BoB.
+#define CBOB_PID_MOVE_PROFILED _IOW(CBOB_PID_MAJOR, 13, int*)
+// blocks until the motor is done with its move
+#define CBOB_PID_WAIT_DONE     _IO (CBOB_PID_MAJOR, 14)
 
 #define CBOB_ANALOG_SET_PULLUPS _IOW(CBOB_ANALOG_MAJOR, 0, int*)
 #define CBOB_ANALOG_GET_PULLUPS _IOR(CBOB_ANALOG_MAJOR, 1, int*)
+#define CBOB_ANALOG_SET_LIVE    _IOW(CBOB_ANALOG_MAJOR, 2, int*)
+// int[2]: port mask (0 stops), rate in Hz.  The rate used is written back.
+#define CBOB_ANALOG_STREAM_START _IOWR(CBOB_ANALOG_MAJOR, 3, int*)
+#define CBOB_ANALOG_STREAM_STOP  _IO (CBOB_ANALOG_MAJOR, 4)
+#define CBOB_ANALOG_STREAM_READ  _IOWR(CBOB_ANALOG_MAJOR, 5, struct cbob_analog_stream*)
+// int[2]: CBOB_FILTER_* type and size for the fd's port (battery included,
+// the all-ports device sets analogs 0-7).  SET writes back the settings used.
+#define CBOB_ANALOG_SET_FILTER   _IOWR(CBOB_ANALOG_MAJOR, 6, int*)
+#define CBOB_ANALOG_GET_FILTER   _IOR(CBOB_ANALOG_MAJOR, 7, int*)
+
+// nonzero bypasses the sensor snapshot for reads on this fd
+#define CBOB_SENSORS_SET_LIVE _IOW(CBOB_SENSORS_MAJOR, 0, int*)
+// sensors, motors and servos from one BoB transaction
+#define CBOB_SENSORS_GET_ROBOT_STATE _IOR(CBOB_SENSORS_MAJOR, 1, struct cbob_robot_state*)
 
 #define CBOB_UART_SET_SIGMASK _IOW(CBOB_UART_MAJOR, 0, int*)
 #define CBOB_UART_GET_SIGMASK _IOR(CBOB_UART_MAJOR, 1, int*)
@@ -39,5 +74,47 @@
 #define CBOB_ACCEL_RECALIBRATE _IO (CBOB_ACCEL_MAJOR, 0)
 #define CBOB_ACCEL_GET_CAL     _IOR(CBOB_ACCEL_MAJOR, 1, short*)
 #define CBOB_ACCEL_SET_CAL     _IOW(CBOB_ACCEL_MAJOR, 2, short*)
+#define CBOB_ACCEL_SET_LIVE    _IOW(CBOB_ACCEL_MAJOR, 3, int*)
+// int[2]: CBOB_FILTER_* type and size, like CBOB_ANALOG_SET_FILTER
+#define CBOB_ACCEL_SET_FILTER  _IOWR(CBOB_ACCEL_MAJOR, 4, int*)
+#define CBOB_ACCEL_GET_FILTER  _IOR(CBOB_ACCEL_MAJOR, 5, int*)
+
+// Several commands in one SPI transaction, see CBOB_CMD_BATCH
+#define CBOB_BATCH_SIZE 126
+struct cbob_batch {
+  short outcount;                 // words used in outbuf
+  short incount;                  // words returned in inbuf
+  short outbuf[CBOB_BATCH_SIZE];  // n, then cmd, count, data... for each
+  short inbuf[CBOB_BATCH_SIZE];   // count, reply... for each
+};
+
+#define CBOB_STATUS_BATCH _IOWR(CBOB_STATUS_MAJOR, 0, struct cbob_batch*)
+
+// Captured digital edges, oldest first
+#define CBOB_EDGES_MAX 64
+struct cbob_edge {
+  unsigned int stamp;   // BoB clock in us, wraps
+  short port;           // 0-7
+  short level;          // after the edge
+};
+
+struct cbob_edges {
+  int count;
+  int dropped;          // edges lost since the last read
+  struct cbob_edge edges[CBOB_EDGES_MAX];
+};
+
+// Streamed analog samples, whole frames of one sample per streamed port in
+// port order.  The frames are consecutive, frame n was sampled n/rate
+// seconds after the stream started.
+#define CBOB_STREAM_MAX 512
+struct cbob_analog_stream {
+  int count;            // in: most samples to return, out: samples returned
+  int mask;             // streamed ports
+  int rate;             // frames per second
+  int dropped;          // frames lost since the last read
+  unsigned int first;   // number of the first frame
+  short samples[CBOB_STREAM_MAX];
+};
 
 #endif
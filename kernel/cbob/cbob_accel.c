@@ -1,6 +1,7 @@
 #include "cbob_accel.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_sensors.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
@@ -35,6 +36,7 @@ static int cbob_accel_open(struct inode *inode, struct file *file)
     return -ENOMEM;
     
   accel->axis = iminor(inode);
+  accel->live = 0;
   
   file->private_data = accel;
   
@@ -51,12 +53,30 @@ static int cbob_accel_release(struct inode *inode, struct file *file)
 static ssize_t cbob_accel_read(struct file *file, char *buf, size_t count, loff_t *ppos) 
 {
   struct accel_axis *accel = file->private_data;
+  struct sensor_data sensors;
   short data[3] = {0,0,0};
   int error;
   
-  if((error = cbob_spi_message(CBOB_CMD_ACCEL_READ, &(accel->axis), 1, data, 3)) < 0)
+  if((error = cbob_sensors_get(&sensors, accel->live)) < 0)
     return error;
   
+  switch(accel->axis) {
+    case 0:
+      data[0] = sensors.accel_x;
+      break;
+    case 1:
+      data[0] = sensors.accel_y;
+      break;
+    case 2:
+      data[0] = sensors.accel_z;
+      break;
+    default:
+      data[0] = sensors.accel_x;
+      data[1] = sensors.accel_y;
+      data[2] = sensors.accel_z;
+      break;
+  }
+  
   if(count > 6)
     count = 6;
   
@@ -65,17 +85,48 @@ static ssize_t cbob_accel_read(struct file *file, char *buf, size_t count, loff_
   return count;
 }
 
+// set is 3 to change the filter, 4 to read it back
+static int cbob_accel_filter(int axis, int set, int *user)
+{
+  short request[4], result[2];
+  int config[2], error;
+
+  request[0] = set;
+  request[1] = (axis >= 0 && axis <= 2) ? axis : -1;
+  if(set == 3) {
+    copy_from_user(config, user, sizeof(config));
+    request[2] = config[0];
+    request[3] = config[1];
+  }
+
+  if((error = cbob_spi_message(CBOB_CMD_ACCEL_CONFIG, request, set == 3 ? 4 : 2, result, 2)) < 0)
+    return error;
+  // firmware without filters replies with nothing
+  if(error < 2)
+    return -ENOSYS;
+  if(set == 3)
+    cbob_sensors_invalidate();
+
+  config[0] = result[0];
+  config[1] = result[1];
+  copy_to_user(user, config, sizeof(config));
+
+  return 0;
+}
+
 static int cbob_accel_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param)
 {
+    struct accel_axis *accel = file->private_data;
     short request[4];
     short result[3];
-    int error;
+    int arg, error;
 
     switch(ioctl_num) {
       case CBOB_ACCEL_RECALIBRATE:
         request[0] = 0;
         if((error = cbob_spi_message(CBOB_CMD_ACCEL_CONFIG, request, 1, 0, 0)) < 0)
           return error;
+        cbob_sensors_invalidate();
         break;
       case CBOB_ACCEL_GET_CAL:
         request[0] = 1;
@@ -88,7 +139,16 @@ static int cbob_accel_ioctl(struct inode *inode, struct file *file, unsigned int
         copy_from_user(&(request[1]), (void*)ioctl_param, sizeof(short)*3);
         if((error = cbob_spi_message(CBOB_CMD_ACCEL_CONFIG, request, 4, 0, 0)) < 0)
           return error;
+        cbob_sensors_invalidate();
+        break;
+      case CBOB_ACCEL_SET_LIVE:
+        copy_from_user(&arg, (void*)ioctl_param, sizeof(int));
+        accel->live = arg ? 1 : 0;
         break;
+      case CBOB_ACCEL_SET_FILTER:
+        return cbob_accel_filter(accel->axis, 3, (int*)ioctl_param);
+      case CBOB_ACCEL_GET_FILTER:
+        return cbob_accel_filter(accel->axis, 4, (int*)ioctl_param);
     }
     return 0;
 }
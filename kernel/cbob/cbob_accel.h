@@ -6,6 +6,7 @@
 
 struct accel_axis {
   short axis;
+  short live;
 };
 
 int  cbob_accel_init(void);
@@ -1,6 +1,8 @@
 #include "cbob_analog.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_sensors.h"
+#include "cbob_stream.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
@@ -35,6 +37,7 @@ static int cbob_analog_open(struct inode *inode, struct file *file)
     return -ENOMEM;
     
   analog->port = iminor(inode);
+  analog->live = 0;
   
   file->private_data = analog;
   
@@ -50,12 +53,22 @@ static int cbob_analog_release(struct inode *inode, struct file *file)
 static ssize_t cbob_analog_read(struct file *file, char *buf, size_t count, loff_t *ppos) 
 {
   struct analog_port *analog = file->private_data;
+  struct sensor_data sensors;
   short data[9] = {0,0,0,0,0,0,0,0, 0};
   int error;
   
-  if((error = cbob_spi_message(CBOB_CMD_ANALOG_READ, &(analog->port), 1, data, 9)) < 0)
+  if((error = cbob_sensors_get(&sensors, analog->live)) < 0)
     return error;
   
+  if(analog->port >= 0 && analog->port < 8)
+    data[0] = sensors.analog[analog->port];
+  else if(analog->port == 8)
+    data[0] = sensors.battery;
+  else {
+    memcpy(data, sensors.analog, sizeof(sensors.analog));
+    data[8] = sensors.battery;
+  }
+  
   if(count > 18)
     count = 18; 
   
@@ -64,8 +77,68 @@ static ssize_t cbob_analog_read(struct file *file, char *buf, size_t count, loff
   return count;
 }
 
+static int cbob_analog_stream_start(int *user)
+{
+  int config[2], error;
+
+  copy_from_user(config, user, sizeof(config));
+  if((error = cbob_stream_start(config[0], &(config[1]))) < 0)
+    return error;
+  copy_to_user(user, config, sizeof(config));
+
+  return 0;
+}
+
+static int cbob_analog_stream_read(struct cbob_analog_stream *user)
+{
+  struct cbob_analog_stream *stream;
+  int error;
+
+  // too big for the kernel stack
+  stream = kmalloc(sizeof(struct cbob_analog_stream), GFP_KERNEL);
+  if(stream == 0)
+    return -ENOMEM;
+
+  copy_from_user(&(stream->count), &(user->count), sizeof(int));
+  if((error = cbob_stream_read(stream)) == 0)
+    copy_to_user(user, stream, sizeof(struct cbob_analog_stream));
+
+  kfree(stream);
+  return error;
+}
+
+// set is 2 to change the filter, 3 to read it back
+static int cbob_analog_filter(int port, int set, int *user)
+{
+  short request[4], result[2];
+  int config[2], error;
+
+  request[0] = set;
+  request[1] = (port >= 0 && port <= 8) ? port : -1;
+  if(set == 2) {
+    copy_from_user(config, user, sizeof(config));
+    request[2] = config[0];
+    request[3] = config[1];
+  }
+
+  if((error = cbob_spi_message(CBOB_CMD_ANALOG_CONFIG, request, set == 2 ? 4 : 2, result, 2)) < 0)
+    return error;
+  // firmware without filters replies with nothing
+  if(error < 2)
+    return -ENOSYS;
+  if(set == 2)
+    cbob_sensors_invalidate();
+
+  config[0] = result[0];
+  config[1] = result[1];
+  copy_to_user(user, config, sizeof(config));
+
+  return 0;
+}
+
 static int cbob_analog_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param)
 {
+	struct analog_port *analog = file->private_data;
 	short request[2];
 	short retval;
 	int arg, error;
@@ -78,6 +151,7 @@ static int cbob_analog_ioctl(struct inode *inode, struct file *file, unsigned in
 			request[1] = arg;
 			if((error = cbob_spi_message(CBOB_CMD_ANALOG_CONFIG, request, 2, 0,0)) < 0)
 				return error;
+			cbob_sensors_invalidate();
 			break;
 		case CBOB_ANALOG_GET_PULLUPS:
 			request[0] = 1;
@@ -85,6 +159,20 @@ static int cbob_analog_ioctl(struct inode *inode, struct file *file, unsigned in
 				return error;
 			arg = retval;
 			break;
+		case CBOB_ANALOG_SET_LIVE:
+			analog->live = arg ? 1 : 0;
+			break;
+		case CBOB_ANALOG_STREAM_START:
+			return cbob_analog_stream_start((int*)ioctl_param);
+		case CBOB_ANALOG_STREAM_STOP:
+			arg = 0;
+			return cbob_stream_start(0, &arg);
+		case CBOB_ANALOG_STREAM_READ:
+			return cbob_analog_stream_read((struct cbob_analog_stream*)ioctl_param);
+		case CBOB_ANALOG_SET_FILTER:
+			return cbob_analog_filter(analog->port, 2, (int*)ioctl_param);
+		case CBOB_ANALOG_GET_FILTER:
+			return cbob_analog_filter(analog->port, 3, (int*)ioctl_param);
 	}
 	
 	copy_to_user((void*)ioctl_param, &arg, sizeof(int));
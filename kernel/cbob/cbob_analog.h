@@ -6,6 +6,7 @@
 
 struct analog_port {
   short port;
+  short live;
 };
 
 int  cbob_analog_init(void);
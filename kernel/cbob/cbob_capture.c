@@ -0,0 +1,203 @@
+#include "cbob_capture.h"
+#include "cbob_spi.h"
+#include "cbob_cmd.h"
+#include "cbob_event.h"
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <asm/semaphore.h>
+
+/* Edge capture
+ *
+ * The BoB stamps edges on digital ports with capture on and raises
+ * CBOB_EVENT_CAPTURE while its log holds any.  The event work drains the
+ * log into a ring here, so the BoB's 128 edges only have to last one
+ * interrupt instead of until the program reads them.  Reads drain too,
+ * which covers firmware that can't send events.
+ */
+
+#define CBOB_CAPTURE_RING 1024
+
+static struct cbob_edge cbob_capture_ring[CBOB_CAPTURE_RING];
+static int cbob_capture_head;
+static int cbob_capture_tail;
+static int cbob_capture_dropped;
+static int cbob_capture_ports;
+static spinlock_t cbob_capture_lock = SPIN_LOCK_UNLOCKED;
+static struct semaphore cbob_capture_sem;
+
+int cbob_capture_set(int port, int edges)
+{
+  short request[3];
+  int error, was_on, on;
+
+  if(port < 0 || port > 7)
+    return -EINVAL;
+
+  request[0] = 0;
+  request[1] = port;
+  request[2] = edges & CBOB_CAPTURE_BOTH;
+
+  if(down_interruptible(&cbob_capture_sem))
+    return -EINTR;
+
+  was_on = on = cbob_capture_ports != 0;
+  if((error = cbob_spi_message(CBOB_CMD_CAPTURE_CONFIG, request, 3, 0, 0)) >= 0) {
+    if(request[2])
+      cbob_capture_ports |= 1<<port;
+    else
+      cbob_capture_ports &= ~(1<<port);
+    on = cbob_capture_ports != 0;
+    error = 0;
+  }
+
+  up(&cbob_capture_sem);
+
+  // keep the event on while any port captures.  Not under the semaphore,
+  // changing the mask fetches events and that may drain.
+  if(!was_on && on)
+    cbob_event_get(CBOB_EVENT_CAPTURE);
+  else if(was_on && !on)
+    cbob_event_put(CBOB_EVENT_CAPTURE);
+
+  return error;
+}
+
+int cbob_capture_get_count(int port, int *count)
+{
+  short request[2];
+  int error;
+
+  request[0] = 2;
+  request[1] = port;
+  *count = 0;
+  if((error = cbob_spi_message(CBOB_CMD_CAPTURE_CONFIG, request, 2, (short*)count, 2)) < 0)
+    return error;
+
+  return 0;
+}
+
+int cbob_capture_clear_count(int port)
+{
+  short request[2];
+  int error;
+
+  request[0] = 3;
+  request[1] = port;
+  if((error = cbob_spi_message(CBOB_CMD_CAPTURE_CONFIG, request, 2, 0, 0)) < 0)
+    return error;
+
+  return 0;
+}
+
+// caller holds cbob_capture_sem
+static int cbob_capture_fetch(void)
+{
+  short request = CBOB_CAPTURE_READ_MAX;
+  short data[2 + 3*CBOB_CAPTURE_READ_MAX];
+  int error, count, i, next;
+
+  if((error = cbob_spi_message(CBOB_CMD_CAPTURE_READ, &request, 1, data, 2 + 3*CBOB_CAPTURE_READ_MAX)) < 0)
+    return error;
+  // firmware without capture replies with nothing
+  if(error < 2)
+    return 0;
+
+  count = data[0];
+  if(count < 0 || count > CBOB_CAPTURE_READ_MAX || error < 2 + 3*count)
+    return 0;
+
+  spin_lock(&cbob_capture_lock);
+  cbob_capture_dropped += data[1];
+  for(i = 0;i < count;i++) {
+    next = (cbob_capture_head + 1) % CBOB_CAPTURE_RING;
+    if(next == cbob_capture_tail) {
+      cbob_capture_dropped += count - i;
+      break;
+    }
+    memcpy(&(cbob_capture_ring[cbob_capture_head].stamp), &(data[2 + 3*i]), 4);
+    cbob_capture_ring[cbob_capture_head].port = data[4 + 3*i] & 0xFF;
+    cbob_capture_ring[cbob_capture_head].level = (data[4 + 3*i] >> 8) & 1;
+    cbob_capture_head = next;
+  }
+  spin_unlock(&cbob_capture_lock);
+
+  return count;
+}
+
+static int cbob_capture_drain_locked(void)
+{
+  int count;
+
+  // a full reply means there may be more
+  while((count = cbob_capture_fetch()) == CBOB_CAPTURE_READ_MAX);
+
+  return count < 0 ? count : 0;
+}
+
+void cbob_capture_drain(void)
+{
+  if(down_interruptible(&cbob_capture_sem))
+    return;
+  cbob_capture_drain_locked();
+  up(&cbob_capture_sem);
+}
+
+int cbob_capture_read(struct cbob_edges *edges)
+{
+  int error, max, count = 0;
+
+  max = edges->count;
+  if(max < 0 || max > CBOB_EDGES_MAX)
+    max = CBOB_EDGES_MAX;
+
+  if(down_interruptible(&cbob_capture_sem))
+    return -EINTR;
+  error = cbob_capture_drain_locked();
+  up(&cbob_capture_sem);
+  if(error < 0)
+    return error;
+
+  spin_lock(&cbob_capture_lock);
+  while(count < max && cbob_capture_tail != cbob_capture_head) {
+    edges->edges[count++] = cbob_capture_ring[cbob_capture_tail];
+    cbob_capture_tail = (cbob_capture_tail + 1) % CBOB_CAPTURE_RING;
+  }
+  edges->dropped = cbob_capture_dropped;
+  cbob_capture_dropped = 0;
+  spin_unlock(&cbob_capture_lock);
+
+  edges->count = count;
+  return 0;
+}
+
+/* init and exit */
+int cbob_capture_init(void)
+{
+  sema_init(&cbob_capture_sem, 1);
+  cbob_capture_head = cbob_capture_tail = 0;
+
+  return 0;
+}
+
+void cbob_capture_exit(void)
+{
+  short request[3];
+  int i;
+
+  if(cbob_capture_ports == 0)
+    return;
+
+  // nobody is left to drain the log
+  request[0] = 0;
+  request[2] = CBOB_CAPTURE_OFF;
+  for(i = 0;i < 8;i++) {
+    if(cbob_capture_ports & (1<<i)) {
+      request[1] = i;
+      cbob_spi_message(CBOB_CMD_CAPTURE_CONFIG, request, 3, 0, 0);
+    }
+  }
+  cbob_capture_ports = 0;
+  cbob_event_put(CBOB_EVENT_CAPTURE);
+}
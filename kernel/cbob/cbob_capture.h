@@ -0,0 +1,18 @@
+#ifndef __CBC_CAPTURE_H__
+#define __CBC_CAPTURE_H__
+
+#include "cbob.h"
+
+int  cbob_capture_init(void);
+void cbob_capture_exit(void);
+
+// Captures CBOB_CAPTURE_* edges on port 0-7
+int  cbob_capture_set(int port, int edges);
+int  cbob_capture_get_count(int port, int *count);
+int  cbob_capture_clear_count(int port);
+// Moves the BoB's edge log into the ring, called on CBOB_EVENT_CAPTURE
+void cbob_capture_drain(void);
+// Drains and then copies up to edges->count edges out of the ring
+int  cbob_capture_read(struct cbob_edges *edges);
+
+#endif
@@ -1,6 +1,9 @@
 #include "cbob_digital.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_sensors.h"
+#include "cbob_event.h"
+#include "cbob_capture.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
@@ -27,6 +30,49 @@ static struct file_operations cbob_digital_fops = {
 	ioctl:   cbob_digital_ioctl
 };
 
+// Sleeps until the port reads value, woken by digital change events
+static int cbob_digital_wait(struct digital_port *digital, int value)
+{
+  struct sensor_data sensors;
+  unsigned int seq;
+  int error;
+
+  if(digital->port < 0 || digital->port > 8)
+    return -EINVAL;
+
+  cbob_event_get(CBOB_EVENT_DIGITAL);
+  for(;;) {
+    seq = cbob_event_seq();
+    if((error = cbob_sensors_get(&sensors, digital->live)) < 0)
+      break;
+    if(((sensors.digitals >> digital->port) & 1) == (value ? 1 : 0))
+      break;
+    if((error = cbob_event_wait(seq)) < 0)
+      break;
+  }
+  cbob_event_put(CBOB_EVENT_DIGITAL);
+
+  return error;
+}
+
+static int cbob_digital_read_edges(struct cbob_edges *user)
+{
+  struct cbob_edges *edges;
+  int error;
+
+  // too big for the kernel stack
+  edges = kmalloc(sizeof(struct cbob_edges), GFP_KERNEL);
+  if(edges == 0)
+    return -ENOMEM;
+
+  copy_from_user(&(edges->count), &(user->count), sizeof(int));
+  if((error = cbob_capture_read(edges)) == 0)
+    copy_to_user(user, edges, sizeof(struct cbob_edges));
+
+  kfree(edges);
+  return error;
+}
+
 static int cbob_digital_open(struct inode *inode, struct file *file)
 {
   struct digital_port *digital;
@@ -37,6 +83,7 @@ static int cbob_digital_open(struct inode *inode, struct file *file)
     return -ENOMEM;
     
   digital->port = iminor(inode);
+  digital->live = 0;
   //printk(KERN_INFO "opening digital %d\n",digital->port);
   file->private_data = digital;
   
@@ -52,12 +99,18 @@ static int cbob_digital_release(struct inode *inode, struct file *file)
 static ssize_t cbob_digital_read(struct file *file, char *buf, size_t count, loff_t *ppos) 
 {
   struct digital_port *digital = file->private_data;
+  struct sensor_data sensors;
   short data;
   int error;
   
-  if((error = cbob_spi_message(CBOB_CMD_DIGITAL_READ, &(digital->port), 1, &data, 1)) < 0)
+  if((error = cbob_sensors_get(&sensors, digital->live)) < 0)
     return error;
   
+  if(digital->port >= 0 && digital->port <= 8)
+    data = (sensors.digitals >> digital->port) & 1;
+  else
+    data = sensors.digitals;
+  
   if(count > 2)
     count = 2;
   
@@ -84,12 +137,14 @@ static ssize_t cbob_digital_write(struct file *file, const char *buf, size_t cou
         //printk(KERN_INFO "Digital set port %d = %d",data[0],data[1]);
         if((error = cbob_spi_message(CBOB_CMD_DIGITAL_WRITE, data, 2,0,0)) < 0)
 		return error;
+	cbob_sensors_invalidate();
 	
   return 1;
 }
 
 static int cbob_digital_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param)
 {
+	struct digital_port *digital = file->private_data;
         short request[2];
         short retval;
 	int arg, error;
@@ -103,6 +158,7 @@ static int cbob_digital_ioctl(struct inode *inode, struct file *file, unsigned i
 
                         if((error = cbob_spi_message(CBOB_CMD_DIGITAL_CONFIG, request, 2, 0,0)) < 0)
 				return error;
+			cbob_sensors_invalidate();
 			break;
 		case CBOB_DIGITAL_GET_DIR:
                         request[0] = 1;
@@ -111,6 +167,25 @@ static int cbob_digital_ioctl(struct inode *inode, struct file *file, unsigned i
 				return error;
                         arg = retval;
 			break;
+		case CBOB_DIGITAL_SET_LIVE:
+			digital->live = arg ? 1 : 0;
+			break;
+		case CBOB_DIGITAL_WAIT:
+			if((error = cbob_digital_wait(digital, arg)) < 0)
+				return error;
+			break;
+		case CBOB_DIGITAL_SET_CAPTURE:
+			if((error = cbob_capture_set(digital->port, arg)) < 0)
+				return error;
+			break;
+		case CBOB_DIGITAL_GET_COUNT:
+			if((error = cbob_capture_get_count(digital->port, &arg)) < 0)
+				return error;
+			break;
+		case CBOB_DIGITAL_CLEAR_COUNT:
+			return cbob_capture_clear_count(digital->port);
+		case CBOB_DIGITAL_READ_EDGES:
+			return cbob_digital_read_edges((struct cbob_edges*)ioctl_param);
 	}
 
         copy_to_user((void*)ioctl_param, &arg, sizeof(int));
@@ -6,6 +6,7 @@
 
 struct digital_port {
   short port;
+  short live;
 };
 
 int  cbob_digital_init(void);
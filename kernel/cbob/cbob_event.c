@@ -0,0 +1,205 @@
+#include "cbob_event.h"
+#include "cbob_spi.h"
+#include "cbob_cmd.h"
+#include "cbob_sensors.h"
+#include "cbob_state.h"
+#include "cbob_uart.h"
+#include "cbob_capture.h"
+#include "cbob_stream.h"
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/types.h>
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/interrupt.h>
+#include <asm/arch/imx-regs.h>
+#include <asm/arch/irqs.h>
+#include <asm/arch/hardware.h>
+#include <asm/semaphore.h>
+
+/* Events
+ *
+ * The BoB pulses SS1 (GPIO D27) while an enabled event is pending.  The
+ * interrupt reads and clears the events with CBOB_CMD_EVENT_READ and hands
+ * them out: UART data to cbob_uart, captured edges to cbob_capture,
+ * analog samples to cbob_stream, everything else wakes the waiters.
+ * Firmware older than the command only pulses for UART data and replies
+ * to EVENT_READ with nothing, then waiters fall back to polling every
+ * event_poll_ms.
+ */
+
+static int event_poll_ms = 20;
+module_param(event_poll_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(event_poll_ms, "Wait poll period in ms when the BoB firmware has no events");
+
+// waiters recheck this often even with events, in case a pulse was lost
+#define CBOB_EVENT_TIMEOUT_MS 1000
+#define CBOB_EVENT_IRQ IRQ_GPIOD(27)
+#define CBOB_EVENT_BITS 9
+
+static unsigned int cbob_event_sequence;
+static int cbob_event_supported = 1;
+static int cbob_event_users[CBOB_EVENT_BITS];
+static int cbob_event_mask = CBOB_EVENT_UART;
+static spinlock_t cbob_event_lock = SPIN_LOCK_UNLOCKED;
+static struct semaphore cbob_event_mask_sem;
+static DECLARE_WAIT_QUEUE_HEAD(cbob_event_queue);
+
+static struct workqueue_struct *cbob_event_workqueue;
+static void cbob_event_fetch_work(void *arg);
+DECLARE_WORK(cbob_event_fetch, cbob_event_fetch_work, 0);
+
+static void cbob_event_dispatch(int events)
+{
+  if(events & CBOB_EVENT_UART)
+    cbob_uart_signal();
+  if(events & (CBOB_EVENT_DIGITAL | CBOB_EVENT_BUTTON))
+    cbob_sensors_invalidate();
+  if(events & CBOB_EVENT_MOTORS_DONE)
+    cbob_state_invalidate(CBOB_STATE_MOTORS);
+  if(events & CBOB_EVENT_CAPTURE)
+    cbob_capture_drain();
+  if(events & CBOB_EVENT_STREAM)
+    cbob_stream_drain();
+
+  if(events & ~(CBOB_EVENT_UART | CBOB_EVENT_CAPTURE | CBOB_EVENT_STREAM)) {
+    spin_lock(&cbob_event_lock);
+    cbob_event_sequence++;
+    spin_unlock(&cbob_event_lock);
+    wake_up_interruptible(&cbob_event_queue);
+  }
+}
+
+static void cbob_event_fetch_work(void *arg)
+{
+  short data[3];
+  int count;
+
+  if((count = cbob_spi_message(CBOB_CMD_EVENT_READ, 0, 0, data, 3)) < 0)
+    return;
+
+  // old firmware, the pulse can only mean UART data
+  if(count < 3) {
+    cbob_event_supported = 0;
+    cbob_event_dispatch(CBOB_EVENT_UART);
+    return;
+  }
+
+  cbob_event_supported = 1;
+  cbob_event_dispatch(data[0]);
+}
+
+static irqreturn_t cbob_event_handler(int irq, void *data, struct pt_regs *regs)
+{
+  queue_work(cbob_event_workqueue, &cbob_event_fetch);
+
+  return IRQ_HANDLED;
+}
+
+// caller holds cbob_event_mask_sem
+static void cbob_event_update_mask(void)
+{
+  short mask = CBOB_EVENT_UART;
+  int i;
+
+  for(i = 0;i < CBOB_EVENT_BITS;i++)
+    if(cbob_event_users[i])
+      mask |= 1<<i;
+
+  if(mask == cbob_event_mask)
+    return;
+  cbob_event_mask = mask;
+
+  cbob_spi_message(CBOB_CMD_EVENT_CONFIG, &mask, 1, 0, 0);
+  // anything latched before the mask changed won't pulse, and this also
+  // finds out whether the firmware has events at all
+  cbob_event_fetch_work(0);
+}
+
+void cbob_event_get(int events)
+{
+  int i;
+
+  down(&cbob_event_mask_sem);
+  for(i = 0;i < CBOB_EVENT_BITS;i++)
+    if(events & (1<<i))
+      cbob_event_users[i]++;
+  cbob_event_update_mask();
+  up(&cbob_event_mask_sem);
+}
+
+void cbob_event_put(int events)
+{
+  int i;
+
+  down(&cbob_event_mask_sem);
+  for(i = 0;i < CBOB_EVENT_BITS;i++)
+    if((events & (1<<i)) && cbob_event_users[i] > 0)
+      cbob_event_users[i]--;
+  cbob_event_update_mask();
+  up(&cbob_event_mask_sem);
+}
+
+unsigned int cbob_event_seq(void)
+{
+  unsigned int seq;
+
+  spin_lock(&cbob_event_lock);
+  seq = cbob_event_sequence;
+  spin_unlock(&cbob_event_lock);
+
+  return seq;
+}
+
+int cbob_event_wait(unsigned int seq)
+{
+  long timeout;
+
+  timeout = msecs_to_jiffies(cbob_event_supported ? CBOB_EVENT_TIMEOUT_MS : event_poll_ms);
+  if(timeout < 1)
+    timeout = 1;
+
+  if(wait_event_interruptible_timeout(cbob_event_queue, cbob_event_seq() != seq, timeout) < 0)
+    return -EINTR;
+
+  return 0;
+}
+
+/* init and exit */
+int cbob_event_init(void)
+{
+  int error;
+
+  sema_init(&cbob_event_mask_sem, 1);
+  cbob_event_workqueue = create_singlethread_workqueue("CBOB events");
+  if(cbob_event_workqueue == 0) {
+    printk(KERN_ALERT "Failed to create cbob_event workqueue\n");
+    return -ENOMEM;
+  }
+
+  imx_gpio_mode(GPIO_PORTD | 27 | GPIO_IN | GPIO_GPIO | GPIO_IRQ_RISING);
+  error = request_irq(CBOB_EVENT_IRQ, cbob_event_handler, 0, "CBOB", 0);
+  if(error < 0) {
+    printk(KERN_ALERT "Failed to request cbob_event irq with error: %d\n", error);
+    destroy_workqueue(cbob_event_workqueue);
+    cbob_event_workqueue = 0;
+    return error;
+  }
+
+  return 0;
+}
+
+void cbob_event_exit(void)
+{
+  if(cbob_event_workqueue == 0)
+    return;
+
+  free_irq(CBOB_EVENT_IRQ, 0);
+  flush_workqueue(cbob_event_workqueue);
+  destroy_workqueue(cbob_event_workqueue);
+  cbob_event_workqueue = 0;
+}
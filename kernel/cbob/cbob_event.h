@@ -0,0 +1,19 @@
+#ifndef __CBC_EVENT_H__
+#define __CBC_EVENT_H__
+
+#include "cbob.h"
+
+int  cbob_event_init(void);
+void cbob_event_exit(void);
+
+// Asks the BoB to signal the CBOB_EVENT_* bits in events while held
+void cbob_event_get(int events);
+void cbob_event_put(int events);
+
+// Waiters sample the sequence, check their condition and then wait for it
+// to move.  cbob_event_wait returns 0 on an event or timeout, -EINTR on a
+// signal; the timeout is short when the BoB can't send events.
+unsigned int cbob_event_seq(void);
+int cbob_event_wait(unsigned int seq);
+
+#endif
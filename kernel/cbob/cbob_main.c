@@ -4,6 +4,7 @@
 #include <linux/init.h>
 
 #include "cbob_spi.h"
+#include "cbob_spi_stats.h"
 #include "cbob_digital.h"
 #include "cbob_analog.h"
 #include "cbob_sensors.h"
@@ -13,6 +14,10 @@
 #include "cbob_uart.h"
 #include "cbob_status.h"
 #include "cbob_accel.h"
+#include "cbob_state.h"
+#include "cbob_event.h"
+#include "cbob_capture.h"
+#include "cbob_stream.h"
 
 
 MODULE_AUTHOR("jorge@kipr.org");
@@ -23,7 +28,9 @@ static int cbob_analog_initted;
 
 static int __init cbob_init(void) 
 {
+  cbob_spi_stats_init();
   cbob_spi_init();
+  cbob_state_init();
   
   if(cbob_digital_init() != 0) {
     cbob_digital_initted = 0;
@@ -43,6 +50,9 @@ static int __init cbob_init(void)
   cbob_pwm_init();
   cbob_servo_init();
   cbob_uart_init();
+  cbob_event_init();
+  cbob_capture_init();
+  cbob_stream_init();
   cbob_status_init();
   
   return (0);
@@ -52,12 +62,17 @@ static void __exit cbob_exit(void) {
   if(cbob_digital_initted) cbob_digital_exit();
   if(cbob_analog_initted)  cbob_analog_exit();
   cbob_sensors_exit();
+  cbob_state_exit();
   cbob_pid_exit();
 	cbob_accel_exit();
   cbob_pwm_exit();
   cbob_servo_exit();
+  cbob_stream_exit();
+  cbob_capture_exit();
+  cbob_event_exit();
   cbob_uart_exit();
   cbob_spi_exit();
+  cbob_spi_stats_exit();
   cbob_status_exit();
 }
 
@@ -1,6 +1,8 @@
 #include "cbob_pid.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_state.h"
+#include "cbob_event.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
@@ -27,6 +29,38 @@ static struct file_operations cbob_pid_fops = {
 	ioctl:   cbob_pid_ioctl
 };
 
+// Sleeps until the motor done event instead of polling GET_DONE
+static int cbob_pid_wait_done(short port)
+{
+  short request[2], result;
+  unsigned int seq;
+  int error, event;
+
+  if(port < 0 || port > 3)
+    return -EINVAL;
+
+  event = CBOB_EVENT_MOTOR_DONE(port);
+  cbob_event_get(event);
+
+  request[0] = 4;
+  request[1] = port;
+  for(;;) {
+    seq = cbob_event_seq();
+    result = 0;
+    if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 2, &result, 1)) < 0)
+      break;
+    if(result) {
+      error = 0;
+      break;
+    }
+    if((error = cbob_event_wait(seq)) < 0)
+      break;
+  }
+
+  cbob_event_put(event);
+  return error;
+}
+
 static int cbob_pid_open(struct inode *inode, struct file *file)
 {
   struct pid_port *pid;
@@ -80,6 +114,7 @@ static ssize_t cbob_pid_write(struct file *file, const char *buf, size_t count,
 	
 	if((error = cbob_spi_message(CBOB_CMD_PID_WRITE, data, (count>>1)+1, 0, 0)) < 0)
 		return error;
+	cbob_state_invalidate(CBOB_STATE_MOTORS);
 	
   return 0;
 }
@@ -89,7 +124,7 @@ static int cbob_pid_ioctl(struct inode *inode, struct file *file, unsigned int i
 	struct pid_port *pid = file->private_data;
 	short request[8];
   short result[8];
-	int error, arg;
+	int error, arg, profile[2];
 	
 	switch(ioctl_num) {
 		case CBOB_PID_CLEAR_COUNTER:
@@ -97,6 +132,7 @@ static int cbob_pid_ioctl(struct inode *inode, struct file *file, unsigned int i
 			request[1] = pid->port;
 			if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 2, 0, 0)) < 0)
 				return error;
+			cbob_state_invalidate(CBOB_STATE_MOTORS);
 			break;
 		case CBOB_PID_SET_COUNTER:
 			/*copy_from_user(&arg, (void*)ioctl_param, sizeof(int));
@@ -150,6 +186,50 @@ static int cbob_pid_ioctl(struct inode *inode, struct file *file, unsigned int i
       if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 5, 0, 0)) < 0);
         return error;
       break;
+    case CBOB_PID_SET_PERIOD:
+      copy_from_user(&arg, (void*)ioctl_param, sizeof(int));
+      request[0] = 9;
+      request[1] = arg;
+      if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 2, result, 1)) < 0)
+        return error;
+      arg = result[0];
+      copy_to_user((void*)ioctl_param, &arg, sizeof(int));
+      break;
+    case CBOB_PID_GET_PERIOD:
+      request[0] = 10;
+      if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 1, result, 1)) < 0)
+        return error;
+      arg = result[0];
+      copy_to_user((void*)ioctl_param, &arg, sizeof(int));
+      break;
+    case CBOB_PID_SET_PROFILE:
+      request[0] = 11;
+      request[1] = pid->port;
+      copy_from_user(&(request[2]), (void*)ioctl_param, sizeof(int)*2);
+      if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 6, 0, 0)) < 0)
+        return error;
+      break;
+    case CBOB_PID_GET_PROFILE:
+      request[0] = 12;
+      request[1] = pid->port;
+      if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 2, result, 4)) < 0)
+        return error;
+      copy_to_user((void*)ioctl_param, result, sizeof(int)*2);
+      break;
+    case CBOB_PID_MOVE_PROFILED:
+      copy_from_user(profile, (void*)ioctl_param, sizeof(int)*2);
+      request[0] = 13;
+      request[1] = pid->port;
+      request[2] = profile[0];
+      memcpy(&(request[3]), &(profile[1]), sizeof(int));
+      if((error = cbob_spi_message(CBOB_CMD_PID_CONFIG, request, 5, 0, 0)) < 0)
+        return error;
+      cbob_state_invalidate(CBOB_STATE_MOTORS);
+      break;
+    case CBOB_PID_WAIT_DONE:
+      if((error = cbob_pid_wait_done(pid->port)) < 0)
+        return error;
+      break;
 	}
   return 0;
 }
@@ -1,6 +1,7 @@
 #include "cbob_pwm.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_state.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
@@ -88,6 +89,7 @@ static ssize_t cbob_pwm_write(struct file *file, const char *buf, size_t count,
   
   if((error = cbob_spi_message(CBOB_CMD_PWM_WRITE, data, 1 + count, 0, 0)) < 0)
     return error;
+  cbob_state_invalidate(CBOB_STATE_MOTORS);
   
   return 0;
 }
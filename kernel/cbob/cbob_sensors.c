@@ -1,18 +1,200 @@
 #include "cbob_sensors.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_state.h"
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/fs.h>
 #include <linux/types.h>
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/bitops.h>
 #include <asm/semaphore.h>
 #include <asm/uaccess.h>
 
 static int cbob_sensors_major = CBOB_SENSORS_MAJOR;
 
+/* Sensor snapshot
+ *
+ * One SENSORS_READ returns every digital, analog and accel value, so the
+ * per-port devices are served from a shared snapshot instead of each doing
+ * its own SPI message.  While somebody is reading, a work item refreshes
+ * the snapshot every sensor_refresh_ms.  Reads older than sensor_max_age_ms
+ * (or from an fd with live set) go to the BoB.
+ *
+ * CBOB_SENSORS_GET_ROBOT_STATE reads sensors, motors and servos in one
+ * CBOB_CMD_STATE_READ and publishes the sensor part like a refresh.
+ */
+
+static int sensor_refresh_ms = 20;
+module_param(sensor_refresh_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sensor_refresh_ms, "Background sensor refresh period in ms (0 = refresh on demand only)");
+
+static int sensor_max_age_ms = 20;
+module_param(sensor_max_age_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sensor_max_age_ms, "Oldest cached sensor snapshot served to readers in ms (0 = always live)");
+
+// stop refreshing when nobody has read for this long
+#define CBOB_SENSORS_IDLE_MS 1000
+
+static struct sensor_data cbob_sensors_cache;
+static unsigned long cbob_sensors_stamp;
+static int cbob_sensors_valid;
+static unsigned int cbob_sensors_generation;
+static unsigned long cbob_sensors_last_use;
+static unsigned long cbob_sensors_running;
+static spinlock_t cbob_sensors_lock = SPIN_LOCK_UNLOCKED;
+static struct semaphore cbob_sensors_refresh_sem;
+
+static struct workqueue_struct *cbob_sensors_workqueue;
+static void cbob_sensors_refresh_work(void *arg);
+DECLARE_WORK(cbob_sensors_work, cbob_sensors_refresh_work, 0);
+
+static int cbob_sensors_copy(struct sensor_data *data)
+{
+  int fresh;
+
+  spin_lock(&cbob_sensors_lock);
+  fresh = cbob_sensors_valid && sensor_max_age_ms > 0 &&
+    time_before(jiffies, cbob_sensors_stamp + msecs_to_jiffies(sensor_max_age_ms));
+  if(fresh)
+    *data = cbob_sensors_cache;
+  spin_unlock(&cbob_sensors_lock);
+
+  return fresh;
+}
+
+// Caches sensors read since generation was sampled, unless a write raced
+// with the read.  Also copies them to data if it is set.
+static void cbob_sensors_publish(struct sensor_data *sensors, unsigned int generation, struct sensor_data *data)
+{
+  int valid;
+
+  spin_lock(&cbob_sensors_lock);
+  // a write raced with the read, hand the data back but don't cache it
+  valid = (generation == cbob_sensors_generation);
+  if(valid) {
+    cbob_sensors_cache = *sensors;
+    cbob_sensors_stamp = jiffies;
+    cbob_sensors_valid = 1;
+  }
+  if(data)
+    *data = *sensors;
+  spin_unlock(&cbob_sensors_lock);
+
+  if(valid)
+    cbob_state_set_sensors(sensors);
+}
+
+// caller holds cbob_sensors_refresh_sem
+static int cbob_sensors_refresh(struct sensor_data *data)
+{
+  short buf[SENSOR_DATA_COUNT];
+  unsigned int generation;
+  int error;
+
+  generation = cbob_sensors_generation;
+
+  memset(buf, 0, sizeof(buf));
+  if((error = cbob_spi_message(CBOB_CMD_SENSORS_READ, 0, 0, buf, SENSOR_DATA_COUNT)) < 0)
+    return error;
+
+  cbob_sensors_publish((struct sensor_data*)buf, generation, data);
+
+  return 0;
+}
+
+static void cbob_sensors_arm(void)
+{
+  cbob_sensors_last_use = jiffies;
+
+  if(sensor_refresh_ms <= 0 || cbob_sensors_workqueue == 0)
+    return;
+  if(test_and_set_bit(0, &cbob_sensors_running))
+    return;
+
+  queue_delayed_work(cbob_sensors_workqueue, &cbob_sensors_work, msecs_to_jiffies(sensor_refresh_ms));
+}
+
+static void cbob_sensors_refresh_work(void *arg)
+{
+  if(down_interruptible(&cbob_sensors_refresh_sem) == 0) {
+    cbob_sensors_refresh(0);
+    up(&cbob_sensors_refresh_sem);
+  }
+
+  if(sensor_refresh_ms > 0 &&
+     time_before(jiffies, cbob_sensors_last_use + msecs_to_jiffies(CBOB_SENSORS_IDLE_MS)))
+    queue_delayed_work(cbob_sensors_workqueue, &cbob_sensors_work, msecs_to_jiffies(sensor_refresh_ms));
+  else
+    clear_bit(0, &cbob_sensors_running);
+}
+
+int cbob_sensors_get(struct sensor_data *data, int live)
+{
+  int error;
+
+  cbob_sensors_arm();
+
+  if(!live && cbob_sensors_copy(data))
+    return 0;
+
+  if(down_interruptible(&cbob_sensors_refresh_sem))
+    return -EINTR;
+
+  // another reader may have refreshed while we waited
+  if(!live && cbob_sensors_copy(data))
+    error = 0;
+  else
+    error = cbob_sensors_refresh(data);
+
+  up(&cbob_sensors_refresh_sem);
+  return error;
+}
+
+int cbob_sensors_get_robot(struct cbob_robot_state *state)
+{
+  unsigned int generation;
+  int error;
+
+  cbob_sensors_arm();
+
+  if(down_interruptible(&cbob_sensors_refresh_sem))
+    return -EINTR;
+
+  generation = cbob_sensors_generation;
+
+  memset(state, 0, sizeof(*state));
+  error = cbob_spi_message(CBOB_CMD_STATE_READ, 0, 0, (short*)state, CBOB_ROBOT_STATE_COUNT);
+  // firmware older than the command replies with nothing
+  if(error >= 0 && (error < CBOB_ROBOT_STATE_COUNT || state->version != CBOB_STATE_READ_VERSION))
+    error = -ENOSYS;
+
+  if(error >= 0) {
+    cbob_sensors_publish(&(state->sensors), generation, 0);
+    error = 0;
+  }
+
+  up(&cbob_sensors_refresh_sem);
+  return error;
+}
+
+void cbob_sensors_invalidate(void)
+{
+  spin_lock(&cbob_sensors_lock);
+  cbob_sensors_valid = 0;
+  cbob_sensors_generation++;
+  spin_unlock(&cbob_sensors_lock);
+
+  cbob_state_invalidate(CBOB_STATE_SENSORS);
+}
+
 /* File Ops */
 
 static ssize_t cbob_sensors_read(struct file *file, char *buf, size_t count, loff_t *ppos);
+static int     cbob_sensors_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param);
 static int     cbob_sensors_open(struct inode *inode, struct file *file);
 static int     cbob_sensors_release(struct inode *inode, struct file *file);
 
@@ -20,32 +202,68 @@ static struct file_operations cbob_sensors_fops = {
 	owner:   THIS_MODULE,
 	open:    cbob_sensors_open,
 	release: cbob_sensors_release,
-	read:    cbob_sensors_read
+	read:    cbob_sensors_read,
+	ioctl:   cbob_sensors_ioctl
 };
 
 static int cbob_sensors_open(struct inode *inode, struct file *file)
 {
+  struct sensors_file *sensors;
+
+  sensors = kmalloc(sizeof(struct sensors_file), GFP_KERNEL);
+
+  if(sensors == 0)
+    return -ENOMEM;
+
+  sensors->live = 0;
+
+  file->private_data = sensors;
+
   return 0;
 }
 
 static int cbob_sensors_release(struct inode *inode, struct file *file)
 {
+  kfree(file->private_data);
   return 0;
 }
 
-static ssize_t cbob_sensors_read(struct file *file, char *buf, size_t count, loff_t *ppos) 
+static ssize_t cbob_sensors_read(struct file *file, char *buf, size_t count, loff_t *ppos)
 {
-  short data[14] = {0,0,0,0,0,0,0,0,0,0,0,0};
+  struct sensors_file *sensors = file->private_data;
+  struct sensor_data data;
   int error;
-  
-  if((error = cbob_spi_message(CBOB_CMD_SENSORS_READ, 0, 0, data, 14)) < 0)
+
+  if((error = cbob_sensors_get(&data, sensors->live)) < 0)
     return error;
-  
-  if(count > 28)
-    count = 28;
-  
-  copy_to_user(buf, data, count);
-  
+
+  if(count > sizeof(data))
+    count = sizeof(data);
+
+  copy_to_user(buf, &data, count);
+
+  return count;
+}
+
+static int cbob_sensors_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param)
+{
+  struct sensors_file *sensors = file->private_data;
+  struct cbob_robot_state state;
+  int arg, error;
+
+  switch(ioctl_num) {
+    case CBOB_SENSORS_SET_LIVE:
+      copy_from_user(&arg, (void*)ioctl_param, sizeof(int));
+      sensors->live = arg ? 1 : 0;
+      break;
+    case CBOB_SENSORS_GET_ROBOT_STATE:
+      if((error = cbob_sensors_get_robot(&state)) < 0)
+        return error;
+      copy_to_user((void*)ioctl_param, &state, sizeof(state));
+      break;
+    default:
+      return -ENOTTY;
+  }
   return 0;
 }
 
@@ -53,23 +271,39 @@ static ssize_t cbob_sensors_read(struct file *file, char *buf, size_t count, lof
 int cbob_sensors_init(void)
 {
   int error;
-  
+
+  sema_init(&cbob_sensors_refresh_sem, 1);
+  cbob_sensors_workqueue = create_singlethread_workqueue("CBOB sensors");
+  if(cbob_sensors_workqueue == 0) {
+    printk(KERN_ALERT "Failed to create cbob_sensors workqueue\n");
+    return -ENOMEM;
+  }
+
   error = register_chrdev(cbob_sensors_major, CBOB_SENSORS_NAME, &cbob_sensors_fops);
-  
+
   if(error < 0) {
     printk(KERN_ALERT "Failed to register cbob_sensors char device with error: %d\n", error);
+    destroy_workqueue(cbob_sensors_workqueue);
+    cbob_sensors_workqueue = 0;
     return error;
   }
-  
+
   return 0;
 }
 
 void cbob_sensors_exit(void)
 {
   int error;
-  
+
   error = unregister_chrdev(cbob_sensors_major, CBOB_SENSORS_NAME);
   if(error < 0) {
     printk(KERN_ALERT "Failed to unregister cbob_sensors char device with error: %d\n", error);
   }
+
+  if(cbob_sensors_workqueue) {
+    sensor_refresh_ms = 0;
+    cancel_delayed_work(&cbob_sensors_work);
+    flush_workqueue(cbob_sensors_workqueue);
+    destroy_workqueue(cbob_sensors_workqueue);
+  }
 }
@@ -2,9 +2,23 @@
 #define __CBC_SENSORS_H__
 
 #include "cbob.h"
+#include "sensor_data.h"
 #define CBOB_SENSORS_NAME  "cbob_sensors"
 
+struct sensors_file {
+  short live;
+};
+
 int  cbob_sensors_init(void);
 void cbob_sensors_exit(void);
 
+// Fills data from the sensor snapshot, refreshing it over SPI if it is
+// older than sensor_max_age or live is set.
+int  cbob_sensors_get(struct sensor_data *data, int live);
+// One CBOB_CMD_STATE_READ, publishes the sensors to the snapshot.  Fails
+// with -ENOSYS if the BoB firmware doesn't know the command.
+int  cbob_sensors_get_robot(struct cbob_robot_state *state);
+// Marks the snapshot stale, call after anything that changes sensor state
+void cbob_sensors_invalidate(void);
+
 #endif
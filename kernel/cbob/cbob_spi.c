@@ -22,22 +22,46 @@
 */
 
 #include "cbob_spi.h"
+#include "cbob_cmd.h"
+#include "cbob_spi_stats.h"
 
 #include <asm/io.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/sched.h>
 #include <linux/jiffies.h>
+#include <linux/spinlock.h>
+#include <linux/completion.h>
 #include <asm/arch/imx-regs.h>
 #include <asm/arch/irqs.h>
 #include <asm/arch/hardware.h>
 #include <linux/interrupt.h>
 #include <linux/wait.h>
 
-static struct semaphore cbob_spi;
-
+// Longest the BoB gets to finish a phase before we go ahead anyway
 #define CBOB_TRANSACTION_DELAY 1600
 
+/* Ready line
+ *
+ * The BoB raises ChumbyBend (its PA6) when its SPI callback starts and drops
+ * it once the callback has set up the next phase, so a falling edge means it
+ * is ready for us.  The line comes in on the sensor card connector's bend
+ * input.  We wait for that edge after each phase and keep the TIM2 compare
+ * as the timeout, so old firmware or a missed edge costs no more than the
+ * fixed delay did.
+ */
+#define CBOB_READY_GPIO (GPIO_PORTD | 26)
+#define CBOB_READY_IRQ  IRQ_GPIOD(26)
+
+// off until the ready pin is confirmed on hardware
+static int spi_ready_handshake = 0;
+module_param(spi_ready_handshake, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(spi_ready_handshake, "Start the next SPI phase on the BoB ready edge instead of waiting out the full delay (experimental)");
+
+static int cbob_ready_irq_requested = 0;
+
 enum {
   CBOB_TRANSACTION_CHUMBYHEADER,
   CBOB_TRANSACTION_CHUMBYDATA,
@@ -46,10 +70,28 @@ enum {
   CBOB_TRANSACTION_END
 };
 
-static void cbob_spi_run_transactions(void);
-static int cbob_spi_do_transaction(void);
+/* Message queue
+ *
+ * Callers queue messages and the ready line (or the TIM2 compare timeout)
+ * walks them through the four transaction phases, starting the next queued
+ * message as soon as the previous one finishes.  Actuator writes go in the high priority queue
+ * and overtake queued reads.  cbob_spi_lock protects the queues and the
+ * current message and is also taken from the interrupts.
+ */
+static spinlock_t cbob_spi_lock = SPIN_LOCK_UNLOCKED;
+static struct list_head cbob_spi_queue[CBOB_SPI_PRIORITIES];
+static struct cbob_spi_msg *cbob_spi_current;
+static int cbob_spi_current_transaction;
+static int cbob_spi_running;
+static int cbob_spi_waiting;
+
+static void cbob_spi_start_wait(void);
+static void cbob_spi_stop_wait(void);
+
+static struct cbob_spi_msg *cbob_spi_step(void);
+static void cbob_spi_do_transaction(struct cbob_spi_msg *msg);
 
-static void cbob_spi_update_desync(void);
+static void cbob_spi_update_desync(struct cbob_spi_msg *msg);
 
 #define TIMER IMX_TIM2_BASE
 #define TIMER_IRQ TIM2_INT
@@ -57,127 +99,206 @@ static void cbob_spi_init_timer(void);
 static void cbob_spi_shutdown_timer(void);
 static irqreturn_t cbob_timer_interrupt(int irq, void *dev_id, struct pt_regs *regs);
 
+static void cbob_spi_init_ready(void);
+static void cbob_spi_shutdown_ready(void);
+static irqreturn_t cbob_ready_interrupt(int irq, void *dev_id, struct pt_regs *regs);
+
 static void cbob_spi_init_spi(void);
 static unsigned int spi_exchange_data(unsigned int dataTx);
 
 void cbob_spi_init()
 {
+  int i;
+
+  for(i = 0;i < CBOB_SPI_PRIORITIES;i++)
+    INIT_LIST_HEAD(&cbob_spi_queue[i]);
+
   cbob_spi_init_spi();
   cbob_spi_init_timer();
-
-  sema_init(&cbob_spi, 1);
+  cbob_spi_init_ready();
 }
 
 #define CBOB_SPI_BUFSIZE 128
-static volatile short cbob_spi_message_cmd;
-static short cbob_spi_message_outbuf[CBOB_SPI_BUFSIZE];
-static volatile short cbob_spi_message_outcount;
-static short cbob_spi_message_inbuf[CBOB_SPI_BUFSIZE];
-static volatile short cbob_spi_message_incount;
-static volatile short cbob_spi_message_replycount;
 
-int cbob_spi_message(short cmd, short *outbuf, short outcount, short *inbuf, short incount)
+int cbob_spi_submit(struct cbob_spi_msg *msg)
 {
-  short len;
-  if(down_interruptible(&cbob_spi))
-    return -EINTR;
+  unsigned long flags;
+  struct cbob_spi_msg *done = 0;
 
-  cbob_spi_message_cmd = cmd;
-  cbob_spi_message_outcount = outcount;
-  if (cbob_spi_message_outcount > CBOB_SPI_BUFSIZE) {
+  if(msg->priority < 0 || msg->priority >= CBOB_SPI_PRIORITIES)
+    return -EINVAL;
+  if(msg->outcount > CBOB_SPI_BUFSIZE) {
     printk(KERN_WARNING "Message overflowed outbuf!");
-    cbob_spi_message_outcount = CBOB_SPI_BUFSIZE;
+    msg->outcount = CBOB_SPI_BUFSIZE;
   }
-  memcpy(cbob_spi_message_outbuf, outbuf, cbob_spi_message_outcount * sizeof(short));
-  cbob_spi_message_incount = incount;
+  msg->replycount = 0;
+  msg->queued = cbob_spi_stats_now();
 
-  cbob_spi_run_transactions();
+  spin_lock_irqsave(&cbob_spi_lock, flags);
+  list_add_tail(&msg->list, &cbob_spi_queue[msg->priority]);
 
-  len = incount < cbob_spi_message_replycount ? incount : cbob_spi_message_replycount;
-  memcpy(inbuf, cbob_spi_message_inbuf, len*sizeof(short));
+  // the transport only goes idle after waiting out the last phase,
+  // so the BoB is ready for a header now
+  if(!cbob_spi_running) {
+    cbob_spi_running = 1;
+    done = cbob_spi_step();
+  }
+  spin_unlock_irqrestore(&cbob_spi_lock, flags);
+
+  if(done && done->complete)
+    done->complete(done);
 
-  up(&cbob_spi);
-  return 1;
+  return 0;
 }
 
-static int cbob_spi_current_transaction;
-static unsigned long cbob_spi_last_message;
-DECLARE_COMPLETION(cbob_spi_message_completion);
+// Actuator writes jump ahead of queued reads
+static int cbob_spi_priority(short cmd)
+{
+  switch(cmd) {
+    case CBOB_CMD_DIGITAL_WRITE:
+    case CBOB_CMD_PWM_WRITE:
+    case CBOB_CMD_PID_WRITE:
+    case CBOB_CMD_SERVO_WRITE:
+    case CBOB_CMD_BATCH:
+      return CBOB_SPI_PRIORITY_HIGH;
+  }
+  return CBOB_SPI_PRIORITY_NORMAL;
+}
 
-static void cbob_spi_run_transactions()
+static void cbob_spi_message_done(struct cbob_spi_msg *msg)
 {
-  cbob_spi_current_transaction = 0;
-  // if enough time has passed since the last transaction
-  if (time_after(jiffies, cbob_spi_last_message + usecs_to_jiffies(CBOB_TRANSACTION_DELAY)))
-    cbob_spi_do_transaction(); // go ahead and do one now to save time
+  complete((struct completion*)msg->context);
+}
 
-  init_completion(&cbob_spi_message_completion);
-  IMX_TCTL(TIMER) |= TCTL_TEN; // enable timer
-  wait_for_completion(&cbob_spi_message_completion);
-  cbob_spi_last_message = jiffies;
+int cbob_spi_message(short cmd, short *outbuf, short outcount, short *inbuf, short incount)
+{
+  struct cbob_spi_msg msg;
+  struct completion done;
+  short len;
+  int error;
+
+  init_completion(&done);
+
+  msg.cmd = cmd;
+  msg.outbuf = outbuf;
+  msg.outcount = outcount;
+  msg.inbuf = inbuf;
+  msg.incount = incount;
+  msg.priority = cbob_spi_priority(cmd);
+  msg.complete = cbob_spi_message_done;
+  msg.context = &done;
+
+  if((error = cbob_spi_submit(&msg)) < 0)
+    return error;
+
+  // the interrupt writes into inbuf, so this wait can't be interrupted
+  wait_for_completion(&done);
+
+  len = incount < msg.replycount ? incount : msg.replycount;
+  if(len < 0)
+    len = 0;
+
+  return len;
 }
 
-static int cbob_spi_do_transaction()
+// Runs the next phase, called with cbob_spi_lock held.  Returns the message
+// that just finished, if any, so its callback can run without the lock.
+static struct cbob_spi_msg *cbob_spi_step(void)
 {
+  struct cbob_spi_msg *msg = cbob_spi_current;
   int i;
 
-  if (cbob_spi_current_transaction == CBOB_TRANSACTION_END)
-    return 1;
+  if(msg == 0) {
+    for(i = CBOB_SPI_PRIORITIES-1;i >= 0;i--) {
+      if(!list_empty(&cbob_spi_queue[i])) {
+        msg = list_entry(cbob_spi_queue[i].next, struct cbob_spi_msg, list);
+        list_del(&msg->list);
+        break;
+      }
+    }
+    if(msg == 0) {
+      cbob_spi_running = 0;
+      return 0;
+    }
+    cbob_spi_current = msg;
+    cbob_spi_current_transaction = CBOB_TRANSACTION_CHUMBYHEADER;
+    msg->started = cbob_spi_stats_now();
+  }
+
+  // drop any edge left over from a phase that timed out
+  ISR(CBOB_READY_GPIO >> 5) = 1 << (CBOB_READY_GPIO & GPIO_PIN_MASK);
+
+  cbob_spi_do_transaction(msg);
+
+  if(++cbob_spi_current_transaction == CBOB_TRANSACTION_END) {
+    cbob_spi_current = 0;
+    cbob_spi_stats_message(msg->cmd, msg->outcount, msg->replycount,
+                           msg->started - msg->queued, cbob_spi_stats_now() - msg->started);
+  }
+  else
+    msg = 0;
+
+  // the next phase, or the next queued message's header, once the BoB is ready
+  cbob_spi_start_wait();
+
+  return msg;
+}
+
+static void cbob_spi_do_transaction(struct cbob_spi_msg *msg)
+{
+  int i;
 
   switch (cbob_spi_current_transaction) {
     case CBOB_TRANSACTION_CHUMBYHEADER: {
       spi_exchange_data(0xCB07);
-      spi_exchange_data(cbob_spi_message_cmd);
-      spi_exchange_data(cbob_spi_message_outcount > 0 ? cbob_spi_message_outcount : 1);
+      spi_exchange_data(msg->cmd);
+      spi_exchange_data(msg->outcount > 0 ? msg->outcount : 1);
       break;
     }
 
     case CBOB_TRANSACTION_CHUMBYDATA:
-      if (cbob_spi_message_outcount == 0)
+      if (msg->outcount == 0)
         spi_exchange_data(0);
       else {
-        for (i = 0;i < cbob_spi_message_outcount;i++)
-         spi_exchange_data(cbob_spi_message_outbuf[i]);
+        for (i = 0;i < msg->outcount;i++)
+         spi_exchange_data(msg->outbuf[i]);
       }
       break;
 
     case CBOB_TRANSACTION_CBOBLENGTH:
-      cbob_spi_message_replycount = spi_exchange_data(0);
+      msg->replycount = spi_exchange_data(0);
       spi_exchange_data(0);
-      cbob_spi_update_desync();
+      cbob_spi_update_desync(msg);
       break;
 
     case CBOB_TRANSACTION_CBOBDATA:
-      for (i = 0;i < cbob_spi_message_replycount;i++) {
-        if (i < cbob_spi_message_incount)
-          cbob_spi_message_inbuf[i] = spi_exchange_data(0);
+      for (i = 0;i < msg->replycount;i++) {
+        if (i < msg->incount)
+          msg->inbuf[i] = spi_exchange_data(0);
         else
           spi_exchange_data(0);
       }
       break;
   }
-
-  if (++cbob_spi_current_transaction == CBOB_TRANSACTION_END) {
-    complete_all(&cbob_spi_message_completion);
-    return 1;
-  } else
-    return 0;
 }
 
 static int cbob_spi_desync;
 static int cbob_spi_desync_count;
-static void cbob_spi_update_desync() {
+static void cbob_spi_update_desync(struct cbob_spi_msg *msg) {
   int desync;
 
-  if (cbob_spi_message_replycount == 1 && cbob_spi_message_incount == 0)
+  if (msg->replycount == 1 && msg->incount == 0)
     desync = 0;
-  else if (cbob_spi_message_replycount > cbob_spi_message_incount)
+  else if (msg->replycount > msg->incount)
     desync = 1;
-  else if (cbob_spi_message_replycount < 0)
+  else if (msg->replycount < 0)
     desync = 1;
   else
     desync = 0;
 
+  if (desync)
+    cbob_spi_stats_desync();
+
   if (desync == cbob_spi_desync)
     return;
 
@@ -186,7 +307,7 @@ static void cbob_spi_update_desync() {
   if (desync) {
     cbob_spi_desync_count++;
     printk(KERN_WARNING "CBOB desync detected. replycount is %hd, incount is %hd, cmd is %hd\n",
-      cbob_spi_message_replycount, cbob_spi_message_incount, cbob_spi_message_cmd);
+      msg->replycount, msg->incount, msg->cmd);
   } else {
     printk(KERN_NOTICE "CBOB resynced, after %d bad messages\n", cbob_spi_desync_count);
     cbob_spi_desync_count = 0;
@@ -195,9 +316,24 @@ static void cbob_spi_update_desync() {
 
 void cbob_spi_exit(void)
 {
+  cbob_spi_shutdown_ready();
   cbob_spi_shutdown_timer();
 }
 
+// caller holds cbob_spi_lock
+static void cbob_spi_start_wait(void)
+{
+  cbob_spi_waiting = 1;
+  IMX_TCTL(TIMER) |= TCTL_TEN; // enable timer
+}
+
+static void cbob_spi_stop_wait(void)
+{
+  cbob_spi_waiting = 0;
+  IMX_TCTL(TIMER) &= ~TCTL_TEN; // shut off timer
+  IMX_TSTAT(TIMER) = TSTAT_CAPT | TSTAT_COMP; // clear interrupts
+}
+
 static void cbob_spi_init_timer(void)
 {
   IMX_TCTL(TIMER) = TCTL_SWR; // reset timer
@@ -219,14 +355,66 @@ static void cbob_spi_shutdown_timer(void)
 
 static irqreturn_t cbob_timer_interrupt(int irq, void *dev_id, struct pt_regs *regs)
 {
+  struct cbob_spi_msg *done = 0;
+  unsigned long flags;
+
   if (!(IMX_TSTAT(TIMER) & TSTAT_COMP))
     return IRQ_NONE;
 
-  IMX_TSTAT(TIMER) = TSTAT_CAPT | TSTAT_COMP; // clear interrupts
-  IMX_TCTL(TIMER) &= ~TCTL_TEN; // shut off timer
+  // the ready edge can interrupt us, so keep it out while we step
+  spin_lock_irqsave(&cbob_spi_lock, flags);
+  if (cbob_spi_waiting) {
+    // the BoB never signalled ready
+    if (spi_ready_handshake)
+      cbob_spi_stats_timeout();
+    cbob_spi_stop_wait();
+    done = cbob_spi_step(); // run transaction, restarts the wait if there is more to do
+  }
+  else
+    IMX_TSTAT(TIMER) = TSTAT_CAPT | TSTAT_COMP; // clear interrupts
+  spin_unlock_irqrestore(&cbob_spi_lock, flags);
+
+  if (done && done->complete)
+    done->complete(done);
+
+  return IRQ_HANDLED;
+}
+
+static void cbob_spi_init_ready(void)
+{
+  imx_gpio_mode(CBOB_READY_GPIO | GPIO_IN | GPIO_GPIO | GPIO_IRQ_FALLING);
+  if (request_irq(CBOB_READY_IRQ, cbob_ready_interrupt, 0, "CBOB ready", 0) < 0) {
+    printk(KERN_ALERT "Failed to get the BoB ready line, using the fixed SPI delay\n");
+    spi_ready_handshake = 0;
+    return;
+  }
+  cbob_ready_irq_requested = 1;
+}
+
+static void cbob_spi_shutdown_ready(void)
+{
+  if (cbob_ready_irq_requested)
+    free_irq(CBOB_READY_IRQ, 0);
+  cbob_ready_irq_requested = 0;
+}
+
+static irqreturn_t cbob_ready_interrupt(int irq, void *dev_id, struct pt_regs *regs)
+{
+  struct cbob_spi_msg *done = 0;
+  unsigned long flags;
+
+  if (!spi_ready_handshake)
+    return IRQ_HANDLED;
+
+  spin_lock_irqsave(&cbob_spi_lock, flags);
+  if (cbob_spi_waiting) {
+    cbob_spi_stop_wait();
+    done = cbob_spi_step();
+  }
+  spin_unlock_irqrestore(&cbob_spi_lock, flags);
 
-  if (!cbob_spi_do_transaction()) // run transaction
-    IMX_TCTL(TIMER) |= TCTL_TEN; // if not last transaction, start timer to run it again
+  if (done && done->complete)
+    done->complete(done);
 
   return IRQ_HANDLED;
 }
@@ -3,11 +3,36 @@
 
 #include <linux/config.h>
 #include <linux/types.h>
+#include <linux/list.h>
 #include <asm/semaphore.h>
 
+#define CBOB_SPI_PRIORITY_NORMAL 0
+#define CBOB_SPI_PRIORITY_HIGH   1
+#define CBOB_SPI_PRIORITIES      2
+
+struct cbob_spi_msg {
+  short cmd;
+  short *outbuf;
+  short outcount;
+  short *inbuf;               // up to incount reply words land here
+  short incount;
+  short replycount;           // words the BoB replied with, set before complete()
+  int priority;               // CBOB_SPI_PRIORITY_*
+  void (*complete)(struct cbob_spi_msg *msg); // runs in interrupt context
+  void *context;
+  struct list_head list;
+  unsigned long queued;       // cbob_spi_stats_now() stamps
+  unsigned long started;
+};
+
 void cbob_spi_init(void);
 void cbob_spi_exit(void);
 
+// Queues msg and returns at once.  msg and its buffers belong to the
+// transport until complete() is called.
+int cbob_spi_submit(struct cbob_spi_msg *msg);
+
+// Returns the number of reply words copied to inbuf, or a negative error
 int cbob_spi_message(short cmd, short *outbuf, short outcount, short *inbuf, short incount);
 
 #endif
@@ -0,0 +1,216 @@
+#include "cbob_spi_stats.h"
+#include "cbob_cmd.h"
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/jiffies.h>
+#include <linux/time.h>
+#include <linux/spinlock.h>
+#include <linux/seq_file.h>
+#include <linux/debugfs.h>
+#include <asm/uaccess.h>
+
+/* SPI link statistics
+ *
+ * Per command counts, words moved, queue wait and transfer time, plus log2
+ * histograms of both times, timeouts on the ready line and desyncs.  Read
+ * them from <debugfs>/cbob/spi_stats, write anything to it to reset them.
+ * Queue wait runs from submit to the header going out, transfer time from
+ * there to the last reply word.
+ */
+
+struct cbob_spi_cmd_stats {
+  unsigned long count;
+  unsigned long words_out;
+  unsigned long words_in;
+  unsigned long wait_total;
+  unsigned long wait_max;
+  unsigned long xfer_total;
+  unsigned long xfer_max;
+};
+
+struct cbob_spi_stats {
+  struct cbob_spi_cmd_stats cmd[CBOB_SPI_STATS_CMDS];
+  unsigned long wait_hist[CBOB_SPI_STATS_BUCKETS];
+  unsigned long xfer_hist[CBOB_SPI_STATS_BUCKETS];
+  unsigned long timeouts;
+  unsigned long desyncs;
+  unsigned long since;
+};
+
+static struct cbob_spi_stats cbob_spi_stats;
+static spinlock_t cbob_spi_stats_lock = SPIN_LOCK_UNLOCKED;
+
+static struct dentry *cbob_spi_stats_dir;
+static struct dentry *cbob_spi_stats_file;
+
+unsigned long cbob_spi_stats_now(void)
+{
+  struct timeval tv;
+
+  do_gettimeofday(&tv);
+  return tv.tv_sec*1000000 + tv.tv_usec;
+}
+
+// bucket i counts times in [2^i, 2^(i+1)) us, the last one everything longer
+static int cbob_spi_stats_bucket(unsigned long us)
+{
+  int i = 0;
+
+  while(us > 1 && i < CBOB_SPI_STATS_BUCKETS-1) {
+    us >>= 1;
+    i++;
+  }
+  return i;
+}
+
+void cbob_spi_stats_message(short cmd, short outcount, short replycount,
+                            unsigned long wait_us, unsigned long xfer_us)
+{
+  struct cbob_spi_cmd_stats *stats;
+  unsigned long flags;
+
+  if(cmd < 0 || cmd >= CBOB_SPI_STATS_CMDS)
+    cmd = 0;
+
+  spin_lock_irqsave(&cbob_spi_stats_lock, flags);
+  stats = &cbob_spi_stats.cmd[cmd];
+  stats->count++;
+  stats->words_out += outcount > 0 ? outcount : 1;
+  stats->words_in += replycount > 0 ? replycount : 0;
+  stats->wait_total += wait_us;
+  if(wait_us > stats->wait_max)
+    stats->wait_max = wait_us;
+  stats->xfer_total += xfer_us;
+  if(xfer_us > stats->xfer_max)
+    stats->xfer_max = xfer_us;
+  cbob_spi_stats.wait_hist[cbob_spi_stats_bucket(wait_us)]++;
+  cbob_spi_stats.xfer_hist[cbob_spi_stats_bucket(xfer_us)]++;
+  spin_unlock_irqrestore(&cbob_spi_stats_lock, flags);
+}
+
+void cbob_spi_stats_timeout(void)
+{
+  unsigned long flags;
+
+  spin_lock_irqsave(&cbob_spi_stats_lock, flags);
+  cbob_spi_stats.timeouts++;
+  spin_unlock_irqrestore(&cbob_spi_stats_lock, flags);
+}
+
+void cbob_spi_stats_desync(void)
+{
+  unsigned long flags;
+
+  spin_lock_irqsave(&cbob_spi_stats_lock, flags);
+  cbob_spi_stats.desyncs++;
+  spin_unlock_irqrestore(&cbob_spi_stats_lock, flags);
+}
+
+void cbob_spi_stats_reset(void)
+{
+  unsigned long flags;
+
+  spin_lock_irqsave(&cbob_spi_stats_lock, flags);
+  memset(&cbob_spi_stats, 0, sizeof(cbob_spi_stats));
+  cbob_spi_stats.since = jiffies;
+  spin_unlock_irqrestore(&cbob_spi_stats_lock, flags);
+}
+
+/* File Ops */
+
+static int cbob_spi_stats_show(struct seq_file *m, void *v)
+{
+  struct cbob_spi_stats *stats;
+  struct cbob_spi_cmd_stats *cmd;
+  unsigned long flags;
+  int i;
+
+  // copy out so we don't print with interrupts off
+  stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+  if(stats == 0)
+    return -ENOMEM;
+
+  spin_lock_irqsave(&cbob_spi_stats_lock, flags);
+  *stats = cbob_spi_stats;
+  spin_unlock_irqrestore(&cbob_spi_stats_lock, flags);
+
+  seq_printf(m, "seconds %lu\n", (jiffies - stats->since)/HZ);
+  seq_printf(m, "timeouts %lu\n", stats->timeouts);
+  seq_printf(m, "desyncs %lu\n\n", stats->desyncs);
+
+  seq_printf(m, "cmd count words_out words_in wait_avg_us wait_max_us xfer_avg_us xfer_max_us\n");
+  for(i = 0;i < CBOB_SPI_STATS_CMDS;i++) {
+    cmd = &stats->cmd[i];
+    if(cmd->count == 0)
+      continue;
+    seq_printf(m, "%d %lu %lu %lu %lu %lu %lu %lu\n", i, cmd->count,
+               cmd->words_out, cmd->words_in,
+               cmd->wait_total/cmd->count, cmd->wait_max,
+               cmd->xfer_total/cmd->count, cmd->xfer_max);
+  }
+
+  seq_printf(m, "\nus wait xfer\n");
+  for(i = 0;i < CBOB_SPI_STATS_BUCKETS;i++)
+    seq_printf(m, "%s%lu %lu %lu\n", i == CBOB_SPI_STATS_BUCKETS-1 ? ">=" : "<",
+               i == CBOB_SPI_STATS_BUCKETS-1 ? 1UL<<i : 2UL<<i,
+               stats->wait_hist[i], stats->xfer_hist[i]);
+
+  kfree(stats);
+  return 0;
+}
+
+static int cbob_spi_stats_open(struct inode *inode, struct file *file)
+{
+  return single_open(file, cbob_spi_stats_show, 0);
+}
+
+static ssize_t cbob_spi_stats_write(struct file *file, const char *buf, size_t count, loff_t *ppos)
+{
+  cbob_spi_stats_reset();
+  return count;
+}
+
+static struct file_operations cbob_spi_stats_fops = {
+	owner:   THIS_MODULE,
+	open:    cbob_spi_stats_open,
+	read:    seq_read,
+	write:   cbob_spi_stats_write,
+	llseek:  seq_lseek,
+	release: single_release
+};
+
+/* init and exit */
+int cbob_spi_stats_init(void)
+{
+  cbob_spi_stats_reset();
+
+  cbob_spi_stats_dir = debugfs_create_dir("cbob", 0);
+  if(cbob_spi_stats_dir == 0) {
+    printk(KERN_ALERT "Failed to create cbob debugfs directory\n");
+    return -ENOMEM;
+  }
+
+  cbob_spi_stats_file = debugfs_create_file("spi_stats", S_IRUGO | S_IWUSR, cbob_spi_stats_dir,
+                                            0, &cbob_spi_stats_fops);
+  if(cbob_spi_stats_file == 0) {
+    printk(KERN_ALERT "Failed to create cbob spi_stats\n");
+    debugfs_remove(cbob_spi_stats_dir);
+    cbob_spi_stats_dir = 0;
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+void cbob_spi_stats_exit(void)
+{
+  if(cbob_spi_stats_dir == 0)
+    return;
+
+  debugfs_remove(cbob_spi_stats_file);
+  debugfs_remove(cbob_spi_stats_dir);
+  cbob_spi_stats_dir = 0;
+}
@@ -0,0 +1,24 @@
+#ifndef __CBOB_SPI_STATS_H__
+#define __CBOB_SPI_STATS_H__
+
+#include <linux/config.h>
+#include <linux/types.h>
+
+#define CBOB_SPI_STATS_CMDS    32
+#define CBOB_SPI_STATS_BUCKETS 16
+
+// Microsecond clock the stats are stamped with
+unsigned long cbob_spi_stats_now(void);
+
+// Called from the transport, any context
+void cbob_spi_stats_message(short cmd, short outcount, short replycount,
+                            unsigned long wait_us, unsigned long xfer_us);
+void cbob_spi_stats_timeout(void);
+void cbob_spi_stats_desync(void);
+
+void cbob_spi_stats_reset(void);
+
+int  cbob_spi_stats_init(void);
+void cbob_spi_stats_exit(void);
+
+#endif
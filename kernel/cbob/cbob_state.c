@@ -0,0 +1,326 @@
+#include "cbob_state.h"
+#include "cbob_sensors.h"
+#include "cbob_spi.h"
+#include "cbob_cmd.h"
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/fs.h>
+#include <linux/types.h>
+#include <linux/mm.h>
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/dma-mapping.h>
+#include <asm/atomic.h>
+#include <asm/system.h>
+#include <asm/semaphore.h>
+#include <asm/uaccess.h>
+
+static int cbob_state_major = CBOB_STATE_MAJOR;
+
+/* State page
+ *
+ * A page of uncached memory holding the latest sensor snapshot, motor
+ * counters and pwm, mapped read-only into anyone who opens /dev/cbc/state.
+ * Sensors are published by every snapshot refresh in cbob_sensors.c; the
+ * motor side is polled here every state_refresh_ms while the device is open,
+ * together with the sensors in one CBOB_CMD_STATE_READ when the BoB has it.
+ * Motors older than state_max_age_ms are marked invalid, so a position loop
+ * reading the counters falls back to a live read instead of overshooting.
+ */
+
+static int state_refresh_ms = 20;
+module_param(state_refresh_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(state_refresh_ms, "Motor counter/pwm refresh period for /dev/cbc/state in ms");
+
+static int state_max_age_ms = 20;
+module_param(state_max_age_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(state_max_age_ms, "Age in ms after which /dev/cbc/state readers read the motors from the BoB");
+
+static struct cbob_state *cbob_state_page;
+static dma_addr_t cbob_state_dma;
+static spinlock_t cbob_state_lock = SPIN_LOCK_UNLOCKED;
+static unsigned int cbob_state_motors_generation;
+static atomic_t cbob_state_users = ATOMIC_INIT(0);
+// cleared when the BoB firmware turns out to predate CBOB_CMD_STATE_READ
+static int cbob_state_use_robot = 1;
+
+static struct workqueue_struct *cbob_state_workqueue;
+static void cbob_state_refresh_work(void *arg);
+DECLARE_WORK(cbob_state_work, cbob_state_refresh_work, 0);
+// on the shared queue, so a refresh stuck on the SPI bus can't hold it up
+static void cbob_state_expire_work(void *arg);
+DECLARE_WORK(cbob_state_expire, cbob_state_expire_work, 0);
+
+static unsigned long cbob_state_max_age(void)
+{
+  return msecs_to_jiffies(state_max_age_ms > 0 ? state_max_age_ms : 1);
+}
+
+// caller holds cbob_state_lock
+static void cbob_state_begin(void)
+{
+  cbob_state_page->seq++;
+  wmb();
+}
+
+static void cbob_state_end(void)
+{
+  wmb();
+  cbob_state_page->seq++;
+}
+
+void cbob_state_set_sensors(struct sensor_data *sensors)
+{
+  if(cbob_state_page == 0)
+    return;
+
+  spin_lock(&cbob_state_lock);
+  cbob_state_begin();
+  cbob_state_page->sensors = *sensors;
+  cbob_state_page->sensors_stamp = jiffies;
+  cbob_state_page->valid |= CBOB_STATE_SENSORS;
+  cbob_state_end();
+  spin_unlock(&cbob_state_lock);
+}
+
+void cbob_state_invalidate(unsigned int parts)
+{
+  if(cbob_state_page == 0)
+    return;
+
+  spin_lock(&cbob_state_lock);
+  if(parts & CBOB_STATE_MOTORS)
+    cbob_state_motors_generation++;
+  cbob_state_begin();
+  cbob_state_page->valid &= ~parts;
+  cbob_state_end();
+  spin_unlock(&cbob_state_lock);
+}
+
+// caller holds cbob_state_lock
+static void cbob_state_set_motors(int *counter, short *pwm)
+{
+  cbob_state_begin();
+  memcpy(cbob_state_page->motor_counter, counter, sizeof(cbob_state_page->motor_counter));
+  memcpy(cbob_state_page->pwm, pwm, sizeof(cbob_state_page->pwm));
+  cbob_state_page->motors_stamp = jiffies;
+  cbob_state_page->valid |= CBOB_STATE_MOTORS;
+  cbob_state_end();
+  // does nothing while pending, the pending check pushes itself back
+  schedule_delayed_work(&cbob_state_expire, cbob_state_max_age());
+}
+
+static void cbob_state_expire_work(void *arg)
+{
+  unsigned long age, max_age = cbob_state_max_age();
+
+  if(cbob_state_page == 0)
+    return;
+
+  spin_lock(&cbob_state_lock);
+  if((cbob_state_page->valid & CBOB_STATE_MOTORS) == 0) {
+    spin_unlock(&cbob_state_lock);
+    return;
+  }
+  age = (unsigned int)jiffies - cbob_state_page->motors_stamp;
+  if(age >= max_age) {
+    cbob_state_begin();
+    cbob_state_page->valid &= ~CBOB_STATE_MOTORS;
+    cbob_state_end();
+  }
+  spin_unlock(&cbob_state_lock);
+
+  if(age < max_age)
+    schedule_delayed_work(&cbob_state_expire, max_age - age);
+}
+
+static int cbob_state_refresh_motors(void)
+{
+  short port = 4;
+  short pwm[4] = {0,0,0,0};
+  int counter[4] = {0,0,0,0};
+  unsigned int generation;
+  int error;
+
+  generation = cbob_state_motors_generation;
+
+  if((error = cbob_spi_message(CBOB_CMD_PID_READ, &port, 1, (short*)counter, 8)) < 0)
+    return error;
+  if((error = cbob_spi_message(CBOB_CMD_PWM_READ, &port, 1, pwm, 4)) < 0)
+    return error;
+
+  spin_lock(&cbob_state_lock);
+  // a write raced with the reads, leave the motors invalid until next time
+  if(generation == cbob_state_motors_generation)
+    cbob_state_set_motors(counter, pwm);
+  spin_unlock(&cbob_state_lock);
+
+  return 0;
+}
+
+// sensors and motors in one transaction
+static int cbob_state_refresh_robot(void)
+{
+  struct cbob_robot_state robot;
+  unsigned int generation;
+  int error;
+
+  generation = cbob_state_motors_generation;
+
+  // publishes the sensors itself
+  if((error = cbob_sensors_get_robot(&robot)) < 0)
+    return error;
+
+  spin_lock(&cbob_state_lock);
+  if(generation == cbob_state_motors_generation)
+    cbob_state_set_motors(robot.motor_counter, robot.pwm);
+  spin_unlock(&cbob_state_lock);
+
+  return 0;
+}
+
+static void cbob_state_refresh_work(void *arg)
+{
+  struct sensor_data sensors;
+  int error = -ENOSYS;
+
+  if(atomic_read(&cbob_state_users) == 0)
+    return;
+
+  if(cbob_state_use_robot) {
+    error = cbob_state_refresh_robot();
+    if(error == -ENOSYS)
+      cbob_state_use_robot = 0;
+  }
+  if(error < 0) {
+    // keeps the sensor snapshot refreshing, which publishes into the page
+    cbob_sensors_get(&sensors, 0);
+    cbob_state_refresh_motors();
+  }
+
+  if(atomic_read(&cbob_state_users) > 0)
+    queue_delayed_work(cbob_state_workqueue, &cbob_state_work,
+                       msecs_to_jiffies(state_refresh_ms > 0 ? state_refresh_ms : 1));
+}
+
+/* File Ops */
+
+static ssize_t cbob_state_read(struct file *file, char *buf, size_t count, loff_t *ppos);
+static int     cbob_state_mmap(struct file *file, struct vm_area_struct *vma);
+static int     cbob_state_open(struct inode *inode, struct file *file);
+static int     cbob_state_release(struct inode *inode, struct file *file);
+
+static struct file_operations cbob_state_fops = {
+	owner:   THIS_MODULE,
+	open:    cbob_state_open,
+	release: cbob_state_release,
+	read:    cbob_state_read,
+	mmap:    cbob_state_mmap
+};
+
+static int cbob_state_open(struct inode *inode, struct file *file)
+{
+  if(file->f_mode & FMODE_WRITE)
+    return -EPERM;
+
+  if(atomic_inc_return(&cbob_state_users) == 1)
+    queue_work(cbob_state_workqueue, &cbob_state_work);
+
+  return 0;
+}
+
+static int cbob_state_release(struct inode *inode, struct file *file)
+{
+  atomic_dec(&cbob_state_users);
+  return 0;
+}
+
+static ssize_t cbob_state_read(struct file *file, char *buf, size_t count, loff_t *ppos)
+{
+  struct cbob_state state;
+
+  spin_lock(&cbob_state_lock);
+  state = *cbob_state_page;
+  spin_unlock(&cbob_state_lock);
+
+  if(count > sizeof(state))
+    count = sizeof(state);
+
+  copy_to_user(buf, &state, count);
+
+  return count;
+}
+
+static int cbob_state_mmap(struct file *file, struct vm_area_struct *vma)
+{
+  if(vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE)
+    return -EINVAL;
+  if(vma->vm_flags & VM_WRITE)
+    return -EPERM;
+
+  vma->vm_flags &= ~VM_MAYWRITE;
+
+  return dma_mmap_coherent(0, vma, cbob_state_page, cbob_state_dma, PAGE_SIZE);
+}
+
+/* init and exit */
+int cbob_state_init(void)
+{
+  int error;
+
+  // uncached on both sides, so the seq/wmb ordering is all readers need
+  cbob_state_page = dma_alloc_coherent(0, PAGE_SIZE, &cbob_state_dma, GFP_KERNEL);
+  if(cbob_state_page == 0) {
+    printk(KERN_ALERT "Failed to allocate cbob_state page\n");
+    return -ENOMEM;
+  }
+  memset(cbob_state_page, 0, PAGE_SIZE);
+
+  cbob_state_workqueue = create_singlethread_workqueue("CBOB state");
+  if(cbob_state_workqueue == 0) {
+    printk(KERN_ALERT "Failed to create cbob_state workqueue\n");
+    dma_free_coherent(0, PAGE_SIZE, cbob_state_page, cbob_state_dma);
+    cbob_state_page = 0;
+    return -ENOMEM;
+  }
+
+  error = register_chrdev(cbob_state_major, CBOB_STATE_NAME, &cbob_state_fops);
+
+  if(error < 0) {
+    printk(KERN_ALERT "Failed to register cbob_state char device with error: %d\n", error);
+    destroy_workqueue(cbob_state_workqueue);
+    dma_free_coherent(0, PAGE_SIZE, cbob_state_page, cbob_state_dma);
+    cbob_state_page = 0;
+    return error;
+  }
+
+  return 0;
+}
+
+void cbob_state_exit(void)
+{
+  int error;
+  struct cbob_state *page = cbob_state_page;
+
+  if(page == 0)
+    return;
+
+  error = unregister_chrdev(cbob_state_major, CBOB_STATE_NAME);
+  if(error < 0) {
+    printk(KERN_ALERT "Failed to unregister cbob_state char device with error: %d\n", error);
+  }
+
+  cancel_delayed_work(&cbob_state_work);
+  flush_workqueue(cbob_state_workqueue);
+  destroy_workqueue(cbob_state_workqueue);
+  // with the motors invalid the expire check stops pushing itself back
+  cbob_state_invalidate(CBOB_STATE_MOTORS);
+  flush_scheduled_work();
+  cancel_delayed_work(&cbob_state_expire);
+  flush_scheduled_work();
+
+  cbob_state_page = 0;
+  dma_free_coherent(0, PAGE_SIZE, page, cbob_state_dma);
+}
@@ -0,0 +1,15 @@
+#ifndef __CBC_STATE_H__
+#define __CBC_STATE_H__
+
+#include "cbob.h"
+#include "sensor_data.h"
+#define CBOB_STATE_NAME  "cbob_state"
+
+int  cbob_state_init(void);
+void cbob_state_exit(void);
+
+void cbob_state_set_sensors(struct sensor_data *sensors);
+// Clears CBOB_STATE_* bits until the next refresh of those parts
+void cbob_state_invalidate(unsigned int parts);
+
+#endif
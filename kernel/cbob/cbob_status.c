@@ -1,11 +1,14 @@
 #include "cbob_status.h"
 #include "cbob_spi.h"
 #include "cbob_cmd.h"
+#include "cbob_sensors.h"
+#include "cbob_state.h"
 
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/types.h>
 #include <asm/semaphore.h>
+#include <linux/slab.h>
 #include <asm/uaccess.h>
 
 static int cbob_status_major = CBOB_STATUS_MAJOR;
@@ -13,6 +16,7 @@ static int cbob_status_major = CBOB_STATUS_MAJOR;
 /* File Ops */
 
 static ssize_t cbob_status_read(struct file *file, char *buf, size_t count, loff_t *ppos);
+static int     cbob_status_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param);
 static int     cbob_status_open(struct inode *inode, struct file *file);
 static int     cbob_status_release(struct inode *inode, struct file *file);
 
@@ -20,7 +24,8 @@ static struct file_operations cbob_status_fops = {
 	owner:   THIS_MODULE,
     open:    cbob_status_open,
     release: cbob_status_release,
-	read:    cbob_status_read
+	read:    cbob_status_read,
+	ioctl:   cbob_status_ioctl
 };
 
 static int cbob_status_open(struct inode *inode, struct file *file)
@@ -52,6 +57,86 @@ static ssize_t cbob_status_read(struct file *file, char *buf, size_t count, loff
   return count;
 }
 
+// Firmware older than BATCH answers it with one zero word, which looks
+// just like a batch of one command without a reply, so check the version.
+static short cbob_status_version = 0;
+
+static int cbob_status_batch_supported(void)
+{
+  short data = 0;
+  int error;
+
+  if(cbob_status_version == 0) {
+    if((error = cbob_spi_message(CBOB_CMD_STATUS_READ, 0, 0, &data, 1)) < 0)
+      return error;
+    cbob_status_version = data;
+  }
+
+  return cbob_status_version >= CBOB_BATCH_VERSION ? 0 : -ENOSYS;
+}
+
+static int cbob_status_batch(struct cbob_batch *batch)
+{
+  short n, cmd, count;
+  int i, error;
+
+  if(batch->outcount < 1 || batch->outcount > CBOB_BATCH_SIZE)
+    return -EINVAL;
+
+  // walk the sub-commands so a bad vector never reaches the BoB
+  n = batch->outbuf[0];
+  for(i = 1;n > 0;n--) {
+    if(i + 2 > batch->outcount)
+      return -EINVAL;
+    cmd = batch->outbuf[i];
+    count = batch->outbuf[i+1];
+    if(cmd == CBOB_CMD_BATCH || count < 0 || i + 2 + count > batch->outcount)
+      return -EINVAL;
+    i += 2 + count;
+  }
+
+  if((error = cbob_status_batch_supported()) < 0)
+    return error;
+
+  // an empty batch only asks whether batches work
+  batch->incount = 0;
+  if(batch->outbuf[0] == 0)
+    return 0;
+
+  if((error = cbob_spi_message(CBOB_CMD_BATCH, batch->outbuf, batch->outcount, batch->inbuf, CBOB_BATCH_SIZE)) < 0)
+    return error;
+  batch->incount = error;
+
+  // a batch can write anything
+  cbob_sensors_invalidate();
+  cbob_state_invalidate(CBOB_STATE_MOTORS);
+
+  return 0;
+}
+
+static int cbob_status_ioctl(struct inode *inode, struct file *file, unsigned int ioctl_num, unsigned long ioctl_param)
+{
+  struct cbob_batch *batch;
+  int error;
+
+  switch(ioctl_num) {
+    case CBOB_STATUS_BATCH:
+      batch = kmalloc(sizeof(struct cbob_batch), GFP_KERNEL);
+      if(batch == 0)
+        return -ENOMEM;
+      if(copy_from_user(batch, (void*)ioctl_param, sizeof(struct cbob_batch))) {
+        kfree(batch);
+        return -EFAULT;
+      }
+      error = cbob_status_batch(batch);
+      if(error == 0)
+        copy_to_user((void*)ioctl_param, batch, sizeof(struct cbob_batch));
+      kfree(batch);
+      return error;
+  }
+  return -ENOTTY;
+}
+
 /* init and exit */
 int cbob_status_init(void)
 {
@@ -0,0 +1,218 @@
+#include "cbob_stream.h"
+#include "cbob_spi.h"
+#include "cbob_cmd.h"
+#include "cbob_event.h"
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <asm/semaphore.h>
+
+/* Analog streaming
+ *
+ * The BoB samples the streamed ports on a timer and raises
+ * CBOB_EVENT_STREAM while it holds samples.  The event work drains them
+ * here in CBOB_STREAM_READ_MAX blocks into a ring that holds about a
+ * second of all 8 ports at 2kHz, which CBOB_ANALOG_STREAM_READ empties.
+ * Like on the BoB, frames in the ring are consecutive: once something is
+ * lost nothing new goes in until the reader has emptied it.
+ */
+
+#define CBOB_STREAM_RING 16384
+
+static short *cbob_stream_ring;
+static int cbob_stream_head;
+static int cbob_stream_tail;
+static unsigned int cbob_stream_first;   // frame number at the tail
+static int cbob_stream_dropped;
+static int cbob_stream_overflow;
+static int cbob_stream_mask;
+static int cbob_stream_ports;
+static int cbob_stream_rate;
+static spinlock_t cbob_stream_lock = SPIN_LOCK_UNLOCKED;
+static struct semaphore cbob_stream_sem;
+
+static void cbob_stream_reset(int mask, int rate)
+{
+  int i;
+
+  spin_lock(&cbob_stream_lock);
+  cbob_stream_head = cbob_stream_tail = 0;
+  cbob_stream_first = 0;
+  cbob_stream_dropped = cbob_stream_overflow = 0;
+  cbob_stream_mask = mask;
+  cbob_stream_rate = rate;
+  cbob_stream_ports = 0;
+  for(i = 0;i < 8;i++)
+    if(mask & (1<<i))
+      cbob_stream_ports++;
+  spin_unlock(&cbob_stream_lock);
+}
+
+int cbob_stream_start(int mask, int *rate)
+{
+  short request[3], result = 0;
+  int error, was_on, on;
+
+  request[0] = 0;
+  request[1] = mask & 0xFF;
+  request[2] = *rate;
+
+  if(down_interruptible(&cbob_stream_sem))
+    return -EINTR;
+
+  was_on = on = cbob_stream_mask != 0;
+  if((error = cbob_spi_message(CBOB_CMD_STREAM_CONFIG, request, 3, &result, 1)) >= 0) {
+    // firmware without streaming replies with nothing
+    if(error < 1 && request[1]) {
+      error = -ENOSYS;
+      request[1] = 0;
+    }
+    else
+      error = 0;
+    cbob_stream_reset(request[1], result);
+    on = request[1] != 0;
+    *rate = result;
+  }
+
+  up(&cbob_stream_sem);
+
+  // not under the semaphore, changing the mask fetches events and that may drain
+  if(!was_on && on)
+    cbob_event_get(CBOB_EVENT_STREAM);
+  else if(was_on && !on)
+    cbob_event_put(CBOB_EVENT_STREAM);
+
+  return error;
+}
+
+// caller holds cbob_stream_sem, returns the samples fetched
+static int cbob_stream_fetch(void)
+{
+  short request = CBOB_STREAM_READ_MAX;
+  short data[4 + CBOB_STREAM_READ_MAX];
+  unsigned int first;
+  int error, count, used;
+
+  if(cbob_stream_ports == 0)
+    return 0;
+
+  if((error = cbob_spi_message(CBOB_CMD_STREAM_READ, &request, 1, data, 4 + CBOB_STREAM_READ_MAX)) < 0)
+    return error;
+  if(error < 4)
+    return 0;
+
+  count = data[0];
+  if(count < 0 || count > CBOB_STREAM_READ_MAX || error < 4 + count)
+    return 0;
+  memcpy(&first, &(data[2]), 4);
+
+  spin_lock(&cbob_stream_lock);
+  cbob_stream_dropped += data[1];
+  used = (cbob_stream_head - cbob_stream_tail + CBOB_STREAM_RING) % CBOB_STREAM_RING;
+  if(used == 0) {
+    cbob_stream_first = first;
+    cbob_stream_overflow = 0;
+  }
+  else if(first != cbob_stream_first + used/cbob_stream_ports)
+    cbob_stream_overflow = 1;
+
+  if(cbob_stream_overflow || used + count >= CBOB_STREAM_RING) {
+    cbob_stream_overflow = 1;
+    cbob_stream_dropped += count/cbob_stream_ports;
+  }
+  else {
+    for(used = 0;used < count;used++) {
+      cbob_stream_ring[cbob_stream_head] = data[4 + used];
+      cbob_stream_head = (cbob_stream_head + 1) % CBOB_STREAM_RING;
+    }
+  }
+  spin_unlock(&cbob_stream_lock);
+
+  return count;
+}
+
+static int cbob_stream_drain_locked(void)
+{
+  int count, full;
+
+  if(cbob_stream_ports == 0)
+    return 0;
+
+  // a full reply means there may be more
+  full = CBOB_STREAM_READ_MAX - CBOB_STREAM_READ_MAX % cbob_stream_ports;
+  while((count = cbob_stream_fetch()) == full);
+
+  return count < 0 ? count : 0;
+}
+
+void cbob_stream_drain(void)
+{
+  if(down_interruptible(&cbob_stream_sem))
+    return;
+  cbob_stream_drain_locked();
+  up(&cbob_stream_sem);
+}
+
+int cbob_stream_read(struct cbob_analog_stream *stream)
+{
+  int error, max, count = 0;
+
+  if(down_interruptible(&cbob_stream_sem))
+    return -EINTR;
+  error = cbob_stream_drain_locked();
+  up(&cbob_stream_sem);
+  if(error < 0)
+    return error;
+
+  spin_lock(&cbob_stream_lock);
+  max = stream->count;
+  if(max < 0 || max > CBOB_STREAM_MAX)
+    max = CBOB_STREAM_MAX;
+  if(cbob_stream_ports)
+    max -= max % cbob_stream_ports;
+
+  stream->first = cbob_stream_first;
+  while(count < max && cbob_stream_tail != cbob_stream_head) {
+    stream->samples[count++] = cbob_stream_ring[cbob_stream_tail];
+    cbob_stream_tail = (cbob_stream_tail + 1) % CBOB_STREAM_RING;
+  }
+  if(cbob_stream_ports)
+    cbob_stream_first += count/cbob_stream_ports;
+  stream->mask = cbob_stream_mask;
+  stream->rate = cbob_stream_rate;
+  stream->dropped = cbob_stream_dropped;
+  cbob_stream_dropped = 0;
+  spin_unlock(&cbob_stream_lock);
+
+  stream->count = count;
+  return 0;
+}
+
+/* init and exit */
+int cbob_stream_init(void)
+{
+  sema_init(&cbob_stream_sem, 1);
+
+  cbob_stream_ring = kmalloc(CBOB_STREAM_RING*sizeof(short), GFP_KERNEL);
+  if(cbob_stream_ring == 0) {
+    printk(KERN_ALERT "Failed to allocate the cbob_stream ring\n");
+    return -ENOMEM;
+  }
+  cbob_stream_reset(0, 0);
+
+  return 0;
+}
+
+void cbob_stream_exit(void)
+{
+  int rate = 0;
+
+  // nobody is left to drain it
+  if(cbob_stream_mask)
+    cbob_stream_start(0, &rate);
+
+  kfree(cbob_stream_ring);
+  cbob_stream_ring = 0;
+}
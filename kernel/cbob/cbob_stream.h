@@ -0,0 +1,17 @@
+#ifndef __CBC_STREAM_H__
+#define __CBC_STREAM_H__
+
+#include "cbob.h"
+
+int  cbob_stream_init(void);
+void cbob_stream_exit(void);
+
+// Streams the analog ports in mask, *rate is set to the rate the BoB used.
+// mask 0 stops the stream.
+int  cbob_stream_start(int mask, int *rate);
+// Moves the BoB's samples into the ring, called on CBOB_EVENT_STREAM
+void cbob_stream_drain(void);
+// Drains and then copies up to stream->count samples out of the ring
+int  cbob_stream_read(struct cbob_analog_stream *stream);
+
+#endif
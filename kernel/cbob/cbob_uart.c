@@ -3,19 +3,37 @@
 #include "cbob_cmd.h"
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/fs.h>
 #include <linux/types.h>
 #include <asm/semaphore.h>
 #include <asm/uaccess.h>
 #include <linux/delay.h>
-#include <asm/arch/imx-regs.h>
-#include <asm/arch/irqs.h>
-#include <asm/arch/hardware.h>
-#include <linux/interrupt.h>
 #include <linux/tty.h>
 #include <linux/tty_driver.h>
 #include <linux/tty_flip.h>
 #include <linux/workqueue.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+
+/* Bridge
+ *
+ * Writes land in a ring per port and the uart workqueue sends them to the
+ * BoB CBOB_UART_WRITE_MAX bytes at a time, so write never waits on SPI.
+ * The BoB keeps its own ring in front of the serial DMA.  When it takes
+ * less than it was offered the rest stays here until the BoB raises
+ * CBOB_EVENT_UART below its low watermark, or uart_retry_ms passes for
+ * firmware without one.  Received data is drained in as many
+ * CBOB_UART_READ_MAX reads as the tty has room for.
+ */
+
+static int uart_retry_ms = 20;
+module_param(uart_retry_ms, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(uart_retry_ms, "Retry period in ms for writes the BoB had no room for");
+
+#define CBOB_UART_RING 4096
+// reads per port per fetch, the BoB signals again if there's more
+#define CBOB_UART_FETCH_MAX 8
 
 /* File Ops */
 
@@ -23,25 +41,36 @@ struct cbob_uart {
   struct tty_struct *tty;
   int open_count;
   struct semaphore sem;
+  spinlock_t lock;             // the tx ring, write can't sleep
+  int tx_head;
+  int tx_tail;
+  unsigned char tx_ring[CBOB_UART_RING];
 };
 
 static int  cbob_uart_open(struct tty_struct *tty, struct file *filp);
 static void cbob_uart_close(struct tty_struct *tty, struct file *filp);
 static int  cbob_uart_write(struct tty_struct *tty, const unsigned char *buf, int count);
 static int  cbob_uart_write_room(struct tty_struct *tty);
+static int  cbob_uart_chars_in_buffer(struct tty_struct *tty);
+static void cbob_uart_flush_buffer(struct tty_struct *tty);
+static void cbob_uart_set_termios(struct tty_struct *tty, struct termios *old);
 static void do_close(struct cbob_uart *uart);
 
-irqreturn_t cbob_uart_handler(int irq, void *data, struct pt_regs *regs);
 static void cbob_uart_fetch_data(void *arg);
+static void cbob_uart_send_data(void *arg);
 
 DECLARE_WORK(cbob_uart_fetch, cbob_uart_fetch_data, 0);
+DECLARE_WORK(cbob_uart_send, cbob_uart_send_data, 0);
 
 static struct tty_driver *cbob_uart_tty_driver;
 static struct tty_operations cbob_uart_ops = {
-  open:       cbob_uart_open,
-  close:      cbob_uart_close,
-  write:      cbob_uart_write,
-  write_room: cbob_uart_write_room
+  open:            cbob_uart_open,
+  close:           cbob_uart_close,
+  write:           cbob_uart_write,
+  write_room:      cbob_uart_write_room,
+  chars_in_buffer: cbob_uart_chars_in_buffer,
+  flush_buffer:    cbob_uart_flush_buffer,
+  set_termios:     cbob_uart_set_termios
 };
 
 struct cbob_uart *cbob_uarts[CBOB_UART_MINORS];
@@ -63,7 +92,10 @@ static int cbob_uart_open(struct tty_struct *tty, struct file *filp)
   	if(!uart)
   		return -ENOMEM;
   	init_MUTEX(&uart->sem);
+  	spin_lock_init(&uart->lock);
   	uart->open_count = 0;
+  	uart->tx_head = 0;
+  	uart->tx_tail = 0;
   	
   	cbob_uarts[index] = uart;
   }
@@ -107,75 +139,203 @@ static void do_close(struct cbob_uart *uart)
   up(&uart->sem);
 }
 
-static ssize_t cbob_uart_write(struct tty_struct *tty, const unsigned char *buf, int count)
+#define CBOB_UART_USED(uart) (((uart)->tx_head - (uart)->tx_tail) & (CBOB_UART_RING-1))
+#define CBOB_UART_FREE(uart) (CBOB_UART_RING - 1 - CBOB_UART_USED(uart))
+
+static int cbob_uart_write(struct tty_struct *tty, const unsigned char *buf, int count)
 {
 	struct cbob_uart *uart = tty->driver_data;
-	int index = tty->index;
-	short data[35], written;
+	unsigned long flags;
+	int first;
 	
 	if(!uart)
 		return -ENODEV;
 	
-	if(down_interruptible(&uart->sem))
-		return -EINTR;
-	
-	if(!uart->open_count) {
-		up(&uart->sem);
+	if(!uart->open_count)
 		return -EINVAL;
-	}
-	
-	if(count > 64) count = 64;
 	
-	memcpy(&(data[2]), buf, count);
-	data[0] = index;
-	data[1] = count;
+	spin_lock_irqsave(&uart->lock, flags);
+	if(count > CBOB_UART_FREE(uart))
+		count = CBOB_UART_FREE(uart);
+	first = CBOB_UART_RING - uart->tx_head;
+	if(first > count)
+		first = count;
+	memcpy(&(uart->tx_ring[uart->tx_head]), buf, first);
+	memcpy(uart->tx_ring, buf + first, count - first);
+	uart->tx_head = (uart->tx_head + count) & (CBOB_UART_RING-1);
+	spin_unlock_irqrestore(&uart->lock, flags);
 	
-	cbob_spi_message(CBOB_CMD_UART_WRITE, data, (count>>1)+3, &written, 1);
+	if(count && cbob_uart_workqueue)
+		queue_work(cbob_uart_workqueue, &cbob_uart_send);
 	
-	up(&uart->sem);
+	return count;
+}
+
+static int cbob_uart_write_room(struct tty_struct *tty)
+{
+	struct cbob_uart *uart = tty->driver_data;
 	
-	return written;
+	return uart ? CBOB_UART_FREE(uart) : 0;
 }
 
-static int  cbob_uart_write_room(struct tty_struct *tty)
+static int cbob_uart_chars_in_buffer(struct tty_struct *tty)
 {
-	return 64;
+	struct cbob_uart *uart = tty->driver_data;
+	
+	return uart ? CBOB_UART_USED(uart) : 0;
 }
 
-irqreturn_t cbob_uart_handler(int irq, void *data, struct pt_regs *regs)
+// drops what hasn't gone to the BoB yet
+static void cbob_uart_flush_buffer(struct tty_struct *tty)
 {
+	struct cbob_uart *uart = tty->driver_data;
+	unsigned long flags;
+	
+	if(!uart)
+		return;
 	
-	queue_work(cbob_uart_workqueue, &cbob_uart_fetch);
+	spin_lock_irqsave(&uart->lock, flags);
+	uart->tx_tail = uart->tx_head;
+	spin_unlock_irqrestore(&uart->lock, flags);
 	
-  return IRQ_HANDLED;
+	tty_wakeup(tty);
 }
 
-void cbob_uart_fetch_data(void *arg) {
-	struct tty_struct *tty;
-	short request[2];
-	short data[33];
+// the serial port runs at whatever baud rate the tty is set to
+static void cbob_uart_set_termios(struct tty_struct *tty, struct termios *old)
+{
+	short request[4];
+	int baud;
+	
+	if(tty->index != 1)
+		return;
+	if(old && (tty->termios->c_cflag & CBAUD) == (old->c_cflag & CBAUD))
+		return;
+	
+	baud = tty_get_baud_rate(tty);
+	if(baud <= 0)
+		return;
 	
-
 	request[0] = 0;
-	request[1] = 64;	
-	if(cbob_spi_message(CBOB_CMD_UART_READ, request, 2, data, 33) < 0) return;
+	request[1] = 1;
+	memcpy(&(request[2]), &baud, sizeof(int));
+	cbob_spi_message(CBOB_CMD_UART_CONFIG, request, 4, 0, 0);
+}
+
+// called from cbob_event when the BoB signals UART data
+void cbob_uart_signal(void)
+{
+	if(cbob_uart_workqueue)
+		queue_work(cbob_uart_workqueue, &cbob_uart_fetch);
+}
+
+// Sends the ring to the BoB until it is empty or the BoB is full, returns
+// 1 in the second case
+static int cbob_uart_send_port(int index)
+{
+	struct cbob_uart *uart = cbob_uarts[index];
+	unsigned long flags;
+	short data[2 + CBOB_UART_WRITE_MAX/2], written;
+	int count, first, tail;
+	
+	if(!uart)
+		return 0;
 	
-	if(data[0] && cbob_uarts[0] && cbob_uarts[0]->open_count) {
-		tty = cbob_uarts[0]->tty;
-		tty_insert_flip_string(tty, (void*)&(data[1]), data[0]);
-		tty_flip_buffer_push(tty);
+	for(;;) {
+		spin_lock_irqsave(&uart->lock, flags);
+		tail = uart->tx_tail;
+		count = CBOB_UART_USED(uart);
+		if(count > CBOB_UART_WRITE_MAX)
+			count = CBOB_UART_WRITE_MAX;
+		first = CBOB_UART_RING - tail;
+		if(first > count)
+			first = count;
+		memcpy(&(data[2]), &(uart->tx_ring[tail]), first);
+		memcpy(((unsigned char*)&(data[2])) + first, uart->tx_ring, count - first);
+		spin_unlock_irqrestore(&uart->lock, flags);
+		
+		if(count == 0)
+			return 0;
+		
+		data[0] = index;
+		data[1] = count;
+		written = 0;
+		if(cbob_spi_message(CBOB_CMD_UART_WRITE, data, ((count+1)>>1)+2, &written, 1) < 0)
+			return 1;
+		if(written < 0 || written > count)
+			written = 0;
+		
+		spin_lock_irqsave(&uart->lock, flags);
+		// unless flush_buffer emptied the ring meanwhile
+		if(uart->tx_tail == tail)
+			uart->tx_tail = (tail + written) & (CBOB_UART_RING-1);
+		spin_unlock_irqrestore(&uart->lock, flags);
+		
+		if(written && uart->open_count)
+			tty_wakeup(uart->tty);
+		if(written < count)
+			return 1;
 	}
+}
+
+static void cbob_uart_send_data(void *arg)
+{
+	int i, full = 0;
 	
-	request[0] = 1;
-	if(cbob_spi_message(CBOB_CMD_UART_READ, request, 2, data, 33) < 0) return;
+	for(i = 0;i < CBOB_UART_MINORS;i++)
+		full |= cbob_uart_send_port(i);
 	
-	if(data[0] && cbob_uarts[1] && cbob_uarts[1]->open_count) {
-		tty = cbob_uarts[1]->tty;
-		tty_insert_flip_string(tty, (void*)&(data[1]), data[0]);
-		tty_flip_buffer_push(tty);
+	// the BoB's event normally gets here first
+	if(full && uart_retry_ms > 0)
+		queue_delayed_work(cbob_uart_workqueue, &cbob_uart_send, msecs_to_jiffies(uart_retry_ms));
+}
+
+static void cbob_uart_fetch_port(int index)
+{
+	struct tty_struct *tty = 0;
+	short request[2];
+	short data[2 + CBOB_UART_READ_MAX/2];
+	int i, room;
+	
+	for(i = 0;i < CBOB_UART_FETCH_MAX;i++) {
+		room = CBOB_UART_READ_MAX;
+		// nobody to hand it to, read it anyway so it doesn't pile up
+		if(cbob_uarts[index] && cbob_uarts[index]->open_count) {
+			tty = cbob_uarts[index]->tty;
+			room = tty_buffer_request_room(tty, CBOB_UART_READ_MAX);
+			if(room <= 0)
+				break;
+		}
+		else
+			tty = 0;
+		
+		request[0] = index;
+		request[1] = room;
+		if(cbob_spi_message(CBOB_CMD_UART_READ, request, 2, data, (room>>1)+2) < 0)
+			break;
+		if(data[0] <= 0 || data[0] > room)
+			break;
+		
+		if(tty) {
+			tty_insert_flip_string(tty, (void*)&(data[1]), data[0]);
+			tty_flip_buffer_push(tty);
+		}
+		if(data[0] < room)
+			break;
 	}
 }
 
+void cbob_uart_fetch_data(void *arg)
+{
+	int i;
+	
+	for(i = 0;i < CBOB_UART_MINORS;i++)
+		cbob_uart_fetch_port(i);
+	
+	// the event may also mean the BoB has room again
+	cbob_uart_send_data(0);
+}
+
 /* init and exit */
 int cbob_uart_init(void)
 {
@@ -196,7 +356,8 @@ int cbob_uart_init(void)
   cbob_uart_tty_driver->init_termios = tty_std_termios;
   cbob_uart_tty_driver->init_termios.c_iflag = IGNBRK | IGNPAR;
   cbob_uart_tty_driver->init_termios.c_oflag = 0;
-  cbob_uart_tty_driver->init_termios.c_cflag = B115200 | CS8 | CREAD | CLOCAL;
+  // the BoB starts the serial port at the Create's 57600
+  cbob_uart_tty_driver->init_termios.c_cflag = B57600 | CS8 | CREAD | CLOCAL;
   cbob_uart_tty_driver->init_termios.c_lflag = 0;
   cbob_uart_tty_driver->init_termios.c_cc[VMIN] = 1;
   cbob_uart_tty_driver->init_termios.c_cc[VTIME] = 0;
@@ -215,24 +376,27 @@ int cbob_uart_init(void)
   }
  
  	cbob_uart_workqueue = create_singlethread_workqueue("CBOB UART");
- 
- 	imx_gpio_mode(GPIO_PORTD | 27 | GPIO_IN | GPIO_GPIO | GPIO_IRQ_RISING);
-  request_irq(IRQ_GPIOD(27), cbob_uart_handler, 0, "CBOB", 0);
   
   return error;
 }
 
 void cbob_uart_exit(void)
 {
+	struct workqueue_struct *workqueue = cbob_uart_workqueue;
 	struct cbob_uart *uart;
 	int i;
 	
-	free_irq(IRQ_GPIOD(27), 0);
-	
 	for(i = 0;i < CBOB_UART_MINORS;i++)
 		tty_unregister_device(cbob_uart_tty_driver, i);
 	tty_unregister_driver(cbob_uart_tty_driver);
 	
+	// the work uses the ports, stop it before they go
+	cbob_uart_workqueue = 0;
+	uart_retry_ms = 0;
+	cancel_delayed_work(&cbob_uart_send);
+	flush_workqueue(workqueue);
+	destroy_workqueue(workqueue);
+	
 	for(i = 0;i < CBOB_UART_MINORS;i++) {
 		uart = cbob_uarts[i];
 		if(uart) {
@@ -242,8 +406,5 @@ void cbob_uart_exit(void)
 			cbob_uarts[i] = NULL;
 		}
 	}
-	
-	flush_workqueue(cbob_uart_workqueue);
-	destroy_workqueue(cbob_uart_workqueue);
 }
 
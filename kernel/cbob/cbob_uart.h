@@ -8,4 +8,7 @@
 int  cbob_uart_init(void);
 void cbob_uart_exit(void);
 
+// The BoB has UART data waiting, fetch it from the uart workqueue
+void cbob_uart_signal(void);
+
 #endif
@@ -1,12 +1,53 @@
 #ifndef __SENSOR_DATA_H__
 #define __SENSOR_DATA_H__
 
+// Same layout as the CBOB_CMD_SENSORS_READ reply
 struct sensor_data {
-  short digitals;
+  short digitals;   // bits 0-7 digital ports, bit 8 black button
   short analog[8];
+  short battery;
   short accel_x;
   short accel_y;
   short accel_z;
+  short pullups;
+};
+
+#define SENSOR_DATA_COUNT (sizeof(struct sensor_data)/sizeof(short))
+
+// Same layout as the CBOB_CMD_STATE_READ reply.  version and count come
+// straight from the BoB, check them against CBOB_STATE_READ_VERSION and
+// CBOB_ROBOT_STATE_COUNT before trusting the rest.
+struct cbob_robot_state {
+  short version;
+  short count;
+  unsigned int stamp;        // BoB clock in ms
+  struct sensor_data sensors;
+  int motor_counter[4];
+  short motor_speed[4];      // ticks per PID period
+  short pwm[4];
+  short servo[4];
+  short motors_moving;       // bit n set while motor n moves to a position
+  short pad;
+};
+
+#define CBOB_ROBOT_STATE_COUNT (sizeof(struct cbob_robot_state)/sizeof(short))
+
+// bits in cbob_state.valid
+#define CBOB_STATE_SENSORS 1
+#define CBOB_STATE_MOTORS  2
+
+// Contents of the read-only /dev/cbc/state page.  seq is odd while the
+// driver is updating; readers copy the page and retry if seq was odd or
+// changed.  Parts missing from valid were invalidated by a write and have
+// not been refreshed yet.
+struct cbob_state {
+  volatile unsigned int seq;
+  unsigned int valid;
+  unsigned int sensors_stamp;   // jiffies
+  unsigned int motors_stamp;
+  struct sensor_data sensors;
+  short pwm[4];
+  int motor_counter[4];
 };
 
 #endif
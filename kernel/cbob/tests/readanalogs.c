@@ -0,0 +1,50 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#include "../cbob.h"
+
+int main(int argc, char **argv)
+{
+	int fd[8], i, j, loops, live = 0;
+	char devname[32];
+	short value[8];
+	struct timeval start, end;
+	long usecs;
+	
+	if(argc < 2) {
+		printf("Usage: %s <loops> [live]\n", argv[0]);
+		return 1;
+	}
+
+	loops = atoi(argv[1]);
+	if(argc > 2) live = atoi(argv[2]);
+
+	for(i = 0;i < 8;i++) {
+		sprintf(devname, "/dev/cbc/analog%d", i);
+		fd[i] = open(devname, O_RDONLY);
+		if(fd[i] < 0) {
+			printf("Error opening analog %d\n", i);
+			return 1;
+		}
+		ioctl(fd[i], CBOB_ANALOG_SET_LIVE, &live);
+	}
+
+	gettimeofday(&start, 0);
+	for(j = 0;j < loops;j++) {
+		for(i = 0;i < 8;i++)
+			read(fd[i], &value[i], 2);
+	}
+	gettimeofday(&end, 0);
+
+	usecs = (end.tv_sec - start.tv_sec)*1000000 + (end.tv_usec - start.tv_usec);
+	printf("%d x 8 %s analog reads: %ld us per loop\n", loops, live ? "live" : "cached", usecs/(loops > 0 ? loops : 1));
+	for(i = 0;i < 8;i++) printf("%hd ", value[i]);
+	printf("\n");
+
+	for(i = 0;i < 8;i++) close(fd[i]);
+	return 0;
+}
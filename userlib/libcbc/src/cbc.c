@@ -30,17 +30,28 @@
 
 #define PENDING(func) printf("Function %s is not yet implemented\n", func)
 
+// longest a sound or UI call waits on cbcui, in ms
+#define UI_COMMAND_TIMEOUT_MS 100
+
 #include "cbc.h"
 #include <assert.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <shared_mem.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include "../../../cbcui/src/UIData.h"
 
 #include "../../../kernel/cbob/cbob.h"
+#include "../../../kernel/cbob/sensor_data.h"
+#include "../../../kernel/cbob/cbob_cmd.h"
 
 int __pid_defaults[6]={30,0,-30,70,1,51};
 int __position_threshold=2000;
@@ -60,9 +71,19 @@ static int g_pid[4];
 static int g_pwm[4];
 static int g_servo[4];
 static int g_accX, g_accY, g_accZ;
+static int g_state_fd = -1;
+static volatile struct cbob_state *g_state = 0;
+static int g_state_tried = 0;
+static pthread_mutex_t g_state_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int g_status = -1;
+static int g_batching = 0;
+static int g_batch_supported = -1; // -1 until the first cbc_batch_begin asks
+static struct cbob_batch g_batch;
 
 shared_mem *g_uidata_sm = 0;
 UIData *g_uidata = 0;
+static int g_ui_socket = -1;
+static pthread_mutex_t g_ui_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 void libcbc_init()
 {
@@ -71,6 +92,9 @@ void libcbc_init()
 	
 	if(g_cbc_initted) return;
 	g_cbc_initted = 1;
+
+	// scheduling and memory locking from cbcui's launch profile
+	__realtime_init();
 	
         g_button = open("/dev/cbc/button", O_RDONLY);
 	
@@ -96,9 +120,13 @@ void libcbc_init()
 	g_accY = open("/dev/cbc/accelY", O_RDONLY);
 	g_accZ = open("/dev/cbc/accelZ", O_RDONLY);
 
+	g_status = open("/dev/cbc/status", O_RDONLY);
+
 	g_uidata_sm = shared_mem_create("/tmp/cbc_uidata", sizeof(UIData));
 	assert(g_uidata_sm);
 	g_uidata = (UIData *)shared_mem_ptr(g_uidata_sm);
+	// our command seqs start over
+	g_uidata->ack = 0;
 	
 	atexit(libcbc_exit);
 }
@@ -123,6 +151,115 @@ void libcbc_exit()
     close(g_accX);
     close(g_accY);
     close(g_accZ);
+
+    if(g_batching) cbc_batch_commit();
+    close(g_status);
+
+    if(g_ui_socket >= 0) close(g_ui_socket);
+    g_ui_socket = -1;
+
+    if(g_state) munmap((void*)g_state, sizeof(struct cbob_state));
+    g_state = 0;
+    if(g_state_fd >= 0) close(g_state_fd);
+    g_state_fd = -1;
+}
+
+// The driver refreshes the sensor state page over SPI while it is open,
+// so it is only mapped once the program first reads a sensor.  The
+// accessors fall back to read() without it.
+static void cbc_state_open()
+{
+	pthread_mutex_lock(&g_state_mutex);
+	if(!g_state_tried) {
+		g_state_tried = 1;
+		g_state_fd = open("/dev/cbc/state", O_RDONLY);
+		if(g_state_fd >= 0) {
+			void *page = mmap(0, sizeof(struct cbob_state), PROT_READ, MAP_SHARED, g_state_fd, 0);
+			if(page != MAP_FAILED)
+				g_state = (volatile struct cbob_state *)page;
+		}
+	}
+	pthread_mutex_unlock(&g_state_mutex);
+}
+
+// Copies the state page without a syscall.  Returns 0 if the page isn't
+// mapped or the requested parts were invalidated by a recent write or, for
+// the motors, by getting older than the driver's state_max_age_ms, in which
+// case the caller reads the device instead.
+static int cbc_state(struct cbob_state *state, unsigned int parts)
+{
+	unsigned int seq;
+
+	if(!g_state_tried) cbc_state_open();
+	if(!g_state) return 0;
+
+	do {
+		seq = g_state->seq;
+		__asm__ __volatile__("" ::: "memory");
+		memcpy(state, (void*)g_state, sizeof(struct cbob_state));
+		__asm__ __volatile__("" ::: "memory");
+	} while((seq & 1) || seq != g_state->seq);
+
+	return (state->valid & parts) == parts;
+}
+
+/////////////////////////////////////////////////////////////
+// Command batching
+
+static int cbc_batch_flush()
+{
+	int error = 0;
+	
+	if(g_batch.outbuf[0] > 0)
+		error = ioctl(g_status, CBOB_STATUS_BATCH, &g_batch);
+	
+	g_batch.outcount = 1;
+	g_batch.outbuf[0] = 0;
+	
+	return error;
+}
+
+void cbc_batch_begin()
+{
+	if(g_batching) return;
+	
+	// firmware without BATCH, the calls write to their devices one by one
+	if(g_batch_supported < 0) {
+		g_batch.outcount = 1;
+		g_batch.outbuf[0] = 0;
+		g_batch_supported = (ioctl(g_status, CBOB_STATUS_BATCH, &g_batch) == 0);
+	}
+	if(!g_batch_supported) return;
+	
+	g_batching = 1;
+	g_batch.outcount = 1;
+	g_batch.outbuf[0] = 0;
+}
+
+int cbc_batch_commit()
+{
+	if(!g_batching) return 0;
+	
+	g_batching = 0;
+	return cbc_batch_flush();
+}
+
+// Queues a command if a batch is open.  Returns 0 if the caller has to
+// send it itself.
+static int cbc_batch_add(short cmd, short *data, short count)
+{
+	if(!g_batching) return 0;
+	
+	if(g_batch.outcount + 2 + count > CBOB_BATCH_SIZE)
+		cbc_batch_flush();
+	
+	g_batch.outbuf[g_batch.outcount++] = cmd;
+	g_batch.outbuf[g_batch.outcount++] = count;
+	memcpy(&g_batch.outbuf[g_batch.outcount], data, count*sizeof(short));
+	g_batch.outcount += count;
+	g_batch.outbuf[0]++;
+	
+	return 1;
 }
 
 /////////////////////////////////////////////////////////////
@@ -137,39 +274,77 @@ void tone(int frequency, int duration)
 //        printf("\a");
 }
 
+// Sends a command to cbcui's console page and returns its seq, or -1 if
+// nobody is listening.  The send blocks for at most UI_COMMAND_TIMEOUT_MS
+// when the UI is behind.
+static int cbc_ui_command(int command, const char *filename, int recordTime)
+{
+	static int seq = 0;
+	struct sockaddr_un addr;
+	struct timeval timeout;
+	UICommand cmd;
+	int error = 0;
+
+	// threads share the socket, and cbcui acks the seqs in the order sent
+	pthread_mutex_lock(&g_ui_mutex);
+	if(g_ui_socket < 0) {
+		if((g_ui_socket = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+			pthread_mutex_unlock(&g_ui_mutex);
+			return -1;
+		}
+		timeout.tv_sec = 0;
+		timeout.tv_usec = UI_COMMAND_TIMEOUT_MS * 1000;
+		setsockopt(g_ui_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	}
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.command = command;
+	cmd.seq = ++seq;
+	cmd.recordTime = recordTime;
+	if(filename)
+		strncpy(cmd.filename, filename, sizeof(cmd.filename) - 1);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, UI_COMMAND_SOCKET);
+	if(sendto(g_ui_socket, &cmd, sizeof(cmd), 0, (struct sockaddr *)&addr, sizeof(addr)) != sizeof(cmd))
+		error = -1;
+	pthread_mutex_unlock(&g_ui_mutex);
+
+	return error ? error : cmd.seq;
+}
+
 void beep()
 {
-        g_uidata->state = 1;
-	printf("\a");
+	cbc_ui_command(UI_BEEP, 0, 0);
 }
 
 void play_sound(const char *filename)
 {
-        g_uidata->state = 2;
-        strcpy(g_uidata->filename,filename);
-        printf("\a");
+	cbc_ui_command(UI_PLAY_SOUND, filename, 0);
 }
 
 int playing_sound()
 {
-    g_uidata->state = 3;
-    printf("\a");
-    if(g_uidata->playing < 2) return 0;
-    else return 1;
+	int seq, i;
+
+	// wait for the UI to refresh playing
+	if((seq = cbc_ui_command(UI_PLAYING_SOUND, 0, 0)) > 0) {
+		for(i = 0;i < UI_COMMAND_TIMEOUT_MS && g_uidata->ack - seq < 0;i++)
+			msleep(1);
+	}
+	if(g_uidata->playing < 2) return 0;
+	else return 1;
 }
 
 void stop_sound()
 {
-        g_uidata->state = 4;
-        printf("\a");
+	cbc_ui_command(UI_STOP_SOUND, 0, 0);
 }
 
 void start_recording(const char *filename, int length)
 {
-        g_uidata->state = 5;
-        g_uidata->recordTime = length;
-        strcpy(g_uidata->filename,filename);
-        printf("\a");
+	cbc_ui_command(UI_START_RECORDING, filename, length);
 }
 
 int recording_sound()
@@ -179,8 +354,7 @@ int recording_sound()
 
 void stop_recording()
 {
-        g_uidata->state = 6;
-        printf("\a");
+	cbc_ui_command(UI_STOP_RECORDING, 0, 0);
 }
 
 /////////////////////////////////////////////////////////////
@@ -190,8 +364,11 @@ void stop_recording()
 int digital(int port)
 {
 	short data;
+	struct cbob_state state;
   
 	if(port >= 8 && port <= 15) {
+            if(cbc_state(&state, CBOB_STATE_SENSORS))
+                return (state.sensors.digitals >> (port-8)) & 1;
             read(g_digital[port-8], &data, 2);
                 return data;
 	}
@@ -202,12 +379,86 @@ int digital(int port)
 }
 
 
+// returns 0 once port reads value, -1 if the port is out of bounds
+int wait_for_digital(int port, int value)
+{
+	if(port < 8 || port > 15) {
+		printf("Digital must be between 8 and 15\n");
+		return -1;
+	}
+	
+	value = value ? 1 : 0;
+	// sleeps in the driver until the BoB signals a digital change
+	if(ioctl(g_digital[port-8], CBOB_DIGITAL_WAIT, &value) == 0)
+		return 0;
+	
+	while(digital(port) != value) msleep(10);
+	return 0;
+}
+
+int set_digital_capture(int port, int edges)
+{
+	if(port < 8 || port > 15) {
+		printf("Digital must be between 8 and 15\n");
+		return -1;
+	}
+	
+	return ioctl(g_digital[port-8], CBOB_DIGITAL_SET_CAPTURE, &edges);
+}
+
+int digital_count(int port)
+{
+	int count = 0;
+	
+	if(port < 8 || port > 15) {
+		printf("Digital must be between 8 and 15\n");
+		return -1;
+	}
+	
+	ioctl(g_digital[port-8], CBOB_DIGITAL_GET_COUNT, &count);
+	
+	return count;
+}
+
+void clear_digital_count(int port)
+{
+	if(port < 8 || port > 15) return;
+	
+	ioctl(g_digital[port-8], CBOB_DIGITAL_CLEAR_COUNT);
+}
+
+int read_digital_edges(unsigned int *stamps, int *ports, int *levels, int max)
+{
+	struct cbob_edges edges;
+	int i, n = 0;
+	
+	while(n < max) {
+		edges.count = max - n;
+		if(ioctl(g_digital[0], CBOB_DIGITAL_READ_EDGES, &edges) < 0)
+			break;
+		for(i = 0;i < edges.count;i++, n++) {
+			stamps[n] = edges.edges[i].stamp;
+			ports[n] = edges.edges[i].port + 8;
+			levels[n] = edges.edges[i].level;
+		}
+		if(edges.count < CBOB_EDGES_MAX)
+			break;
+	}
+	
+	return n;
+}
+
 void set_digital_output_value(int port, int value)
 {
     char state = value;
+    short data[2];
 
     if(port < 8 || port > 15) return;
 
+    data[0] = port-8;
+    data[1] = state;
+    if(cbc_batch_add(CBOB_CMD_DIGITAL_WRITE, data, 2)) return;
+
     write(g_digital[port-8], &state, 1);
 }
 
@@ -228,8 +479,11 @@ int get_digital_port_direction()
 int analog10(int port)
 {
 	unsigned short data;
+	struct cbob_state state;
 	
 	if(port >= 0 && port <= 7) {
+		if(cbc_state(&state, CBOB_STATE_SENSORS))
+			return (int)(unsigned short)state.sensors.analog[port];
 		read(g_analog[port], &data, 2);
 		return (int)data;
 	}
@@ -239,6 +493,63 @@ int analog10(int port)
 	}
 }
 
+int start_analog_stream(int mask, int rate)
+{
+	int config[2];
+	
+	config[0] = mask & 0xff;
+	config[1] = rate;
+	if(ioctl(g_analog[0], CBOB_ANALOG_STREAM_START, config) < 0)
+		return -1;
+	
+	return config[1];
+}
+
+void stop_analog_stream()
+{
+	ioctl(g_analog[0], CBOB_ANALOG_STREAM_STOP);
+}
+
+// One read, so the samples are always consecutive: sample time first+n
+// came n/rate seconds after first.  A gap shows as first jumping ahead.
+int read_analog_stream(short *samples, int max, unsigned int *first)
+{
+	struct cbob_analog_stream stream;
+	
+	if(max <= 0)
+		return 0;
+	stream.count = max < CBOB_STREAM_MAX ? max : CBOB_STREAM_MAX;
+	if(ioctl(g_analog[0], CBOB_ANALOG_STREAM_READ, &stream) < 0)
+		return -1;
+	
+	memcpy(samples, stream.samples, stream.count*sizeof(short));
+	if(first) *first = stream.first;
+	
+	return stream.count;
+}
+
+// type and size go to the BoB, which filters every reading
+static int cbc_set_filter(int fd, unsigned long request, int type, int size)
+{
+	int config[2];
+	
+	config[0] = type;
+	config[1] = size;
+	if(ioctl(fd, request, config) < 0)
+		return -1;
+	
+	return config[1];
+}
+
+int set_analog_filter(int port, int type, int size)
+{
+	if(port < 0 || port > 7) {
+		printf("Analog sensors must be between 0 and 7\n");
+		return -1;
+	}
+	return cbc_set_filter(g_analog[port], CBOB_ANALOG_SET_FILTER, type, size);
+}
+
 // 8-bit analog for HB compatibility
 int analog(int port)
 {
@@ -274,6 +585,10 @@ void set_each_analog_state(int a0, int a1, int a2, int a3, int a4, int a5, int a
 int accel_x() 
 {
 	short data;
+	struct cbob_state state;
+	
+	if(cbc_state(&state, CBOB_STATE_SENSORS))
+		return state.sensors.accel_x;
 	
 	read(g_accX, &data, 2);
 	
@@ -283,6 +598,10 @@ int accel_x()
 int accel_y() 
 {
 	short data;
+	struct cbob_state state;
+	
+	if(cbc_state(&state, CBOB_STATE_SENSORS))
+		return state.sensors.accel_y;
 	
 	read(g_accY, &data, 2);
 	
@@ -292,12 +611,27 @@ int accel_y()
 int accel_z() 
 {
 	short data;
+	struct cbob_state state;
+	
+	if(cbc_state(&state, CBOB_STATE_SENSORS))
+		return state.sensors.accel_z;
 	
         read(g_accZ, &data, 2);
 	
 	return data;
 }
 
+int set_accel_filter(int axis, int type, int size)
+{
+	int fd[3] = {g_accX, g_accY, g_accZ};
+	
+	if(axis < 0 || axis > 2) {
+		printf("Accelerometer axis must be between 0 and 2\n");
+		return -1;
+	}
+	return cbc_set_filter(fd[axis], CBOB_ACCEL_SET_FILTER, type, size);
+}
+
 
 //////////////////////////
 // Sonar function: returns distance in mm
@@ -328,13 +662,21 @@ int sonar_inches(int port)
 float power_level()
 {
 	short data;
-	float volts;
+	struct cbob_state state;
 	
-	read(g_battery, &data, 2);
+	if(cbc_state(&state, CBOB_STATE_SENSORS))
+		data = state.sensors.battery;
+	else
+		read(g_battery, &data, 2);
 	
 	return ((float)data)/1000.0;
 }
 
+int set_battery_filter(int type, int size)
+{
+	return cbc_set_filter(g_battery, CBOB_ANALOG_SET_FILTER, type, size);
+}
+
 
 
 /////////////////////////////////////////////////////////////
@@ -360,6 +702,7 @@ void disable_servos()
 int set_servo_position(int servo, int pos)
 {
 	short position = pos;
+	short data[2];
 	
 	if(servo < 0 || servo > 3) {
 		printf("Servo must be 0..3\n");
@@ -371,6 +714,10 @@ int set_servo_position(int servo, int pos)
 		return -1;
 	}
 	
+	data[0] = servo;
+	data[1] = position;
+	if(cbc_batch_add(CBOB_CMD_SERVO_WRITE, data, 2)) return 0;
+	
 	write(g_servo[servo], &position, 2);
 	
 	return 0;
@@ -405,12 +752,16 @@ int get_servo_position(int servo)
 int get_motor_position_counter(int motor)
 {
 	int counter;
+	struct cbob_state state;
 	
 	if(motor < 0 || motor > 3) {
 		printf("Motor must be 0..3\n");
 		return 0;
 	}
 	
+	if(cbc_state(&state, CBOB_STATE_MOTORS))
+		return state.motor_counter[motor];
+	
 	read(g_pid[motor], &counter, 4);
 	
 	return counter;
@@ -419,11 +770,17 @@ int get_motor_position_counter(int motor)
 
 int clear_motor_position_counter(int motor)
 {
+	short data[2];
+	
 	if(motor < 0 || motor > 3) {
 		printf("Motor must be 0..3\n");
 		return -1;
 	}
 	
+	data[0] = 0;
+	data[1] = motor;
+	if(cbc_batch_add(CBOB_CMD_PID_CONFIG, data, 2)) return 0;
+	
 	return ioctl(g_pid[motor], CBOB_PID_CLEAR_COUNTER);
 }
 
@@ -431,12 +788,17 @@ int clear_motor_position_counter(int motor)
 int move_at_velocity(int motor, int velocity)
 {
 	short v = velocity;
+	short data[2];
 	
 	if(motor < 0 || motor > 3) {
 		printf("Motor must be 0..3\n");
 		return -1;
 	}
 	
+	data[0] = motor;
+	data[1] = v;
+	if(cbc_batch_add(CBOB_CMD_PID_WRITE, data, 2)) return 0;
+	
 	write(g_pid[motor], &v, 2);
 	
 	return 0;
@@ -452,6 +814,7 @@ int move_to_position(int motor, int speed, int goal_pos)
 	short v = speed;
 	int p = goal_pos;
 	char outdata[6];
+	short data[4];
 	
 	if(motor < 0 || motor > 3) {
 		printf("Motor must be 0..3\n");
@@ -461,6 +824,10 @@ int move_to_position(int motor, int speed, int goal_pos)
 	memcpy(outdata, &v, 2);
 	memcpy(outdata+2, &p, 4);
 	
+	data[0] = motor;
+	memcpy(&data[1], outdata, 6);
+	if(cbc_batch_add(CBOB_CMD_PID_WRITE, data, 4)) return 0;
+	
 	write(g_pid[motor], outdata, 6);
 	
 	return 0;
@@ -484,6 +851,76 @@ int mrp(int motor, int velocity, int delta_pos)
 	return(move_relative_position(motor, velocity, delta_pos));
 }
 
+// Acceleration (ticks/s^2) and jerk (ticks/s^3) limits for the profiled
+// moves.  A jerk of 0 gives a trapezoid, otherwise the speed follows an
+// S-curve.  An acceleration of 0 makes the profiled moves plain mtp/mrp.
+int set_motor_profile(int motor, int accel, int jerk)
+{
+	int profile[2];
+	short data[6];
+	
+	if(motor < 0 || motor > 3) {
+		printf("Motor must be 0..3\n");
+		return -1;
+	}
+	
+	profile[0] = accel;
+	profile[1] = jerk;
+	
+	data[0] = 11;
+	data[1] = motor;
+	memcpy(&data[2], profile, 8);
+	if(cbc_batch_add(CBOB_CMD_PID_CONFIG, data, 6)) return 0;
+	
+	return ioctl(g_pid[motor], CBOB_PID_SET_PROFILE, profile);
+}
+
+void get_motor_profile(int motor, int *accel, int *jerk)
+{
+	int profile[2] = {0,0};
+	
+	if(motor >= 0 && motor <= 3)
+		ioctl(g_pid[motor], CBOB_PID_GET_PROFILE, profile);
+	
+	*accel = profile[0];
+	*jerk = profile[1];
+}
+
+// Like move_to_position, but the BoB ramps the speed up and down with
+// the motor's profile instead of starting and stopping at full speed
+int move_to_position_profiled(int motor, int speed, int goal_pos)
+{
+	int move[2];
+	short data[5];
+	
+	if(motor < 0 || motor > 3) {
+		printf("Motor must be 0..3\n");
+		return -1;
+	}
+	
+	move[0] = speed;
+	move[1] = goal_pos;
+	
+	data[0] = 13;
+	data[1] = motor;
+	data[2] = speed;
+	memcpy(&data[3], &goal_pos, 4);
+	if(cbc_batch_add(CBOB_CMD_PID_CONFIG, data, 5)) return 0;
+	
+	return ioctl(g_pid[motor], CBOB_PID_MOVE_PROFILED, move);
+}
+
+int mtp_profiled(int motor, int velocity, int goal_pos)
+{ return(move_to_position_profiled(motor, velocity, goal_pos)); }
+
+int move_relative_position_profiled(int motor, int speed, int delta_pos)
+{
+	return move_to_position_profiled(motor, speed, get_motor_position_counter(motor)+delta_pos);
+}
+
+int mrp_profiled(int motor, int velocity, int delta_pos)
+{ return(move_relative_position_profiled(motor, velocity, delta_pos)); }
+
 //Turns off or actively holds the motor in position depending  on the situation -- but it may drift
 int freeze(int motor)
 {
@@ -523,6 +960,23 @@ void get_pid_gains(int motor, int *p, int *i, int *d, int *pd, int *id, int *dd)
 	*dd = gains[5];
 }
 
+// the loop period is shared by all four motors, returns the period the BoB used
+int set_pid_period(int usecs)
+{
+	if(ioctl(g_pid[0], CBOB_PID_SET_PERIOD, &usecs) < 0) return -1;
+	
+	return usecs;
+}
+
+int get_pid_period()
+{
+	int usecs;
+	
+	if(ioctl(g_pid[0], CBOB_PID_GET_PERIOD, &usecs) < 0) return -1;
+	
+	return usecs;
+}
+
 //returns 0 if motor is in motion and 1 if it has reached its target position
 int get_motor_done(int motor)
 {
@@ -550,6 +1004,9 @@ void block_motor_done(int motor)
 		return;
 	}
         msleep(10);
+	// sleeps in the driver until the BoB signals the motor is done
+	if(ioctl(g_pid[motor], CBOB_PID_WAIT_DONE) == 0)
+		return;
 	//loop doing nothing while motor position move is in progress
 	while(!get_motor_done(motor)){msleep(10);}
 }
@@ -557,6 +1014,7 @@ void block_motor_done(int motor)
 int setpwm(int motor, int pwm)
 {
 	signed char power = pwm;
+	short data[2];
 	
 	if(motor < 0 || motor > 3) {
 		printf("Motor must be 0..3\n");
@@ -568,18 +1026,26 @@ int setpwm(int motor, int pwm)
 		return -1;
 	}
 	
+	data[0] = motor;
+	data[1] = power;
+	if(cbc_batch_add(CBOB_CMD_PWM_WRITE, data, 2)) return 0;
+	
 	write(g_pwm[motor], &power, 1);
 }
 
 int getpwm(int motor)
 {
 	signed char power;
+	struct cbob_state state;
 	
 	if(motor < 0 || motor > 3) {
 		printf("Motor must be 0..3\n");
 		return -1;
 	}
 	
+	if(cbc_state(&state, CBOB_STATE_MOTORS))
+		return (signed char)state.pwm[motor];
+	
 	read(g_pwm[motor], &power, 1);
 	
 	return power;
@@ -654,6 +1120,10 @@ void ao()
 int black_button()
 {
 	short data;
+	struct cbob_state state;
+	
+	if(cbc_state(&state, CBOB_STATE_SENSORS))
+		return (state.sensors.digitals >> 8) & 1;
 	
         read(g_button, &data, 2);
 	
@@ -50,15 +50,26 @@ void start_recording(const char* filename, int length); /* records a sound to th
 int recording_sound(); /* returns 1 if still recording, 0 if completed length number of seconds */
 void stop_recording(); /* stops recording */
 int digital(int port); /* returns a 1 or 0 reflecting the state of port (0 to 7) */
+int wait_for_digital(int port, int value); /* returns when digital port (8 to 15) reads value (0 or 1) */
+int set_digital_capture(int port, int edges); /* captures edges on digital port (8 to 15) on the BoB, edges: 0 off, 1 rising, 2 falling, 3 both */
+int digital_count(int port); /* returns the edges captured on digital port (8 to 15) since it was cleared */
+void clear_digital_count(int port); /* zeroes the captured edge count of digital port (8 to 15) */
+int read_digital_edges(unsigned int *stamps, int *ports, int *levels, int max); /* copies up to max captured edges, oldest first, stamps in microseconds; returns the number copied */
 void set_digital_output_value(int port, int value); /*sets port (0 to 7)to value (0 or 1) */
 int analog10(int port); /* returns 10-bit value from analog port (ports 8 to 15) */
 int analog(int port); /* returns 8-bit value from analog port (ports 8 to 15) */
+int start_analog_stream(int mask, int rate); /* samples the analog ports in mask (bit n is port n) rate times a second (100 to 10000) on the BoB, returns the rate used */
+void stop_analog_stream(); /* stops sampling */
+int read_analog_stream(short *samples, int max, unsigned int *first); /* copies up to max (at most 512) samples, one per streamed port in port order for each sample time; first gets the sample time number of the first, returns the number copied */
+int set_analog_filter(int port, int type, int size); /* smooths analog port 0-7 on the BoB with a FILTER_ type, returns the size used */
 int accel_x(); /* returns x accelleration (-2047 to 2047, +/- 1.5 gee) */
 int accel_y(); /* returns y accelleration (-2047 to 2047, +/- 1.5 gee) */
 int accel_z(); /* returns z accelleration (-2047 to 2047, +/- 1.5 gee) */
+int set_accel_filter(int axis, int type, int size); /* smooths accel axis 0-2 (x, y, z) like set_analog_filter */
 int sonar(int port); /* returns range in mm for sonar plugged into port (13-15)*/
 int sonar_inches(int port); /* returns range in whole inches for sonar plugged into port (13-15)*/
 float power_level(); /* returns a float battery voltage */
+int set_battery_filter(int type, int size); /* the battery averages 40 readings (about 2.4 seconds) unless changed */
 void enable_servos(); /* powers up the servos */
 void disable_servos(); /* powers down the servos */
 int set_servo_position(int servo, int pos); /* sets servo (1 to 4) to pos (0 to 2047) */
@@ -71,8 +82,16 @@ int move_to_position(int motor, int speed, int goal_pos);/* move motor (0 to 3)
 int mtp(int motor, int speed, int goal_pos);/* move motor (0 to 3) at speed to goal_pos */
 int move_relative_position(int motor, int speed, int delta_pos);/* move motor (0 to 3) at speed by delta_pos */
 int mrp(int motor, int speed, int delta_pos);/* move motor (0 to 3) at speed by delta_pos */
+int set_motor_profile(int motor, int accel, int jerk);/* accel (ticks/s^2) and jerk (ticks/s^3, 0 for a trapezoid) of the profiled moves */
+void get_motor_profile(int motor, int *accel, int *jerk);
+int move_to_position_profiled(int motor, int speed, int goal_pos);/* mtp, ramping speed up and down with the motor profile */
+int mtp_profiled(int motor, int velocity, int goal_pos);
+int move_relative_position_profiled(int motor, int speed, int delta_pos);/* mrp, ramping speed up and down with the motor profile */
+int mrp_profiled(int motor, int velocity, int delta_pos);
 void set_pid_gains(int motor, int p, int i, int d, int pd, int id, int dd);/* set PID gains */
 void get_pid_gains(int motor, int *p, int *i, int *d, int *pd, int *id, int *dd);
+int set_pid_period(int usecs);/* set the motor PID loop period (2000 to 30000us), returns the period used */
+int get_pid_period();/* returns the motor PID loop period in us */
 int freeze(int motor);/* keep motor (0 to 3) at current position */
 int get_motor_done(int motor); /* returns 1 if motor (0 to 3) is moving to a goal and 0 otherwise */
 void block_motor_done(int motor); /* returns when motor (0 to 3) has reached goal */
@@ -88,6 +107,9 @@ void ao(); /* turns all motors off */
 void libcbc_init();
 void libcbc_exit();
 
+void cbc_batch_begin(); /* queue motor, servo and digital output commands instead of sending them */
+int cbc_batch_commit(); /* send everything queued since cbc_batch_begin in one BoB transaction */
+
 int up_button();
 int down_button();
 int left_button();
@@ -108,6 +130,13 @@ void set_analog_floats(int mask);
 int get_analog_floats();
 void set_each_analog_state(int a0, int a1, int a2, int a3, int a4, int a5, int a6, int a7);
 
+// Filters for set_analog_filter, set_accel_filter and set_battery_filter.
+// Sensors are read every 10ms, the battery every 60ms.
+#define FILTER_NONE    0 /* raw readings */
+#define FILTER_AVERAGE 1 /* mean of the last size readings, size up to 40 */
+#define FILTER_MEDIAN  2 /* median of the last size readings, size up to 9 */
+#define FILTER_IIR     3 /* each reading moves the value 1/2^size of the way, size up to 8 */
+
 #define SIMPLEWORLD 0
 #define BB08WORLD 1
 #define EMPTYWORLD 2
@@ -38,6 +38,10 @@ struct Motor : Port {
 	void moveRelativePosition(int speed, long goalPos) { move_relative_position(m_port, speed, goalPos); }
 	void mrp(int speed, long goalPos) { moveRelativePosition(speed, goalPos); }
 	
+	void setProfile(int accel, int jerk) { set_motor_profile(m_port, accel, jerk); }
+	void moveToPositionProfiled(int speed, long goalPos) { move_to_position_profiled(m_port, speed, goalPos); }
+	void moveRelativePositionProfiled(int speed, long goalPos) { move_relative_position_profiled(m_port, speed, goalPos); }
+	
 	int freeze() { ::freeze(m_port); }
 	
 	bool isMotorDone() { get_motor_done(m_port); }
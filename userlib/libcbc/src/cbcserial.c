@@ -23,7 +23,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <sys/select.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <stdio.h>
 
@@ -31,9 +34,22 @@
 
 int g_cbc_serial_fd = -1;
 
+// serial_queue collects writes in tx until serial_send, so a command goes
+// out in one write() instead of one per byte.  serial_write goes straight
+// to the fd like it always has.  Reads come out of the rx ring,
+// which is refilled with as much as the fd has whenever it runs dry.
+static char g_cbc_serial_tx[SERIAL_TX_SIZE];
+static int g_cbc_serial_tx_count = 0;
+static pthread_mutex_t g_cbc_serial_tx_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char g_cbc_serial_rx[SERIAL_RX_SIZE];
+static int g_cbc_serial_rx_head = 0; // next byte to hand out
+static int g_cbc_serial_rx_tail = 0; // next free byte
+
 void serial_init()
 {
   g_cbc_serial_fd = open(CREATE_UART, O_RDWR | O_NONBLOCK);
+  g_cbc_serial_tx_count = 0;
   
   serial_flush();
   
@@ -43,36 +59,160 @@ void serial_init()
 void serial_quit()
 {
   if(g_cbc_serial_fd > 0) {
+    serial_send();
     close(g_cbc_serial_fd);
     g_cbc_serial_fd = -1;
   }
 }
 
+// pulls whatever the fd has into the empty rx ring
+static int serial_fill()
+{
+  int ret;
+  
+  g_cbc_serial_rx_head = g_cbc_serial_rx_tail = 0;
+  if(g_cbc_serial_fd <= 0)
+    return 0;
+  if((ret = read(g_cbc_serial_fd, g_cbc_serial_rx, SERIAL_RX_SIZE)) > 0)
+    g_cbc_serial_rx_tail = ret;
+  return g_cbc_serial_rx_tail;
+}
+
 int serial_read(char *data, int count)
 {
   int ret;
-  if(g_cbc_serial_fd > 0) {
-    if((ret = read(g_cbc_serial_fd, data, count)) > 0)
-      return ret;
+  
+  if(g_cbc_serial_rx_head == g_cbc_serial_rx_tail && serial_fill() == 0)
+    return 0;
+  
+  ret = g_cbc_serial_rx_tail - g_cbc_serial_rx_head;
+  if(ret > count)
+    ret = count;
+  memcpy(data, g_cbc_serial_rx + g_cbc_serial_rx_head, ret);
+  g_cbc_serial_rx_head += ret;
+  
+  return ret;
+}
+
+int serial_wait(int timeout_ms)
+{
+  struct pollfd fds;
+  
+  if(g_cbc_serial_rx_head != g_cbc_serial_rx_tail)
+    return 1;
+  if(g_cbc_serial_fd <= 0)
+    return 0;
+  
+  fds.fd = g_cbc_serial_fd;
+  fds.events = POLLIN;
+  return poll(&fds, 1, timeout_ms) > 0;
+}
+
+// caller holds g_cbc_serial_tx_mutex
+static int serial_send_locked()
+{
+  struct pollfd fds;
+  int sent = 0, ret;
+  
+  while(g_cbc_serial_fd > 0 && sent < g_cbc_serial_tx_count) {
+    ret = write(g_cbc_serial_fd, g_cbc_serial_tx + sent, g_cbc_serial_tx_count - sent);
+    if(ret > 0) {
+      sent += ret;
+      continue;
+    }
+    if(ret < 0 && errno != EAGAIN && errno != EINTR)
+      break;
+    // the uart's queue is full, wait for it to drain
+    fds.fd = g_cbc_serial_fd;
+    fds.events = POLLOUT;
+    if(poll(&fds, 1, SERIAL_SEND_TIMEOUT) <= 0)
+      break;
   }
-  return 0;
+  
+  g_cbc_serial_tx_count = 0;
+  return sent;
+}
+
+int serial_queue(char *data, int count)
+{
+  int n, left = count;
+  
+  if(g_cbc_serial_fd <= 0)
+    return 0;
+  
+  pthread_mutex_lock(&g_cbc_serial_tx_mutex);
+  while(left > 0) {
+    if(g_cbc_serial_tx_count == SERIAL_TX_SIZE)
+      serial_send_locked();
+    n = SERIAL_TX_SIZE - g_cbc_serial_tx_count;
+    if(n > left)
+      n = left;
+    memcpy(g_cbc_serial_tx + g_cbc_serial_tx_count, data, n);
+    g_cbc_serial_tx_count += n;
+    data += n;
+    left -= n;
+  }
+  pthread_mutex_unlock(&g_cbc_serial_tx_mutex);
+  
+  return count;
 }
 
 int serial_write(char *data, int count)
 {
   int ret;
-  if(g_cbc_serial_fd > 0) {
-    if((ret = write(g_cbc_serial_fd, data, count)) > 0)
-      return ret;
+  
+  if(g_cbc_serial_fd <= 0)
+    return 0;
+  
+  // anything queued goes first to keep the bytes in order
+  pthread_mutex_lock(&g_cbc_serial_tx_mutex);
+  serial_send_locked();
+  ret = write(g_cbc_serial_fd, data, count);
+  pthread_mutex_unlock(&g_cbc_serial_tx_mutex);
+  
+  return ret > 0 ? ret : 0;
+}
+
+int serial_send()
+{
+  int ret;
+  
+  pthread_mutex_lock(&g_cbc_serial_tx_mutex);
+  ret = serial_send_locked();
+  pthread_mutex_unlock(&g_cbc_serial_tx_mutex);
+  
+  return ret;
+}
+
+int serial_set_baud(int baud)
+{
+  struct termios options;
+  speed_t speed;
+  
+  switch(baud) {
+    case 9600: speed = B9600; break;
+    case 19200: speed = B19200; break;
+    case 38400: speed = B38400; break;
+    case 57600: speed = B57600; break;
+    case 115200: speed = B115200; break;
+    default: return -1;
   }
-  return 0;
+  
+  if(g_cbc_serial_fd <= 0 || tcgetattr(g_cbc_serial_fd, &options) < 0)
+    return -1;
+  // what's buffered was meant for the old rate
+  serial_send();
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+  return tcsetattr(g_cbc_serial_fd, TCSANOW, &options);
 }
 
 void serial_flush()
 {
-  char data;
+  // input only, commands still queued for the BoB must not be dropped
+  g_cbc_serial_rx_head = g_cbc_serial_rx_tail = 0;
   if(g_cbc_serial_fd > 0) {
-    tcflush(g_cbc_serial_fd, TCIOFLUSH);
+    tcflush(g_cbc_serial_fd, TCIFLUSH);
   }
 }
 
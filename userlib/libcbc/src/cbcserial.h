@@ -27,15 +27,31 @@ extern "C" {
 
 #define CREATE_UART "/dev/uart1"
 
+// bytes serial_queue collects before it has to send
+#define SERIAL_TX_SIZE 256
+#define SERIAL_RX_SIZE 1024
+// ms serial_send waits for room in the uart's queue
+#define SERIAL_SEND_TIMEOUT 500
+
 void serial_init();
 void serial_quit();
 
+// Returns what has arrived, up to count bytes, without waiting
 int serial_read(char *data, int count);
+// Returns 1 once there is something to read, 0 after timeout_ms
+int serial_wait(int timeout_ms);
+// Writes data right away, after anything serial_queue still holds
 int serial_write(char *data, int count);
+// Buffers data, it goes out on serial_send (or when the buffer fills)
+int serial_queue(char *data, int count);
+int serial_send();
 
 char serial_read_byte();
 void serial_wryte_byte(char byte);
 
+// 57600 to start, the Create's default.  Tell the Create first (opcode 129).
+int serial_set_baud(int baud);
+
 void serial_flush_output();
 void serial_flush_input();
 void serial_flush();
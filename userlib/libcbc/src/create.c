@@ -23,13 +23,24 @@
 
 #include "create.h"
 
+#include <pthread.h>
+#include <string.h>
+#include <math.h>
+
 // create the Create's state and initialize all data to 0 and all last updates to a billion seconds in the past.
-struct _create_state stateOfCreate={0,0,0,0,0,0,0,0,0,0,0,{0,0,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0}};//is the one and only instance of this structure
+struct _create_state stateOfCreate={0,0,0,0,0,0,0,0,0,0,0,0,{0,0,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0},{-1.E9,0}};//is the one and only instance of this structure
 // This global is used by the user to store songs to be played on the Create
 // The functions create_load_song and create_play_song are used to get the data
 // from this global to the Create.  The user fills the global on their own.
 int gc_song_array[16][33];
 
+static pthread_mutex_t _create_mutex=PTHREAD_MUTEX_INITIALIZER;// held between CREATE_BUSY and CREATE_FREE
+static pthread_t _create_owner, _create_no_owner;// the thread between CREATE_BUSY and CREATE_FREE
+static int _create_stale(struct _sensor_packet *packet, float lag);
+// opens the getter's own query if packet is stale, returns the error if
+// refreshing it with the update group failed
+#define CREATE_IF_STALE(packet,lag) int _stale=_create_stale(packet,lag); if(_stale>1)return(_stale); if(_stale)
+
 
 // void beep() {} // Does nothing for now
 
@@ -59,6 +70,8 @@ int create_connect()
 // returns the serial connections on XBC to normal communications over the USB port.
 // Turns of play LED and returns power light to green
 void create_disconnect() {
+        create_odometry_stop();
+        create_stream_stop();
         create_play_led(0);
         create_power_led(0,255);
         create_stop();
@@ -81,7 +94,7 @@ int get_create_mode(float lag)
 {
         char buffer[1];
         char *bptr = buffer;
-        if(seconds()-stateOfCreate.OIMode.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.OIMode, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(35);
@@ -164,7 +177,7 @@ void create_cover_dock()
 // updates the bumper and wheel drop states with the current values from the Create
 int _get_create_bumpdrop(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.bumpsWheelDrops.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.bumpsWheelDrops, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(7);//drops and bumps
@@ -211,7 +224,7 @@ int get_create_rwheel(float lag)
 //updates and returns wall sensor in digital mode
 int get_create_wall(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.wall.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.wall, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(8);  //  wall seen or not (1 byte)
@@ -227,7 +240,7 @@ int get_create_wall(float lag) {
 //updates and returns cliff sensor in digital mode
 int get_create_lcliff(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.lcliff.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.lcliff, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(9);  //  wall seen or not (1 byte)
@@ -241,7 +254,7 @@ int get_create_lcliff(float lag) {
 //updates and returns cliff sensor in digital mode
 int get_create_lfcliff(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.lfcliff.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.lfcliff, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(10);  //  wall seen or not (1 byte)
@@ -255,7 +268,7 @@ int get_create_lfcliff(float lag) {
 //updates and returns cliff sensor in digital mode
 int get_create_rfcliff(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.rfcliff.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.rfcliff, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(11);  //  wall seen or not (1 byte)
@@ -269,7 +282,7 @@ int get_create_rfcliff(float lag) {
 //updates and returns cliff sensor in digital mode
 int get_create_rcliff(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.rcliff.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.rcliff, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(12);  //  wall seen or not (1 byte)
@@ -285,7 +298,7 @@ int get_create_rcliff(float lag) {
 //updates and returns virtual wall sensor in digital mode
 int get_create_vwall(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.vWall.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.vWall, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(13);  //  wall seen or not (1 byte)
@@ -300,7 +313,7 @@ int get_create_vwall(float lag) {
 //updates and returns overcurrents b4 lw, b3 rw, b2 ld2, b1, ld0, b0 ld1
 int get_create_overcurrents(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.LSDandWheelOvercurrents.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.LSDandWheelOvercurrents, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(14);  //  wall seen or not (1 byte)
@@ -316,7 +329,7 @@ int get_create_overcurrents(float lag) {
 //updates and returns infrared byte. 255 if no signal
 int get_create_infrared(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.infrared.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.infrared, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(17);  //  infrared
@@ -332,7 +345,7 @@ int get_create_infrared(float lag) {
 // updates the bumper and wheel drop globals with the current values from the Create
 int _get_create_buttons(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.buttons.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.buttons, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(18);//buttons
@@ -353,7 +366,7 @@ int get_create_play_button(float lag){int b=_get_create_buttons(lag); if(b>10000
 // Forward increments, backwards decrements
 int get_create_incremental_distance(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.distance.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.distance, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(19);//buttons
@@ -378,7 +391,7 @@ void set_create_distance(int d) {get_create_incremental_distance(.005); stateOfC
 // CCW angles are positive and CW turns decrement the angle value.
 int get_create_incremental_angle(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.angle.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.angle, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(20);//buttons
@@ -417,7 +430,7 @@ void set_create_normalized_angle(int a) {
 int get_create_battery_charging_state(float lag)
 {
         char buffer[1];
-        if(seconds()-stateOfCreate.chargingState.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.chargingState, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(21);
@@ -432,7 +445,7 @@ int get_create_battery_charging_state(float lag)
 int get_create_battery_voltage(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.voltage.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.voltage, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(22);
@@ -448,7 +461,7 @@ int get_create_battery_voltage(float lag)
 int get_create_battery_current(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.current.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.current, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(23);
@@ -466,7 +479,7 @@ int get_create_battery_current(float lag)
 int get_create_battery_temp(float lag)
 {
         char buffer[1];
-        if(seconds()-stateOfCreate.batteryTemp.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.batteryTemp, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(24);
@@ -482,7 +495,7 @@ int get_create_battery_temp(float lag)
 int get_create_battery_charge(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.batteryCharge.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.batteryCharge, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(25);
@@ -498,7 +511,7 @@ int get_create_battery_charge(float lag)
 int get_create_battery_capacity(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.batteryCapacity.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.batteryCapacity, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(26);
@@ -515,7 +528,7 @@ int get_create_battery_capacity(float lag)
 //updates and returns wall sensor in analog mode
 int get_create_wall_amt(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.wallSignal.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.wallSignal, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(27);  //  wall seen or not (1 byte)
@@ -531,7 +544,7 @@ int get_create_wall_amt(float lag) {
 //updates and returns cliff sensor in analog mode
 int get_create_lcliff_amt(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.lcliffSignal.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.lcliffSignal, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(28);  //  wall seen or not (1 byte)
@@ -548,7 +561,7 @@ int get_create_lcliff_amt(float lag) {
 //updates and returns cliff sensor in analog mode
 int get_create_lfcliff_amt(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.lfcliffSignal.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.lfcliffSignal, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(29);  // lf cliff
@@ -565,7 +578,7 @@ int get_create_lfcliff_amt(float lag) {
 //updates and returns cliff sensor in analog mode
 int get_create_rfcliff_amt(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.rfcliffSignal.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.rfcliffSignal, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(30);  //  rf
@@ -582,7 +595,7 @@ int get_create_rfcliff_amt(float lag) {
 //updates and returns cliff sensor in analog mode
 int get_create_rcliff_amt(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.rcliffSignal.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.rcliffSignal, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(31);  //  right cliff
@@ -599,7 +612,7 @@ int get_create_rcliff_amt(float lag) {
 //updates and returns cargo bay digitals b4 is device detect; b3 is pin 6; b2 pin 18; b0 pin 17
 int get_create_cargo_bay_digitals(float lag) {
         char buffer[1];
-        if(seconds()-stateOfCreate.cargoBayDI.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.cargoBayDI, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(32);  //
@@ -614,7 +627,7 @@ int get_create_cargo_bay_digitals(float lag) {
 //updates and returns CB analog sensor pin 4
 int get_create_cargo_bay_analog(float lag) {
         char buffer[2];
-        if(seconds()-stateOfCreate.cargoBayAI.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.cargoBayAI, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(33);  //  CB analog 0 -1023
@@ -631,7 +644,7 @@ int get_create_cargo_bay_analog(float lag) {
 int get_create_battery_charging_source(float lag)
 {
         char buffer[1];
-        if(seconds()-stateOfCreate.chargingSource.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.chargingSource, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(34);
@@ -648,7 +661,7 @@ int get_create_battery_charging_source(float lag)
 int get_create_song_number(float lag)
 {
         char buffer[1];
-        if(seconds()-stateOfCreate.songNumber.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.songNumber, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(36);
@@ -664,7 +677,7 @@ int get_create_song_number(float lag)
 int get_create_song_playing(float lag)
 {
         char buffer[1];
-        if(seconds()-stateOfCreate.songPlaying.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.songPlaying, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(37);
@@ -680,7 +693,7 @@ int get_create_song_playing(float lag)
 int get_create_number_of_stream_packets(float lag)
 {
         char buffer[1];
-        if(seconds()-stateOfCreate.numStreamPackets.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.numStreamPackets, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(38);
@@ -696,7 +709,7 @@ int get_create_number_of_stream_packets(float lag)
 int get_create_requested_velocity(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.requestedVelocity.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.requestedVelocity, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(39);
@@ -714,7 +727,7 @@ int get_create_requested_velocity(float lag)
 int get_create_requested_radius(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.requestedRadius.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.requestedRadius, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(40);
@@ -732,7 +745,7 @@ int get_create_requested_radius(float lag)
 int get_create_requested_right_velocity(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.requestedRVelocity.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.requestedRVelocity, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(41);
@@ -750,7 +763,7 @@ int get_create_requested_right_velocity(float lag)
 int get_create_requested_left_velocity(float lag)
 {
         char buffer[2];
-        if(seconds()-stateOfCreate.requestedLVelocity.lastUpdate > lag){
+        CREATE_IF_STALE(&stateOfCreate.requestedLVelocity, lag){
                 CREATE_BUSY;
                 create_write_byte(142);
                 create_write_byte(42);
@@ -896,7 +909,11 @@ int create_spin_block(int speed, int angle)
         char *bptr = buffer;
         int r[7]={18,7,9,24,12,15,21},v[7],i,b;
         long lenc=0L, renc=0L,slenc,srenc,flenc,frenc;
-        float offset, ticsPerMM=7.8324283, rad=129.0, pi=3.1415926;
+        float offset, ticsPerMM=CREATE_TICS_PER_MM, rad=CREATE_WHEEL_BASE/2.0, pi=3.1415926;
+        if(stateOfCreate.streaming){
+                printf("create_spin_block\n can't run while\n streaming\n");
+                return(-1);
+        }
         CREATE_BUSY;
         create_write_byte(8);//version
         CREATE_WAITFORBUFFER(buffer,7,-99)
@@ -928,7 +945,7 @@ int create_spin_block(int speed, int angle)
 int _create_get_raw_encoders(long *lenc, long *renc)
 {
         char buffer[4];
-        char *bptr = buffer;
+        unsigned char *bptr = (unsigned char*)buffer;
         CREATE_BUSY;
         create_write_byte(149);
         create_write_byte(2);
@@ -940,6 +957,7 @@ int _create_get_raw_encoders(long *lenc, long *renc)
         *renc=(long)(*(bptr++))*256L;
         *renc=*renc+(long)(*(bptr++));//left encoder value
         CREATE_FREE;
+        return(0);
 }
 
 
@@ -1333,18 +1351,395 @@ void create_script_run() {
         create_write_byte(153); // run script
 }
 
+/////////////////////////CREATE SENSOR STREAM///////////////////
+
+// Bytes in each sensor packet, negative if the value is signed.  Packets
+// 15 and 16 are unused but still take a byte in the groups.
+static const signed char _create_packet_bytes[CREATE_MAX_PACKET+1]={
+        0,0,0,0,0,0,0,
+        1,1,1,1,1,1,1,1,1,1,    // 7-16
+        1,1,-2,-2,              // 17-20
+        1,2,-2,-1,2,2,          // 21-26
+        2,2,2,2,2,              // 27-31
+        1,2,1,1,1,1,1,          // 32-38
+        -2,-2,-2,-2};           // 39-42
+
+// first and last packet of each group
+static const char _create_groups[CREATE_MAX_GROUP+1][2]={{7,26},{7,16},{17,20},{21,26},{27,34},{35,42},{7,42}};
+
+static pthread_t _create_stream_thread;
+static unsigned char _create_stream_buffer[512];// a frame is at most 255+3 bytes
+static int _create_stream_count;
+static char _create_streamed[CREATE_MAX_PACKET+1];// 1 if the packet is in the stream
+static int _create_update_group=-1;// see create_set_update_group
+
+// the cache entry of a sensor packet, 0 for the unused ones
+static struct _sensor_packet *_create_packet(int id)
+{
+        if(id>=7 && id<=14) return(&stateOfCreate.bumpsWheelDrops+(id-7));
+        if(id>=17 && id<=CREATE_MAX_PACKET) return(&stateOfCreate.infrared+(id-17));
+        return(0);
+}
+
+// the packets a packet or group id stands for, -1 if there are none
+static int _create_packet_range(int id, int *first, int *last)
+{
+        if(id>=0 && id<=CREATE_MAX_GROUP){*first=_create_groups[id][0]; *last=_create_groups[id][1]; return(0);}
+        if(id>CREATE_MAX_GROUP && id<=CREATE_MAX_PACKET && _create_packet_bytes[id]!=0){*first=*last=id; return(0);}
+        return(-1);
+}
+
+static int _create_range_bytes(int first, int last)
+{
+        int id, size=0;
+        for(id=first;id<=last;id++)size+=(_create_packet_bytes[id]<0 ? -_create_packet_bytes[id] : _create_packet_bytes[id]);
+        return(size);
+}
+
+static int _create_packet_id(struct _sensor_packet *packet)
+{
+        if(packet<=&stateOfCreate.LSDandWheelOvercurrents)return(packet-&stateOfCreate.bumpsWheelDrops+7);
+        return(packet-&stateOfCreate.infrared+17);
+}
+
+// Stores packets first..last from the bytes the Create sent for them and
+// returns the number of bytes used.  Distance and angle are increments, so
+// they are added to the accumulated values like the get_create_* functions do.
+static int _create_store_packets(int first, int last, unsigned char *bytes, float stamp)
+{
+        struct _sensor_packet *packet;
+        int id, size, value, used=0;
+        for(id=first;id<=last;id++){
+                size=_create_packet_bytes[id];
+                value=bytes[used];
+                if(size==-1 && value>127)value=value-256;
+                if(size==2 || size==-2)value=256*value+bytes[used+1];
+                if(size==-2 && value>32767)value=value-65536;
+                used+=(size<0 ? -size : size);
+                if((packet=_create_packet(id))==0)continue;
+                packet->data=value;
+                packet->lastUpdate=stamp;
+                if(id==19)stateOfCreate.accumulatedDistance=stateOfCreate.accumulatedDistance+value;
+                if(id==20){
+                        stateOfCreate.totalAngle=stateOfCreate.totalAngle+value;
+                        stateOfCreate.normalizedAngle=(stateOfCreate.normalizedAngle+value)%360;
+                        if(stateOfCreate.normalizedAngle<0)stateOfCreate.normalizedAngle=stateOfCreate.normalizedAngle+360;
+                }
+        }
+        return(used);
+}
+
+// packets or groups in a stream frame's data: id, its bytes, id, its bytes...
+static int _create_stream_packets(unsigned char *data, int count, float stamp)
+{
+        int i=0, id;
+        int first, last;
+        while(i<count){
+                id=data[i++];
+                if(_create_packet_range(id,&first,&last)<0 || i+_create_range_bytes(first,last)>count)return(-1);
+                i+=_create_store_packets(first,last,data+i,stamp);
+        }
+        return(i==count ? 0 : -1);
+}
+
+// Frames are 19, count, count bytes of packets and a checksum that makes
+// the sum of the frame 0.  Parses every complete frame in the buffer and
+// resyncs on the next 19 when a frame doesn't check out.
+static void _create_stream_parse(float stamp)
+{
+        int start=0, size, i;
+        unsigned char sum;
+        while(1){
+                while(start<_create_stream_count && _create_stream_buffer[start]!=19)start++;
+                if(_create_stream_count-start<2)break;
+                size=_create_stream_buffer[start+1]+3;
+                if(_create_stream_count-start<size)break;
+                for(sum=0,i=0;i<size;i++)sum=sum+_create_stream_buffer[start+i];
+                if(sum==0 && _create_stream_packets(_create_stream_buffer+start+2,size-3,stamp)==0)start=start+size;
+                else start++;
+        }
+        _create_stream_count=_create_stream_count-start;
+        memmove(_create_stream_buffer,_create_stream_buffer+start,_create_stream_count);
+}
+
+static void *_create_stream_run(void *arg)
+{
+        int count;
+        while(stateOfCreate.streaming){
+                count=serial_read((char*)_create_stream_buffer+_create_stream_count,sizeof(_create_stream_buffer)-_create_stream_count);
+                if(count==0){serial_wait(50); continue;}
+                _create_stream_count=_create_stream_count+count;
+                _create_stream_parse(seconds());
+        }
+        return(0);
+}
+
+// Returns 1 if packet is older than lag and has to be requested.  With an
+// update group set, a stale packet in the group is refreshed with the whole
+// group instead, so a sweep over the getters is one exchange; if that
+// times out its 100000+ error code is returned for the getter to pass on.  While
+// streaming the Create sends a frame every 15ms, so this waits up to
+// COMM_TIMEOUT for the stream to bring a fresh enough value instead.
+// Packets that aren't in the stream keep their last value.
+static int _create_stale(struct _sensor_packet *packet, float lag)
+{
+        float start_time=seconds();
+        int id=_create_packet_id(packet), error;
+        if(start_time-packet->lastUpdate <= lag)return(0);
+        if(!stateOfCreate.streaming){
+                if(_create_update_group<0 || id<_create_groups[_create_update_group][0] || id>_create_groups[_create_update_group][1])return(1);
+                error=create_sensor_query(&_create_update_group,1);
+                return(error<0 ? 1 : error);
+        }
+        if(!_create_streamed[id])return(0);
+        while(stateOfCreate.streaming && packet->lastUpdate < start_time-lag && seconds()-start_time < COMM_TIMEOUT)
+                msleep(5);
+        return(0);
+}
+
+// Has the Create stream the packets (or groups) in packets, all of them if
+// packets is 0.  A thread parses the stream into stateOfCreate, so the
+// get_create_* functions answer from it without talking to the Create.
+// Stops create_odometry_start's thread.  Returns -1 if a packet id is out of range or the thread can't start.
+int create_stream_start(int *packets, int count)
+{
+        int all=6, i, id, first, last;
+        if(packets==0){packets=&all; count=1;}
+        if(count<1 || count>CREATE_MAX_PACKET)return(-1);
+        for(i=0;i<count;i++)
+                if(_create_packet_range(packets[i],&first,&last)<0)return(-1);
+        // the odometry thread queries the Create, which would eat the stream
+        create_odometry_stop();
+        create_stream_stop();
+
+        memset(_create_streamed,0,sizeof(_create_streamed));
+        for(i=0;i<count;i++){
+                _create_packet_range(packets[i],&first,&last);
+                for(id=first;id<=last;id++)_create_streamed[id]=1;
+        }
+
+        CREATE_BUSY;
+        _create_stream_count=0;
+        stateOfCreate.streaming=1;
+        if(pthread_create(&_create_stream_thread, NULL, _create_stream_run, 0)){
+                stateOfCreate.streaming=0;
+                CREATE_FREE;
+                return(-1);
+        }
+        create_write_byte(148);
+        create_write_byte(count);
+        for(i=0;i<count;i++)create_write_byte(packets[i]);
+        CREATE_FREE;
+        return(0);
+}
+
+// pauses the stream and goes back to requesting packets
+void create_stream_stop()
+{
+        if(!stateOfCreate.streaming)return;
+        CREATE_BUSY;
+        create_write_byte(150);
+        create_write_byte(0);
+        stateOfCreate.streaming=0;
+        pthread_join(_create_stream_thread, NULL);
+        CREATE_FREE;
+}
+
+// Requests the packets (or groups) in packets in one exchange with the
+// query list opcode and stores them all in stateOfCreate with the same
+// timestamp.  Returns -1 if a packet id is out of range, the reply doesn't
+// fit in a query or the Create is streaming (the stream already keeps the
+// packets fresh), and the usual 100000+ error if the Create doesn't answer.
+int create_sensor_query(int *packets, int count)
+{
+        char buffer[CREATE_QUERY_BYTES];
+        int i, size=0, used=0, first, last;
+        float stamp;
+        if(stateOfCreate.streaming || count<1 || count>255)return(-1);
+        for(i=0;i<count;i++){
+                if(_create_packet_range(packets[i],&first,&last)<0)return(-1);
+                size+=_create_range_bytes(first,last);
+        }
+        if(size>CREATE_QUERY_BYTES)return(-1);
+
+        CREATE_BUSY;
+        create_write_byte(149);
+        create_write_byte(count);
+        for(i=0;i<count;i++)create_write_byte(packets[i]);
+        CREATE_WAITFORBUFFER(buffer,size,100149)
+        stamp=seconds();
+        for(i=0;i<count;i++){
+                _create_packet_range(packets[i],&first,&last);
+                used+=_create_store_packets(first,last,(unsigned char*)buffer+used,stamp);
+        }
+        CREATE_FREE;
+        return(0);
+}
+
+// Makes the get_create_* functions refresh a stale packet by querying the
+// whole group (0-6) it is in, or one packet at a time again with -1.
+int create_set_update_group(int group)
+{
+        if(group<-1 || group>CREATE_MAX_GROUP)return(-1);
+        _create_update_group=group;
+        return(0);
+}
+
+/////////////////////////CREATE ODOMETRY///////////////////
+
+// The odometry thread reads the raw encoders every period and integrates
+// the pose.  It is the only writer of _create_pose; readers copy it
+// between two reads of _create_pose_sequence, which is odd while the
+// thread is writing, and retry if it changed.  The CBC is a single core,
+// so a compiler barrier orders the accesses.
+#define _CREATE_BARRIER __asm__ __volatile__("" ::: "memory")
+
+static struct create_pose _create_pose;
+static volatile unsigned int _create_pose_sequence;
+static struct create_pose _create_pose_request;
+static volatile int _create_pose_requested;
+static volatile int _create_odometry_running;
+static int _create_odometry_period;
+static pthread_t _create_odometry_thread;
+
+// the counters are 16 bits, a step is taken to be the short way around
+static long _create_encoder_delta(long now, long before)
+{
+        long d=now-before;
+        if(d>32767L)d=d-65536L;
+        if(d<-32768L)d=d+65536L;
+        return(d);
+}
+
+static void _create_pose_write(struct create_pose *pose)
+{
+        _create_pose_sequence++;
+        _CREATE_BARRIER;
+        _create_pose=*pose;
+        _CREATE_BARRIER;
+        _create_pose_sequence++;
+}
+
+static void *_create_odometry_run(void *arg)
+{
+        struct create_pose pose=_create_pose;
+        long lenc, renc, lprev=0, rprev=0;
+        float next=seconds(), now, left, right, step, turn;
+        int primed=0;
+        while(_create_odometry_running){
+                if(_create_pose_requested){
+                        pose=_create_pose_request;
+                        _create_pose_requested=0;
+                        _create_pose_write(&pose);
+                }
+                if(_create_get_raw_encoders(&lenc,&renc)==0){
+                        if(primed){
+                                // midpoint integration of the arc both wheels drove
+                                left=_create_encoder_delta(lenc,lprev)/CREATE_TICS_PER_MM;
+                                right=_create_encoder_delta(renc,rprev)/CREATE_TICS_PER_MM;
+                                step=(left+right)/2.0;
+                                turn=(right-left)/CREATE_WHEEL_BASE;
+                                pose.x=pose.x+step*cos(pose.theta+turn/2.0);
+                                pose.y=pose.y+step*sin(pose.theta+turn/2.0);
+                                pose.theta=pose.theta+turn;
+                                if(pose.theta>M_PI)pose.theta=pose.theta-twopi;
+                                if(pose.theta<=-M_PI)pose.theta=pose.theta+twopi;
+                        }
+                        pose.lastUpdate=seconds();
+                        _create_pose_write(&pose);
+                        lprev=lenc;
+                        rprev=renc;
+                        primed=1;
+                }
+                else primed=0;// lost readings, start over from the next one
+
+                // keep to the period instead of drifting by the query time
+                next=next+_create_odometry_period/1000.0;
+                now=seconds();
+                if(next>now)msleep((long)((next-now)*1000.0));
+                else next=now;
+        }
+        return(0);
+}
+
+// Starts integrating the pose from the wheel encoders every period_ms.
+// Needs the 9/07 Create firmware like create_spin_block, and doesn't run
+// while streaming.  Returns -1 if it can't start.
+int create_odometry_start(int period_ms)
+{
+        if(period_ms<1 || stateOfCreate.streaming)return(-1);
+        create_odometry_stop();
+        _create_odometry_period=period_ms;
+        _create_odometry_running=1;
+        if(pthread_create(&_create_odometry_thread, NULL, _create_odometry_run, 0)){
+                _create_odometry_running=0;
+                return(-1);
+        }
+        return(0);
+}
+
+void create_odometry_stop()
+{
+        if(!_create_odometry_running)return;
+        _create_odometry_running=0;
+        pthread_join(_create_odometry_thread, NULL);
+}
+
+// copies the latest pose, never blocks on the Create
+void create_get_pose(struct create_pose *pose)
+{
+        unsigned int sequence;
+        do{
+                sequence=_create_pose_sequence;
+                _CREATE_BARRIER;
+                *pose=_create_pose;
+                _CREATE_BARRIER;
+        }while((sequence&1) || sequence!=_create_pose_sequence);
+}
+
+// Moves the pose, theta in radians.  The odometry thread picks it up
+// before its next step so it doesn't race with the integration.
+void create_set_pose(float x, float y, float theta)
+{
+        struct create_pose pose;
+        pose.x=x;
+        pose.y=y;
+        pose.theta=atan2(sin(theta),cos(theta));
+        pose.lastUpdate=seconds();
+        if(_create_odometry_running){
+                _create_pose_request=pose;
+                _CREATE_BARRIER;
+                _create_pose_requested=1;
+        }
+        else _create_pose_write(&pose);
+}
+
 int create_read_block(char *data, int count)
 {
-        float start_time;
+        float start_time, left;
         int read_count = 0;
 
+        serial_send(); // the request has to go out before the reply can come
         start_time = seconds();
-        while(read_count < count && seconds()-start_time < COMM_TIMEOUT)
-        read_count += serial_read(data+read_count, count-read_count);
+        while(1) {
+                read_count += serial_read(data+read_count, count-read_count);
+                left = COMM_TIMEOUT-(seconds()-start_time);
+                if(read_count >= count || left <= 0 || !serial_wait((int)(left*1000.0)+1))
+                        break;
+        }
 
         return read_count;
 }
 
+// Bytes written inside CREATE_BUSY/CREATE_FREE go out when the command is
+// done.  Other callers write right away but take the lock for the byte, so
+// it can't land in the middle of another thread's command.
 void create_write_byte(char byte) {
-        serial_write(&byte, 1);
+        if(pthread_equal(_create_owner, pthread_self()))
+                serial_queue(&byte, 1);
+        else{
+                pthread_mutex_lock(&_create_mutex);
+                serial_write(&byte, 1);
+                pthread_mutex_unlock(&_create_mutex);
+        }
 }
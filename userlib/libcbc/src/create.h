@@ -29,22 +29,38 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <pthread.h>
 #include "compat.h"
-//#include "cbcserial.h"
+#include "cbcserial.h"
 
 #define HIGH_BYTE(word) (((word)>>8)&0xFF)
 #define LOW_BYTE(word)  ((word)&0xFF)
 
-#define CREATE_WAITFORBUFFER(buffer,count,error) { if(create_read_block(buffer, count) < count) { printf("Create connection failed.");stateOfCreate.createBusy=0; return error; }}
+#define CREATE_WAITFORBUFFER(buffer,count,error) { if(create_read_block(buffer, count) < count) { printf("Create connection failed.");CREATE_FREE; return error; }}
 
-#define CREATE_BUSY while(stateOfCreate.createBusy)msleep(10); serial_flush(); stateOfCreate.createBusy = 1;
-#define CREATE_FREE stateOfCreate.createBusy = 0;
+// Serializes commands between threads (the odometry thread talks to the
+// Create too).  While streaming the input belongs to the stream thread,
+// don't flush it.  _create_owner lets create_write_byte tell whether its
+// caller holds the lock.
+#define CREATE_BUSY pthread_mutex_lock(&_create_mutex); _create_owner = pthread_self(); if(!stateOfCreate.streaming) serial_flush(); stateOfCreate.createBusy = 1;
+// a command's bytes go out together when it's done
+#define CREATE_FREE serial_send(); stateOfCreate.createBusy = 0; _create_owner = _create_no_owner; pthread_mutex_unlock(&_create_mutex);
 
 #define twopi 6.28318531
 
+// encoder counts per mm of wheel travel and mm between the wheels
+#define CREATE_TICS_PER_MM 7.8324283
+#define CREATE_WHEEL_BASE 258.0
+
 // in seconds
 #define COMM_TIMEOUT .5
 
+// sensor packet groups (0-6) cover packets 7-42, group 6 is all of them
+#define CREATE_MAX_PACKET 42
+#define CREATE_MAX_GROUP 6
+// largest reply create_sensor_query takes, group 6 is 52 bytes
+#define CREATE_QUERY_BYTES 255
+
 // structures used to track and cache Create data
 struct _sensor_packet{
         float lastUpdate; //cpu clock time
@@ -54,6 +70,7 @@ struct _sensor_packet{
 struct _create_state{
         int createConnected;
         int createBusy;
+        int streaming;//1 while a stream started with create_stream_start is being parsed
         int normalizedAngle;
         int totalAngle;
         int accumulatedDistance;//sum of the increment distances
@@ -101,6 +118,14 @@ struct _create_state{
         struct _sensor_packet requestedLVelocity;//packet 42; left wheel v -500 to 500
 } ;
 
+// Pose integrated from the wheel encoders by create_odometry_start
+struct create_pose{
+        float x;//mm, +x is where the Create faced when the pose was set to 0
+        float y;//mm, +y is to its left
+        float theta;//radians CCW, -pi to pi
+        float lastUpdate;//seconds() of the encoder reading
+};
+
 // This global is used by the user to store songs to be played on the Create
 // The functions create_load_song and create_play_song are used to get the data
 // from this global to the Create.  The user fills the global on their own.
@@ -174,6 +199,14 @@ void create_pwm_low_side_drivers(int pwm2, int pwm1, int pwm0);
 void create_low_side_drivers(int pwm2, int pwm1, int pwm0);
 void create_load_song(int num);
 void create_play_song(int num);
+int create_stream_start(int *packets, int count);
+void create_stream_stop();
+int create_sensor_query(int *packets, int count);
+int create_set_update_group(int group);
+int create_odometry_start(int period_ms);
+void create_odometry_stop();
+void create_get_pose(struct create_pose *pose);
+void create_set_pose(float x, float y, float theta);
 int create_read_block(char *data, int count);
 void create_write_byte(char byte);
 void create_clear_serial_buffer();
@@ -20,6 +20,30 @@
 
 #include "process.h"
 
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static int g_realtime_locked = 0;
+
+// With memory locked every page of a thread's stack is faulted in when
+// the thread starts, so don't give threads the default 8MB
+static void __thread_attr(pthread_attr_t *attr)
+{
+	pthread_attr_init(attr);
+	if(g_realtime_locked)
+		pthread_attr_setstacksize(attr, REALTIME_THREAD_STACK);
+}
+
 volatile struct __ptable_entry __process_table[MAX_PROCESSES];
 pthread_mutex_t __process_mutex = PTHREAD_MUTEX_INITIALIZER;
 volatile int __ptable_initted = 0;
@@ -36,7 +60,8 @@ void __init_ptable()
 
 int start_process(void (*func)())
 {
-	int i = -1;
+	pthread_attr_t attr;
+	int i = -1, error;
 
 	pthread_mutex_lock(&__process_mutex);
 
@@ -45,13 +70,20 @@ int start_process(void (*func)())
 
 	while(++i < MAX_PROCESSES && __process_table[i].in_use);
 	
-	if(i == MAX_PROCESSES)
+	if(i == MAX_PROCESSES) {
+		pthread_mutex_unlock(&__process_mutex);
 		return -1;
+	}
 
 	__process_table[i].in_use = 1;
 
-	if(pthread_create((pthread_t *)&(__process_table[i].thread), NULL, __run_process, (void *)func)) {
+	__thread_attr(&attr);
+	error = pthread_create((pthread_t *)&(__process_table[i].thread), &attr, __run_process, (void *)func);
+	pthread_attr_destroy(&attr);
+
+	if(error) {
 		__process_table[i].in_use = 0;
+		pthread_mutex_unlock(&__process_mutex);
 		return -1;
 	}
 
@@ -92,3 +124,388 @@ void *__run_process(void *ptr)
 	func();
 	return 0;
 }
+
+/* Periodic tasks
+ *
+ * Each task is a thread that sleeps until an absolute deadline on the
+ * monotonic clock, runs func and moves the deadline on by one period, so
+ * the rate doesn't drift with the time func takes.  A run that ends past
+ * the next deadline counts the periods it covered as misses and the task
+ * picks up at the next deadline still ahead.  Jitter is how late func
+ * started after its deadline.
+ */
+
+volatile struct __periodic_entry __periodic_table[MAX_PERIODIC];
+pthread_mutex_t __periodic_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// whole seconds and the rest separately, ms * 1000000 overflows a 32 bit
+// long past 2147ms
+static void __timespec_add_ms(struct timespec *t, int ms)
+{
+	t->tv_sec += ms / 1000;
+	t->tv_nsec += (ms % 1000) * 1000000L;
+	if(t->tv_nsec >= 1000000000L) {
+		t->tv_nsec -= 1000000000L;
+		t->tv_sec++;
+	}
+}
+
+static long __timespec_diff_us(struct timespec *a, struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000000L + (a->tv_nsec - b->tv_nsec) / 1000L;
+}
+
+void *__run_periodic(void *ptr)
+{
+	volatile struct __periodic_entry *task = ptr;
+	struct periodic_stats *stats = (struct periodic_stats *)&task->stats;
+	struct timespec deadline, now;
+	long late;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	__timespec_add_ms(&deadline, task->period_ms);
+
+	while(task->running) {
+		while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0) == EINTR);
+		if(!task->running)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		late = __timespec_diff_us(&now, &deadline);
+		if(late > stats->max_jitter_us)
+			stats->max_jitter_us = late;
+		stats->total_jitter_us += late;
+		stats->runs++;
+
+		task->func();
+
+		__timespec_add_ms(&deadline, task->period_ms);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		while(__timespec_diff_us(&now, &deadline) > 0) {
+			stats->misses++;
+			__timespec_add_ms(&deadline, task->period_ms);
+		}
+	}
+
+	return 0;
+}
+
+int run_periodic(void (*func)(), int period_ms, int priority)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	int i = -1, error;
+
+	if(period_ms < 1 || priority < 0 || priority >= sched_get_priority_max(SCHED_FIFO))
+		return -1;
+
+	pthread_mutex_lock(&__periodic_mutex);
+
+	while(++i < MAX_PERIODIC && __periodic_table[i].in_use);
+
+	if(i == MAX_PERIODIC) {
+		pthread_mutex_unlock(&__periodic_mutex);
+		return -1;
+	}
+
+	__periodic_table[i].in_use = 1;
+	__periodic_table[i].running = 1;
+	__periodic_table[i].func = func;
+	__periodic_table[i].period_ms = period_ms;
+	memset((void *)&__periodic_table[i].stats, 0, sizeof(struct periodic_stats));
+
+	__thread_attr(&attr);
+	if(priority > 0) {
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		param.sched_priority = priority;
+		pthread_attr_setschedparam(&attr, &param);
+	}
+
+	error = pthread_create((pthread_t *)&(__periodic_table[i].thread), &attr, __run_periodic, (void *)&__periodic_table[i]);
+	// not allowed to go real-time, run it at normal priority
+	if(error == EPERM) {
+		pthread_attr_destroy(&attr);
+		__thread_attr(&attr);
+		error = pthread_create((pthread_t *)&(__periodic_table[i].thread), &attr, __run_periodic, (void *)&__periodic_table[i]);
+	}
+	pthread_attr_destroy(&attr);
+
+	if(error) {
+		__periodic_table[i].in_use = 0;
+		pthread_mutex_unlock(&__periodic_mutex);
+		return -1;
+	}
+
+	pthread_mutex_unlock(&__periodic_mutex);
+
+	return i;
+}
+
+void stop_periodic(int task)
+{
+	pthread_t thread;
+
+	if(task < 0 || task >= MAX_PERIODIC)
+		return;
+
+	pthread_mutex_lock(&__periodic_mutex);
+	if(!__periodic_table[task].in_use || !__periodic_table[task].running) {
+		pthread_mutex_unlock(&__periodic_mutex);
+		return;
+	}
+	__periodic_table[task].running = 0;
+	thread = __periodic_table[task].thread;
+	pthread_mutex_unlock(&__periodic_mutex);
+
+	// the current run finishes and the thread leaves at its next deadline
+	pthread_join(thread, 0);
+
+	pthread_mutex_lock(&__periodic_mutex);
+	__periodic_table[task].in_use = 0;
+	pthread_mutex_unlock(&__periodic_mutex);
+}
+
+int get_periodic_stats(int task, struct periodic_stats *stats)
+{
+	if(task < 0 || task >= MAX_PERIODIC || !__periodic_table[task].in_use)
+		return -1;
+
+	memcpy(stats, (void *)&__periodic_table[task].stats, sizeof(struct periodic_stats));
+	return 0;
+}
+
+/* Real-time launch profile
+ *
+ * cbcui passes the profile set for the program in the environment and
+ * libcbc_init applies it before main:
+ *   CBC_RT_POLICY    fifo or rr, no profile without it
+ *   CBC_RT_PRIORITY  1-99
+ *   CBC_RT_CPU       cpu to pin the program to, -1 for any
+ *   CBC_RT_MLOCK     1 to lock memory and prefault the stack
+ * A real-time program that never sleeps would lock the GUI out, so a
+ * watchdog at the top priority puts it back to normal scheduling if it
+ * keeps the CPU for a whole REALTIME_WATCHDOG_MS.  The scheduling
+ * statistics are printed when the program exits or is stopped.
+ */
+
+static int g_realtime_policy = SCHED_OTHER;
+static int g_realtime_priority = 0;
+static int g_realtime_cpu = -1;
+static volatile int g_realtime_demoted = 0;
+
+static long long __rusage_cpu_us(struct rusage *usage)
+{
+	return (long long)(usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000000LL +
+		usage->ru_utime.tv_usec + usage->ru_stime.tv_usec;
+}
+
+static void __realtime_demote()
+{
+	struct sched_param param;
+	struct dirent *entry;
+	DIR *tasks;
+
+	param.sched_priority = 0;
+	if((tasks = opendir("/proc/self/task")) == 0) {
+		sched_setscheduler(0, SCHED_OTHER, &param);
+		return;
+	}
+	while((entry = readdir(tasks)) != 0) {
+		if(entry->d_name[0] != '.')
+			sched_setscheduler(atoi(entry->d_name), SCHED_OTHER, &param);
+	}
+	closedir(tasks);
+}
+
+static void *__realtime_watchdog(void *ptr)
+{
+	struct timespec period;
+	struct rusage usage;
+	long long before, used;
+
+	period.tv_sec = REALTIME_WATCHDOG_MS / 1000;
+	period.tv_nsec = (REALTIME_WATCHDOG_MS % 1000) * 1000000L;
+
+	getrusage(RUSAGE_SELF, &usage);
+	before = __rusage_cpu_us(&usage);
+	for(;;) {
+		nanosleep(&period, 0);
+		getrusage(RUSAGE_SELF, &usage);
+		used = __rusage_cpu_us(&usage) - before;
+		before += used;
+		// the rest of the system got less than a tenth of the CPU
+		if(used * 10 > REALTIME_WATCHDOG_MS * 1000LL * 9) {
+			g_realtime_demoted = 1;
+			__realtime_demote();
+			printf("Real-time: the program kept the CPU, back to normal scheduling\n");
+			return 0;
+		}
+	}
+}
+
+// stdio isn't safe in the SIGTERM handler, so the report formats by hand
+static char *__report_str(char *p, char *end, const char *str)
+{
+	while(*str && p < end)
+		*p++ = *str++;
+	return p;
+}
+
+static char *__report_num(char *p, char *end, long long num)
+{
+	char digits[20];
+	unsigned long long n = num < 0 ? -num : num;
+	int i = 0;
+
+	if(num < 0 && p < end)
+		*p++ = '-';
+	do {
+		digits[i++] = '0' + n % 10;
+		n /= 10;
+	} while(n);
+	while(i > 0 && p < end)
+		*p++ = digits[--i];
+	return p;
+}
+
+static const char *__report_parse(const char *str, unsigned long long *num)
+{
+	*num = 0;
+	while(*str == ' ')
+		str++;
+	while(*str >= '0' && *str <= '9')
+		*num = *num * 10 + (*str++ - '0');
+	return str;
+}
+
+// Only uses calls that are safe from the SIGTERM handler
+static void __realtime_report()
+{
+	unsigned long long run_ns = 0, wait_ns = 0, slices = 0;
+	struct periodic_stats *stats;
+	struct rusage usage;
+	char buf[768], *p = buf, *end = buf + sizeof(buf);
+	const char *str;
+	int fd, n, i;
+
+	if((fd = open("/proc/self/schedstat", O_RDONLY)) >= 0) {
+		if((n = read(fd, buf, sizeof(buf) - 1)) > 0) {
+			buf[n] = 0;
+			str = __report_parse(buf, &run_ns);
+			str = __report_parse(str, &wait_ns);
+			__report_parse(str, &slices);
+		}
+		close(fd);
+	}
+	getrusage(RUSAGE_SELF, &usage);
+
+	p = __report_str(p, end, "Real-time: ");
+	p = __report_str(p, end, g_realtime_policy == SCHED_RR ? "rr " : "fifo ");
+	p = __report_num(p, end, g_realtime_priority);
+	p = __report_str(p, end, g_realtime_locked ? ", memory locked" : "");
+	p = __report_str(p, end, g_realtime_demoted ? ", demoted\n" : "\n");
+	if(slices > 0) {
+		p = __report_str(p, end, " main thread ran ");
+		p = __report_num(p, end, run_ns / 1000000ULL);
+		p = __report_str(p, end, "ms, waited ");
+		p = __report_num(p, end, wait_ns / 1000ULL / slices);
+		p = __report_str(p, end, "us per run over ");
+		p = __report_num(p, end, slices);
+		p = __report_str(p, end, " runs\n");
+	}
+	p = __report_str(p, end, " page faults ");
+	p = __report_num(p, end, usage.ru_majflt + usage.ru_minflt);
+	p = __report_str(p, end, ", preempted ");
+	p = __report_num(p, end, usage.ru_nivcsw);
+	p = __report_str(p, end, " times\n");
+	for(i = 0;i < MAX_PERIODIC;i++) {
+		if(!__periodic_table[i].in_use)
+			continue;
+		stats = (struct periodic_stats *)&__periodic_table[i].stats;
+		p = __report_str(p, end, " task ");
+		p = __report_num(p, end, i);
+		p = __report_str(p, end, ": ");
+		p = __report_num(p, end, stats->runs);
+		p = __report_str(p, end, " runs, ");
+		p = __report_num(p, end, stats->misses);
+		p = __report_str(p, end, " misses, jitter max ");
+		p = __report_num(p, end, stats->max_jitter_us);
+		p = __report_str(p, end, "us mean ");
+		p = __report_num(p, end, stats->runs ? (long long)(stats->total_jitter_us / stats->runs) : 0);
+		p = __report_str(p, end, "us\n");
+	}
+	write(1, buf, p - buf);
+}
+
+static void __realtime_stopped(int sig)
+{
+	__realtime_report();
+	_exit(128 + sig);
+}
+
+// keep the stack pages the program will use resident from the start
+static void __realtime_prefault_stack()
+{
+	char stack[REALTIME_PREFAULT_STACK];
+	volatile char *page = stack;
+	int i;
+
+	// through a volatile pointer so the compiler can't drop the stores
+	for(i = 0;i < REALTIME_PREFAULT_STACK;i += 1024)
+		page[i] = 0;
+}
+
+void __realtime_init()
+{
+	struct sched_param param;
+	pthread_attr_t attr;
+	pthread_t watchdog;
+	char *value;
+
+	if((value = getenv("CBC_RT_POLICY")) == 0)
+		return;
+	g_realtime_policy = strcmp(value, "rr") ? SCHED_FIFO : SCHED_RR;
+	g_realtime_priority = (value = getenv("CBC_RT_PRIORITY")) ? atoi(value) : REALTIME_DEFAULT_PRIORITY;
+	if(g_realtime_priority < 1 || g_realtime_priority >= sched_get_priority_max(g_realtime_policy))
+		g_realtime_priority = REALTIME_DEFAULT_PRIORITY;
+	g_realtime_cpu = (value = getenv("CBC_RT_CPU")) ? atoi(value) : -1;
+
+	if((value = getenv("CBC_RT_MLOCK")) && atoi(value)) {
+		if(mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+			g_realtime_locked = 1;
+			__realtime_prefault_stack();
+		}
+		else
+			printf("Real-time: can't lock memory (%s)\n", strerror(errno));
+	}
+
+#ifdef CPU_SET
+	if(g_realtime_cpu >= 0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(g_realtime_cpu, &cpus);
+		if(sched_setaffinity(0, sizeof(cpus), &cpus))
+			printf("Real-time: can't run on cpu %d (%s)\n", g_realtime_cpu, strerror(errno));
+	}
+#endif
+
+	param.sched_priority = g_realtime_priority;
+	if(sched_setscheduler(0, g_realtime_policy, &param)) {
+		printf("Real-time: can't set priority %d (%s)\n", g_realtime_priority, strerror(errno));
+		return;
+	}
+
+	// the watchdog has to be able to preempt the program
+	__thread_attr(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+	pthread_attr_setschedparam(&attr, &param);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_create(&watchdog, &attr, __realtime_watchdog, 0);
+	pthread_attr_destroy(&attr);
+
+	signal(SIGTERM, __realtime_stopped);
+	atexit(__realtime_report);
+}
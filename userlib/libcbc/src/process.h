@@ -30,18 +30,52 @@ extern "C" {
 #define MAX_PROCESSES 16
 #define MAX_MUTEXES 8
 
+#define MAX_PERIODIC 8
+
+// real-time launch profile, see __realtime_init
+#define REALTIME_DEFAULT_PRIORITY 20
+#define REALTIME_WATCHDOG_MS 1000
+#define REALTIME_PREFAULT_STACK (64*1024)
+#define REALTIME_THREAD_STACK (256*1024)
+
 int  start_process(void (*func)());
 void kill_process(int pid);
 int is_process_running(int pid);
 
+struct periodic_stats {
+	unsigned long runs;
+	unsigned long misses;        // deadlines passed while func was still running
+	long max_jitter_us;          // latest start after a deadline
+	long long total_jitter_us;   // divide by runs for the mean
+};
+
+// Calls func every period_ms until stop_periodic.  priority 1-98 runs it
+// SCHED_FIFO below the real-time watchdog when the program may, 0 at
+// normal priority.  Returns the task number or -1.
+int run_periodic(void (*func)(), int period_ms, int priority);
+// Returns once the task is done, at the latest by its next deadline
+void stop_periodic(int task);
+int get_periodic_stats(int task, struct periodic_stats *stats);
+
 void *__run_process(void *ptr);
 void __init_ptable();
+void *__run_periodic(void *ptr);
+void __realtime_init();
 
 struct __ptable_entry {
 	pthread_t thread;
 	int in_use;
 };
 
+struct __periodic_entry {
+	pthread_t thread;
+	void (*func)();
+	int period_ms;
+	int in_use;
+	int running;
+	struct periodic_stats stats;
+};
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,805 @@
+/**************************************************************************
+ *  Copyright 2008,2009 KISS Institute for Practical Robotics             *
+ *                                                                        *
+ *  This file is part of CBC Firmware.                                    *
+ *                                                                        *
+ *  CBC Firmware is free software: you can redistribute it and/or modify  *
+ *  it under the terms of the GNU General Public License as published by  *
+ *  the Free Software Foundation, either version 2 of the License, or     *
+ *  (at your option) any later version.                                   *
+ *                                                                        *
+ *  CBC Firmware is distributed in the hope that it will be useful,       *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *  GNU General Public License for more details.                          *
+ *                                                                        *
+ *  You should have received a copy of the GNU General Public License     *
+ *  along with this copy of CBC Firmware.  Check the LICENSE file         *
+ *  in the project root.  If not, see <http://www.gnu.org/licenses/>.     *
+ **************************************************************************/
+
+// Simulated BoB
+//
+// Runs the commands from kernel/cbob/cbob_cmd.h against a model of the
+// board: sensor values come from the CBOB_SIM_INPUT file, motors are a
+// first order model driven by pwm, velocity or position commands, servos
+// just remember where they were sent.  Every message sleeps for the time
+// the real link would take, see README.
+
+#include "bob_sim.h"
+#include "../../kernel/cbob/cbob_cmd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define SIM_MOTOR_MAX_SPEED 1000.0 // ticks/s at full pwm
+#define SIM_MOTOR_TAU       0.05   // s, time constant of the speed response
+
+#define SIM_MOTOR_PWM      0
+#define SIM_MOTOR_VELOCITY 1
+#define SIM_MOTOR_POSITION 2
+#define SIM_MOTOR_PROFILE  3
+
+struct sim_motor {
+  int mode;
+  int pwm;           // -100..100
+  int velocity;      // ticks/s, target in velocity and position modes
+  int goal;          // target in position mode
+  double speed;      // ticks/s
+  double position;   // ticks
+  short gains[6];
+  int accel;         // ticks/s^2, profiled moves
+  int jerk;          // ticks/s^3, kept for GET only, the model ramps like a trapezoid
+};
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_initted = 0;
+
+static struct sensor_data g_sensors;
+static short g_inputs;          // digital input levels, bits 0-7
+static short g_outputs;         // digital output levels, bits 0-7
+static short g_digitalConfig;   // 1 = output
+static short g_button;
+static short g_accelCal[3];
+// CBOB_FILTER_* type and size for analogs 0-7, the battery and accel x y z.
+// Inputs only change when the input file does, so nothing is filtered.
+static short g_filter[12][2];
+static short g_motorCal[4];
+static short g_servo[4];
+static struct sim_motor g_motor[4];
+static double g_lastUpdate;
+static double g_start;          // for the STATE_READ stamp
+static short g_pidPeriod = 10000; // us, the model doesn't depend on it
+static int g_uartBaud = 57600;    // uart 1, nothing is attached
+
+// Edge capture, edges are seen when a message notices the inputs changed
+#define SIM_CAPTURE_LOG 128
+static short g_captureEdges[8];
+static int g_captureCount[8];
+static short g_captureLog[SIM_CAPTURE_LOG][3];
+static int g_captureHead, g_captureTail, g_captureDropped;
+static int g_captureLast;
+
+// Analog streaming, frames due since the last message are sampled at once
+#define SIM_STREAM_RING 2048
+static short g_streamRing[SIM_STREAM_RING];
+static int g_streamHead, g_streamTail, g_streamDropped, g_streamOverflow;
+static int g_streamMask, g_streamPorts, g_streamRate;
+static unsigned int g_streamIndex, g_streamFirst;
+static double g_streamStart;
+
+// Link latency, see README
+static long g_phaseUs = 1600;
+static long g_wordUs = 0;
+
+static const char *g_inputFile = 0;
+static time_t g_inputMtime = 0;
+
+// Stats printed at exit with CBOB_SIM_STATS=1
+static unsigned long g_messages[32];
+static double g_busy;
+static int g_stats = 0;
+
+static double sim_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static void sim_sleep_us(long us)
+{
+  struct timespec ts;
+
+  if(us <= 0) return;
+  ts.tv_sec = us/1000000;
+  ts.tv_nsec = (us%1000000)*1000;
+  while(nanosleep(&ts, &ts) != 0);
+}
+
+static void sim_gains_default(int motor)
+{
+  short gains[6] = {3, 3, -2, 1, 2, 3};
+
+  memcpy(g_motor[motor].gains, gains, sizeof(gains));
+}
+
+// Lines of "<name> <value>", names are the struct sensor_data fields plus
+// digital0..7 and button.  Reread whenever the file changes.
+static void sim_read_input()
+{
+  struct stat st;
+  char name[32];
+  int value, port;
+  FILE *f;
+
+  if(!g_inputFile || stat(g_inputFile, &st) != 0 || st.st_mtime == g_inputMtime)
+    return;
+  g_inputMtime = st.st_mtime;
+
+  f = fopen(g_inputFile, "r");
+  if(!f) return;
+
+  while(fscanf(f, "%31s %d", name, &value) == 2) {
+    if(sscanf(name, "analog%d", &port) == 1 && port >= 0 && port < 8)
+      g_sensors.analog[port] = value;
+    else if(sscanf(name, "digital%d", &port) == 1 && port >= 0 && port < 8) {
+      if(value) g_inputs |= 1<<port;
+      else g_inputs &= ~(1<<port);
+    }
+    else if(!strcmp(name, "button"))
+      g_button = value ? 1 : 0;
+    else if(!strcmp(name, "battery"))
+      g_sensors.battery = value;
+    else if(!strcmp(name, "accel_x"))
+      g_sensors.accel_x = value;
+    else if(!strcmp(name, "accel_y"))
+      g_sensors.accel_y = value;
+    else if(!strcmp(name, "accel_z"))
+      g_sensors.accel_z = value;
+  }
+  fclose(f);
+}
+
+static void sim_update_motors()
+{
+  struct sim_motor *m;
+  double now = sim_now(), dt = now - g_lastUpdate;
+  double target, k, step;
+  int i;
+
+  g_lastUpdate = now;
+  k = dt/SIM_MOTOR_TAU;
+  if(k > 1) k = 1;
+
+  for(i = 0;i < 4;i++) {
+    m = &g_motor[i];
+
+    if(m->mode == SIM_MOTOR_POSITION) {
+      step = m->goal - m->position;
+      // arrived, or would get there within this step
+      if(step == 0 || abs(m->velocity)*dt >= (step > 0 ? step : -step)) {
+        m->position = m->goal;
+        m->speed = 0;
+        m->pwm = 0;
+        m->mode = SIM_MOTOR_PWM;
+        continue;
+      }
+      target = step > 0 ? abs(m->velocity) : -abs(m->velocity);
+    }
+    else if(m->mode == SIM_MOTOR_PROFILE) {
+      step = m->goal - m->position;
+      // arrived, or would get there within this step
+      if(fabs(step) < 1 || (m->speed*step > 0 && fabs(m->speed)*dt >= fabs(step))) {
+        m->position = m->goal;
+        m->speed = 0;
+        m->pwm = 0;
+        m->mode = SIM_MOTOR_PWM;
+        continue;
+      }
+      // as fast as still lets it stop at the goal, changing by at most accel
+      target = sqrt(2*m->accel*fabs(step));
+      if(target > abs(m->velocity)) target = abs(m->velocity);
+      if(step < 0) target = -target;
+      if(target > m->speed + m->accel*dt) target = m->speed + m->accel*dt;
+      if(target < m->speed - m->accel*dt) target = m->speed - m->accel*dt;
+      if(target > SIM_MOTOR_MAX_SPEED) target = SIM_MOTOR_MAX_SPEED;
+      if(target < -SIM_MOTOR_MAX_SPEED) target = -SIM_MOTOR_MAX_SPEED;
+      m->pwm = (int)(target*100/SIM_MOTOR_MAX_SPEED);
+      m->speed = target;
+      m->position += m->speed*dt;
+      continue;
+    }
+    else if(m->mode == SIM_MOTOR_VELOCITY)
+      target = m->velocity;
+    else
+      target = m->pwm*SIM_MOTOR_MAX_SPEED/100;
+
+    if(target > SIM_MOTOR_MAX_SPEED) target = SIM_MOTOR_MAX_SPEED;
+    if(target < -SIM_MOTOR_MAX_SPEED) target = -SIM_MOTOR_MAX_SPEED;
+    if(m->mode != SIM_MOTOR_PWM)
+      m->pwm = (int)(target*100/SIM_MOTOR_MAX_SPEED);
+
+    m->speed += (target - m->speed)*k;
+    m->position += m->speed*dt;
+  }
+}
+
+static int sim_all_digitals()
+{
+  return ((g_outputs & g_digitalConfig) | (g_inputs & ~g_digitalConfig)) & 0xff;
+}
+
+static void sim_capture(int digitals)
+{
+  unsigned int stamp;
+  int i, level, next;
+
+  stamp = (unsigned int)((sim_now() - g_start)*1000000);
+  for(i = 0;i < 8;i++) {
+    if(!((digitals ^ g_captureLast) & (1<<i)))
+      continue;
+    level = (digitals >> i) & 1;
+    if(!(g_captureEdges[i] & (level ? CBOB_CAPTURE_RISING : CBOB_CAPTURE_FALLING)))
+      continue;
+    g_captureCount[i]++;
+    next = (g_captureHead + 1) % SIM_CAPTURE_LOG;
+    if(next == g_captureTail) {
+      g_captureDropped++;
+      continue;
+    }
+    memcpy(g_captureLog[g_captureHead], &stamp, 4);
+    g_captureLog[g_captureHead][2] = i | (level<<8);
+    g_captureHead = next;
+  }
+  g_captureLast = digitals;
+}
+
+static void sim_stream_start(int mask, int rate)
+{
+  int i;
+
+  g_streamMask = mask & 0xff;
+  if(rate < 100) rate = 100;
+  if(rate > 10000) rate = 10000;
+  g_streamRate = g_streamMask ? rate : 0;
+  g_streamPorts = 0;
+  for(i = 0;i < 8;i++)
+    if(g_streamMask & (1<<i)) g_streamPorts++;
+  g_streamHead = g_streamTail = g_streamDropped = g_streamOverflow = 0;
+  g_streamIndex = g_streamFirst = 0;
+  g_streamStart = sim_now();
+}
+
+// same ring rules as ISR_AnalogStream
+static void sim_stream_update()
+{
+  unsigned int due;
+  int i, used;
+
+  if(!g_streamMask) return;
+
+  due = (unsigned int)((sim_now() - g_streamStart)*g_streamRate);
+  while(g_streamIndex < due) {
+    g_streamIndex++;
+    if(g_streamHead == g_streamTail) {
+      g_streamFirst = g_streamIndex - 1;
+      g_streamOverflow = 0;
+    }
+    used = (g_streamHead - g_streamTail + SIM_STREAM_RING) % SIM_STREAM_RING;
+    if(g_streamOverflow || used + g_streamPorts >= SIM_STREAM_RING) {
+      g_streamOverflow = 1;
+      g_streamDropped++;
+      continue;
+    }
+    for(i = 0;i < 8;i++) {
+      if(g_streamMask & (1<<i)) {
+        g_streamRing[g_streamHead] = g_sensors.analog[i];
+        g_streamHead = (g_streamHead + 1) % SIM_STREAM_RING;
+      }
+    }
+  }
+}
+
+// data is (sub, index, type, size), sets the filters from first to
+// first+n-1 (index -1 for all of them) with the firmware's limits and
+// replies with the settings used
+static void sim_filter_set(int first, int n, short *data)
+{
+  short index = data[1], type = data[2], size = data[3], max = 0;
+  int i;
+
+  if(type == CBOB_FILTER_AVERAGE) max = 40;
+  else if(type == CBOB_FILTER_MEDIAN) max = 9;
+  else if(type == CBOB_FILTER_IIR) max = 8;
+  else type = CBOB_FILTER_NONE;
+  if(size > max) size = max;
+  if(type != CBOB_FILTER_NONE && size < 1) size = 1;
+
+  for(i = 0;i < n;i++) {
+    if(index == -1 || index == i) {
+      g_filter[first+i][0] = type;
+      g_filter[first+i][1] = size;
+    }
+  }
+  if(index < 0 || index >= n) index = 0;
+  memcpy(&(data[1]), g_filter[first+index], sizeof(g_filter[0]));
+}
+
+static void sim_fill_sensors()
+{
+  sim_read_input();
+  g_sensors.digitals = sim_all_digitals() | (g_button<<8);
+  sim_capture(g_sensors.digitals);
+}
+
+void bob_sim_init()
+{
+  char *env;
+  int i;
+
+  pthread_mutex_lock(&g_lock);
+  if(g_initted) {
+    pthread_mutex_unlock(&g_lock);
+    return;
+  }
+  g_initted = 1;
+
+  if((env = getenv("CBOB_SIM_PHASE_US"))) g_phaseUs = atol(env);
+  if((env = getenv("CBOB_SIM_WORD_US"))) g_wordUs = atol(env);
+  if((env = getenv("CBOB_SIM_STATS"))) g_stats = atoi(env);
+  g_inputFile = getenv("CBOB_SIM_INPUT");
+
+  for(i = 0;i < 8;i++)
+    g_sensors.analog[i] = 1023; // nothing plugged in
+  g_sensors.battery = 7400;
+  g_filter[8][0] = CBOB_FILTER_AVERAGE;
+  g_filter[8][1] = 40;
+  g_sensors.pullups = 0xff;
+  for(i = 0;i < 4;i++) {
+    sim_gains_default(i);
+    g_servo[i] = 1024;
+  }
+  g_lastUpdate = g_start = sim_now();
+
+  sim_read_input();
+  pthread_mutex_unlock(&g_lock);
+}
+
+static short sim_exec_cmd(short cmd, short *data, short length);
+
+// Same framing as ChumbyExecBatch
+static short sim_exec_batch(short *data, short length)
+{
+  short in[BOB_SIM_MAX_DATA_COUNT];
+  short out[BOB_SIM_MAX_DATA_COUNT];
+  short cmd, count, replies;
+  int i, n, outcount = 0;
+
+  if(length < 1 || length > BOB_SIM_MAX_DATA_COUNT)
+    return 0;
+  memcpy(in, data, length*sizeof(short));
+
+  n = in[0];
+  for(i = 1;n > 0 && i+2 <= length;n--) {
+    cmd = in[i];
+    count = in[i+1];
+    i += 2;
+    if(cmd == CBOB_CMD_BATCH || count < 0 || i+count > length)
+      break;
+
+    memcpy(data, &(in[i]), count*sizeof(short));
+    i += count;
+
+    replies = sim_exec_cmd(cmd, data, count);
+    if(outcount+1+replies > BOB_SIM_MAX_DATA_COUNT-2)
+      break;
+    out[outcount++] = replies;
+    memcpy(&(out[outcount]), &(data[1]), replies*sizeof(short));
+    outcount += replies;
+  }
+
+  memcpy(&(data[1]), out, outcount*sizeof(short));
+  return outcount;
+}
+
+// data[0..length) holds the arguments, replies go in data[1..] like
+// g_ChumbyData
+static short sim_exec_cmd(short cmd, short *data, short length)
+{
+  struct sim_motor *m;
+  int tmp, i, outcount = 0;
+  unsigned int utmp;
+
+  sim_update_motors();
+  sim_fill_sensors();
+  sim_stream_update();
+
+  switch(cmd) {
+  case CBOB_CMD_DIGITAL_READ:
+    if(data[0] >= 0 && data[0] <= 7)
+      data[1] = (sim_all_digitals()>>data[0]) & 1;
+    else if(data[0] == 8)
+      data[1] = g_button;
+    else
+      data[1] = g_sensors.digitals;
+    outcount = 1;
+    break;
+  case CBOB_CMD_DIGITAL_WRITE:
+    if(data[0] >= 0 && data[0] <= 7) {
+      if(data[1]) g_outputs |= 1<<data[0];
+      else g_outputs &= ~(1<<data[0]);
+    }
+    break;
+  case CBOB_CMD_DIGITAL_CONFIG:
+    if(data[0] == 0)
+      g_digitalConfig = data[1];
+    else if(data[0] == 1) {
+      data[1] = g_digitalConfig;
+      outcount = 1;
+    }
+    break;
+  case CBOB_CMD_ANALOG_READ:
+    if(data[0] >= 0 && data[0] < 8) {
+      data[1] = g_sensors.analog[data[0]];
+      outcount = 1;
+    }
+    else if(data[0] == 8) {
+      data[1] = g_sensors.battery;
+      outcount = 1;
+    }
+    else {
+      memcpy(&(data[1]), g_sensors.analog, sizeof(g_sensors.analog));
+      data[9] = g_sensors.battery;
+      outcount = 9;
+    }
+    break;
+  case CBOB_CMD_ANALOG_CONFIG:
+    if(data[0] == 0)
+      g_sensors.pullups = data[1];
+    else if(data[0] == 1) {
+      data[1] = g_sensors.pullups;
+      outcount = 1;
+    }
+    else if(data[0] == 2) {
+      // port 8 is the battery, -1 means analogs 0-7
+      if(data[1] == 8) {
+        data[1] = 0;
+        sim_filter_set(8, 1, data);
+      }
+      else
+        sim_filter_set(0, 8, data);
+      outcount = 2;
+    }
+    else if(data[0] == 3) {
+      memcpy(&(data[1]), g_filter[(data[1] >= 0 && data[1] <= 8) ? data[1] : 0], sizeof(g_filter[0]));
+      outcount = 2;
+    }
+    break;
+  case CBOB_CMD_ACCEL_READ:
+    if(data[0] >= 0 && data[0] <= 2) {
+      data[1] = (&g_sensors.accel_x)[data[0]];
+      outcount = 1;
+    }
+    else {
+      data[1] = g_sensors.accel_x;
+      data[2] = g_sensors.accel_y;
+      data[3] = g_sensors.accel_z;
+      outcount = 3;
+    }
+    break;
+  case CBOB_CMD_ACCEL_CONFIG:
+    if(data[0] == 1) {
+      memcpy(&(data[1]), g_accelCal, sizeof(g_accelCal));
+      outcount = 3;
+    }
+    else if(data[0] == 2)
+      memcpy(g_accelCal, &(data[1]), sizeof(g_accelCal));
+    else if(data[0] == 3) {
+      sim_filter_set(9, 3, data);
+      outcount = 2;
+    }
+    else if(data[0] == 4) {
+      memcpy(&(data[1]), g_filter[9 + ((data[1] >= 0 && data[1] <= 2) ? data[1] : 0)], sizeof(g_filter[0]));
+      outcount = 2;
+    }
+    break;
+  case CBOB_CMD_SENSORS_READ:
+    memcpy(&(data[1]), &g_sensors, sizeof(g_sensors));
+    outcount = SENSOR_DATA_COUNT;
+    break;
+  case CBOB_CMD_PWM_READ:
+    if(data[0] >= 0 && data[0] < 4) {
+      data[1] = g_motor[data[0]].pwm;
+      outcount = 1;
+    }
+    else {
+      for(i = 0;i < 4;i++)
+        data[i+1] = g_motor[i].pwm;
+      outcount = 4;
+    }
+    break;
+  case CBOB_CMD_PWM_WRITE:
+    for(i = 0;i < 4;i++) {
+      if(data[0] <= 3 && i != data[0])
+        continue;
+      m = &g_motor[i];
+      m->mode = SIM_MOTOR_PWM;
+      m->pwm = data[0] <= 3 ? data[1] : data[i+1];
+      if(m->pwm > 100) m->pwm = 100;
+      if(m->pwm < -100) m->pwm = -100;
+    }
+    break;
+  case CBOB_CMD_PID_READ:
+    if(data[0] >= 0 && data[0] <= 3) {
+      tmp = (int)g_motor[data[0]].position;
+      memcpy(&(data[1]), &tmp, 4);
+      outcount = 2;
+    }
+    else {
+      for(i = 0;i < 4;i++) {
+        tmp = (int)g_motor[i].position;
+        memcpy(&(data[1+2*i]), &tmp, 4);
+      }
+      outcount = 8;
+    }
+    break;
+  case CBOB_CMD_PID_WRITE:
+    if(data[0] >= 0 && data[0] < 4) {
+      m = &g_motor[data[0]];
+      m->velocity = data[1];
+      if(length > 2) {
+        memcpy(&tmp, &(data[2]), 4);
+        m->goal = tmp;
+        m->mode = SIM_MOTOR_POSITION;
+      }
+      else
+        m->mode = SIM_MOTOR_VELOCITY;
+    }
+    break;
+  case CBOB_CMD_PID_CONFIG:
+    if(data[1] >= 0 && data[1] <= 3)
+      m = &g_motor[data[1]];
+    else
+      m = 0;
+    if(data[0] == 0 && m)
+      m->position = 0;
+    else if(data[0] == 1 && m) {
+      memcpy(&tmp, &(data[2]), 4);
+      m->position = tmp;
+    }
+    else if(data[0] == 2 && m)
+      memcpy(m->gains, &(data[2]), sizeof(m->gains));
+    else if(data[0] == 3 && m) {
+      memcpy(&(data[1]), m->gains, sizeof(m->gains));
+      data[7] = 0;
+      outcount = 7;
+    }
+    else if(data[0] == 4 && m) {
+      data[1] = m->mode != SIM_MOTOR_POSITION && m->mode != SIM_MOTOR_PROFILE;
+      outcount = 1;
+    }
+    else if(data[0] == 5 && m)
+      sim_gains_default(data[1]);
+    else if(data[0] == 7) {
+      memcpy(&(data[1]), g_motorCal, sizeof(g_motorCal));
+      outcount = 4;
+    }
+    else if(data[0] == 8)
+      memcpy(g_motorCal, &(data[1]), sizeof(g_motorCal));
+    else if(data[0] == 9 || data[0] == 10) {
+      // same limits as SetMotorPeriod
+      if(data[0] == 9)
+        g_pidPeriod = data[1] < 2000 ? 2000 : data[1] > 30000 ? 30000 : data[1];
+      data[1] = g_pidPeriod;
+      outcount = 1;
+    }
+    else if(data[0] == 11 && m) {
+      memcpy(&tmp, &(data[2]), 4);
+      m->accel = abs(tmp);
+      memcpy(&tmp, &(data[4]), 4);
+      m->jerk = abs(tmp);
+    }
+    else if(data[0] == 12 && m) {
+      memcpy(&(data[1]), &m->accel, 4);
+      memcpy(&(data[3]), &m->jerk, 4);
+      outcount = 4;
+    }
+    else if(data[0] == 13 && m) {
+      m->velocity = data[2];
+      memcpy(&tmp, &(data[3]), 4);
+      m->goal = tmp;
+      m->mode = m->accel ? SIM_MOTOR_PROFILE : SIM_MOTOR_POSITION;
+    }
+    break;
+  case CBOB_CMD_SERVO_READ:
+    if(data[0] >= 0 && data[0] < 4) {
+      data[1] = g_servo[data[0]];
+      outcount = 1;
+    }
+    else {
+      memcpy(&(data[1]), g_servo, sizeof(g_servo));
+      outcount = 4;
+    }
+    break;
+  case CBOB_CMD_SERVO_WRITE:
+    if(data[0] >= 0 && data[0] < 4)
+      g_servo[data[0]] = data[1];
+    break;
+  case CBOB_CMD_UART_READ:
+    // no serial devices on the simulated board
+    data[1] = 0;
+    outcount = 2;
+    break;
+  case CBOB_CMD_UART_WRITE:
+    outcount = 1;
+    break;
+  case CBOB_CMD_UART_CONFIG:
+    if(data[0] == 0) {
+      memcpy(&tmp, &(data[2]), 4);
+      if(data[1] == 1) {
+        if(tmp < 1200) tmp = 1200;
+        if(tmp > 230400) tmp = 230400;
+        g_uartBaud = tmp;
+      }
+      else
+        tmp = 0;
+      memcpy(&(data[1]), &tmp, 4);
+      outcount = 2;
+    }
+    else if(data[0] == 1) {
+      // nothing goes out, so the TX ring is always empty
+      data[3] = data[1] == 1 ? 2047 : 0;
+      data[4] = 0;
+      tmp = data[1] == 1 ? g_uartBaud : 0;
+      memcpy(&(data[1]), &tmp, 4);
+      outcount = 4;
+    }
+    break;
+  case CBOB_CMD_STATUS_READ:
+    data[1] = BOB_SIM_VERSION;
+    outcount = 1;
+    break;
+  case CBOB_CMD_BATCH:
+    outcount = sim_exec_batch(data, length);
+    break;
+  case CBOB_CMD_STATE_READ:
+    // same layout as ChumbyPackState
+    data[1] = CBOB_STATE_READ_VERSION;
+    data[2] = CBOB_STATE_READ_COUNT;
+    utmp = (unsigned int)((sim_now() - g_start)*1000);
+    memcpy(&(data[3]), &utmp, 4);
+    memcpy(&(data[5]), &g_sensors, sizeof(g_sensors));
+    data[39] = 0;
+    for(i = 0;i < 4;i++) {
+      m = &g_motor[i];
+      tmp = (int)m->position;
+      memcpy(&(data[19+2*i]), &tmp, 4);
+      data[27+i] = (short)(m->speed*0.01); // ticks per 10ms PID period
+      data[31+i] = m->pwm;
+      data[35+i] = g_servo[i];
+      if(m->mode == SIM_MOTOR_POSITION || m->mode == SIM_MOTOR_PROFILE)
+        data[39] |= 1<<i;
+    }
+    data[40] = 0;
+    outcount = CBOB_STATE_READ_COUNT;
+    break;
+  case CBOB_CMD_CAPTURE_READ:
+    tmp = data[0];
+    if(tmp < 0 || tmp > CBOB_CAPTURE_READ_MAX) tmp = CBOB_CAPTURE_READ_MAX;
+    data[2] = g_captureDropped;
+    g_captureDropped = 0;
+    for(i = 0;i < tmp && g_captureTail != g_captureHead;i++) {
+      memcpy(&(data[3+3*i]), g_captureLog[g_captureTail], 3*sizeof(short));
+      g_captureTail = (g_captureTail + 1) % SIM_CAPTURE_LOG;
+    }
+    data[1] = i;
+    outcount = 2 + 3*i;
+    break;
+  case CBOB_CMD_STREAM_READ:
+    tmp = data[0];
+    if(tmp < 0 || tmp > CBOB_STREAM_READ_MAX) tmp = CBOB_STREAM_READ_MAX;
+    data[2] = g_streamDropped;
+    g_streamDropped = 0;
+    memcpy(&(data[3]), &g_streamFirst, 4);
+    i = 0;
+    if(g_streamPorts) {
+      tmp -= tmp % g_streamPorts;
+      for(;i < tmp && g_streamTail != g_streamHead;i++) {
+        data[5+i] = g_streamRing[g_streamTail];
+        g_streamTail = (g_streamTail + 1) % SIM_STREAM_RING;
+      }
+      g_streamFirst += i/g_streamPorts;
+    }
+    data[1] = i;
+    outcount = 4 + i;
+    break;
+  case CBOB_CMD_STREAM_CONFIG:
+    if(data[0] == 0) {
+      sim_stream_start(data[1], data[2]);
+      data[1] = g_streamRate;
+      outcount = 1;
+    }
+    else if(data[0] == 1) {
+      data[1] = g_streamMask;
+      data[2] = g_streamRate;
+      outcount = 2;
+    }
+    break;
+  case CBOB_CMD_CAPTURE_CONFIG:
+    if(data[1] < -1 || data[1] > 7)
+      break;
+    if(data[0] == 0 && data[1] >= 0)
+      g_captureEdges[data[1]] = data[2] & CBOB_CAPTURE_BOTH;
+    else if(data[0] == 1 && data[1] >= 0) {
+      data[1] = g_captureEdges[data[1]];
+      outcount = 1;
+    }
+    else if(data[0] == 2 && data[1] >= 0) {
+      memcpy(&(data[1]), &(g_captureCount[data[1]]), 4);
+      outcount = 2;
+    }
+    else if(data[0] == 3) {
+      for(i = 0;i < 8;i++)
+        if(data[1] == -1 || data[1] == i)
+          g_captureCount[i] = 0;
+    }
+    break;
+  }
+  return outcount;
+}
+
+int bob_sim_message(short cmd, short *outbuf, short outcount, short *inbuf, short incount)
+{
+  short data[BOB_SIM_MAX_DATA_COUNT];
+  short replies;
+  long us;
+
+  bob_sim_init();
+
+  if(outcount > BOB_SIM_MAX_DATA_COUNT)
+    outcount = BOB_SIM_MAX_DATA_COUNT;
+  memset(data, 0, sizeof(data));
+  if(outcount > 0)
+    memcpy(data, outbuf, outcount*sizeof(short));
+
+  // one bus, callers queue behind each other like they do in the driver
+  pthread_mutex_lock(&g_lock);
+  replies = sim_exec_cmd(cmd, data, outcount > 0 ? outcount : 1);
+  if(replies < 1)
+    replies = 1; // ChumbySetStateWriteLen never sends less than one word
+
+  // header, data, length and reply phases
+  us = 4*g_phaseUs + (3 + (outcount > 0 ? outcount : 1) + 2 + replies)*g_wordUs;
+  sim_sleep_us(us);
+
+  if(cmd >= 0 && cmd < 32)
+    g_messages[cmd]++;
+  g_busy += us/1e6;
+  pthread_mutex_unlock(&g_lock);
+
+  if(inbuf && incount > 0)
+    memcpy(inbuf, &(data[1]), (incount < replies ? incount : replies)*sizeof(short));
+
+  return replies;
+}
+
+static void bob_sim_exit() __attribute__((destructor));
+static void bob_sim_exit()
+{
+  int i;
+
+  if(!g_stats)
+    return;
+
+  fprintf(stderr, "cbob_sim: %.3f s on the link\n", g_busy);
+  for(i = 0;i < 32;i++)
+    if(g_messages[i])
+      fprintf(stderr, "cbob_sim: cmd %d x %lu\n", i, g_messages[i]);
+}
@@ -0,0 +1,39 @@
+/**************************************************************************
+ *  Copyright 2008,2009 KISS Institute for Practical Robotics             *
+ *                                                                        *
+ *  This file is part of CBC Firmware.                                    *
+ *                                                                        *
+ *  CBC Firmware is free software: you can redistribute it and/or modify  *
+ *  it under the terms of the GNU General Public License as published by  *
+ *  the Free Software Foundation, either version 2 of the License, or     *
+ *  (at your option) any later version.                                   *
+ *                                                                        *
+ *  CBC Firmware is distributed in the hope that it will be useful,       *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *  GNU General Public License for more details.                          *
+ *                                                                        *
+ *  You should have received a copy of the GNU General Public License     *
+ *  along with this copy of CBC Firmware.  Check the LICENSE file         *
+ *  in the project root.  If not, see <http://www.gnu.org/licenses/>.     *
+ **************************************************************************/
+
+#ifndef __BOB_SIM_H__
+#define __BOB_SIM_H__
+
+#include "../../kernel/cbob/sensor_data.h"
+
+// Matches CHUMBY_MAX_DATA_COUNT in the firmware
+#define BOB_SIM_MAX_DATA_COUNT 128
+
+// Matches CBOB_VERSION in bob.h
+#define BOB_SIM_VERSION 228
+
+void bob_sim_init();
+
+// One SPI message: runs cmd on the simulated BoB the way ChumbyExecCmd
+// does, copies up to incount reply words to inbuf and returns the number
+// of words the BoB replied with.  Sleeps for the configured link latency.
+int bob_sim_message(short cmd, short *outbuf, short outcount, short *inbuf, short incount);
+
+#endif
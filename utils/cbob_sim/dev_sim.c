@@ -0,0 +1,875 @@
+/**************************************************************************
+ *  Copyright 2008,2009 KISS Institute for Practical Robotics             *
+ *                                                                        *
+ *  This file is part of CBC Firmware.                                    *
+ *                                                                        *
+ *  CBC Firmware is free software: you can redistribute it and/or modify  *
+ *  it under the terms of the GNU General Public License as published by  *
+ *  the Free Software Foundation, either version 2 of the License, or     *
+ *  (at your option) any later version.                                   *
+ *                                                                        *
+ *  CBC Firmware is distributed in the hope that it will be useful,       *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *  GNU General Public License for more details.                          *
+ *                                                                        *
+ *  You should have received a copy of the GNU General Public License     *
+ *  along with this copy of CBC Firmware.  Check the LICENSE file         *
+ *  in the project root.  If not, see <http://www.gnu.org/licenses/>.     *
+ **************************************************************************/
+
+// /dev/cbc stand-in
+//
+// LD_PRELOAD this and opens of /dev/cbc/* get a placeholder fd whose
+// read, write, ioctl and mmap do what kernel/cbob does, talking to the
+// simulated BoB in bob_sim.c instead of the SPI link.  Everything else
+// passes through to libc.
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "bob_sim.h"
+#include "../../kernel/cbob/cbob.h"
+#include "../../kernel/cbob/cbob_cmd.h"
+
+#define SIM_MAX_FDS 1024
+
+enum {
+  SIM_NONE = 0,
+  SIM_DIGITAL,
+  SIM_ANALOG,
+  SIM_SENSORS,
+  SIM_PWM,
+  SIM_PID,
+  SIM_SERVO,
+  SIM_ACCEL,
+  SIM_STATUS,
+  SIM_STATE
+};
+
+struct sim_file {
+  int type;
+  short port;     // minor number, as in mkdev.sh
+  short live;
+};
+
+static struct sim_file g_files[SIM_MAX_FDS];
+static pthread_mutex_t g_filesLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int     (*real_open)(const char *, int, ...);
+static int     (*real_close)(int);
+static ssize_t (*real_read)(int, void *, size_t);
+static ssize_t (*real_write)(int, const void *, size_t);
+static int     (*real_ioctl)(int, unsigned long, ...);
+static void   *(*real_mmap)(void *, size_t, int, int, int, off_t);
+
+static void sim_resolve()
+{
+  if(real_open) return;
+  real_open  = dlsym(RTLD_NEXT, "open");
+  real_close = dlsym(RTLD_NEXT, "close");
+  real_read  = dlsym(RTLD_NEXT, "read");
+  real_write = dlsym(RTLD_NEXT, "write");
+  real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+  real_mmap  = dlsym(RTLD_NEXT, "mmap");
+}
+
+static struct sim_file *sim_file(int fd)
+{
+  if(fd < 0 || fd >= SIM_MAX_FDS || g_files[fd].type == SIM_NONE)
+    return 0;
+  return &g_files[fd];
+}
+
+// Names and minors from kernel/cbob/mkdev.sh
+static int sim_lookup(const char *name, int *type, short *port)
+{
+  int n;
+
+  if(sscanf(name, "digital%d", &n) == 1 && n >= 8 && n <= 15) { *type = SIM_DIGITAL; *port = n-8; }
+  else if(!strcmp(name, "button"))   { *type = SIM_DIGITAL; *port = 8; }
+  else if(!strcmp(name, "digital"))  { *type = SIM_DIGITAL; *port = 9; }
+  else if(sscanf(name, "analog%d", &n) == 1 && n >= 0 && n <= 7) { *type = SIM_ANALOG; *port = n; }
+  else if(!strcmp(name, "battery"))  { *type = SIM_ANALOG; *port = 8; }
+  else if(!strcmp(name, "analog"))   { *type = SIM_ANALOG; *port = 9; }
+  else if(!strcmp(name, "sensors"))  { *type = SIM_SENSORS; *port = 0; }
+  else if(sscanf(name, "pwm%d", &n) == 1 && n >= 0 && n <= 3) { *type = SIM_PWM; *port = n; }
+  else if(!strcmp(name, "pwm"))      { *type = SIM_PWM; *port = 4; }
+  else if(sscanf(name, "pid%d", &n) == 1 && n >= 0 && n <= 3) { *type = SIM_PID; *port = n; }
+  else if(!strcmp(name, "pid"))      { *type = SIM_PID; *port = 4; }
+  else if(sscanf(name, "servo%d", &n) == 1 && n >= 0 && n <= 3) { *type = SIM_SERVO; *port = n; }
+  else if(!strcmp(name, "servo"))    { *type = SIM_SERVO; *port = 4; }
+  else if(!strcmp(name, "accelX"))   { *type = SIM_ACCEL; *port = 0; }
+  else if(!strcmp(name, "accelY"))   { *type = SIM_ACCEL; *port = 1; }
+  else if(!strcmp(name, "accelZ"))   { *type = SIM_ACCEL; *port = 2; }
+  else if(!strcmp(name, "accel"))    { *type = SIM_ACCEL; *port = 3; }
+  else if(!strcmp(name, "status"))   { *type = SIM_STATUS; *port = 0; }
+  else if(!strcmp(name, "state"))    { *type = SIM_STATE; *port = 0; }
+  else return -1;
+
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////
+// Sensor snapshot, like cbob_sensors.c
+
+static struct sensor_data g_snapshot;
+static double g_snapshotStamp = -1;
+static pthread_mutex_t g_snapshotLock = PTHREAD_MUTEX_INITIALIZER;
+static double g_maxAge = 0.020;
+
+static double sim_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static void sim_state_invalidate(unsigned int parts);
+
+static void sim_sensors_invalidate()
+{
+  pthread_mutex_lock(&g_snapshotLock);
+  g_snapshotStamp = -1;
+  pthread_mutex_unlock(&g_snapshotLock);
+  sim_state_invalidate(CBOB_STATE_SENSORS);
+}
+
+static void sim_sensors_get(struct sensor_data *data, int live)
+{
+  pthread_mutex_lock(&g_snapshotLock);
+  if(!live && g_snapshotStamp >= 0 && sim_now() - g_snapshotStamp < g_maxAge) {
+    *data = g_snapshot;
+    pthread_mutex_unlock(&g_snapshotLock);
+    return;
+  }
+
+  bob_sim_message(CBOB_CMD_SENSORS_READ, 0, 0, (short*)data, SENSOR_DATA_COUNT);
+  g_snapshot = *data;
+  g_snapshotStamp = sim_now();
+  pthread_mutex_unlock(&g_snapshotLock);
+}
+
+// CBOB_SENSORS_GET_ROBOT_STATE, the sensor part refreshes the snapshot
+static void sim_sensors_get_robot(struct cbob_robot_state *state)
+{
+  pthread_mutex_lock(&g_snapshotLock);
+  bob_sim_message(CBOB_CMD_STATE_READ, 0, 0, (short*)state, CBOB_ROBOT_STATE_COUNT);
+  g_snapshot = state->sensors;
+  g_snapshotStamp = sim_now();
+  pthread_mutex_unlock(&g_snapshotLock);
+}
+
+/////////////////////////////////////////////////////////////
+// State page, like cbob_state.c.  The page lives in an unlinked temp file
+// so every mmap gets its own read-only view and munmap can't pull it out
+// from under the refresh thread.
+
+static int g_stateFd = -1;
+static struct cbob_state *g_state;
+static pthread_mutex_t g_stateLock = PTHREAD_MUTEX_INITIALIZER;
+static int g_stateUsers = 0;
+
+static void sim_state_begin()
+{
+  g_state->seq++;
+  __sync_synchronize();
+}
+
+static void sim_state_end()
+{
+  __sync_synchronize();
+  g_state->seq++;
+}
+
+static void sim_state_invalidate(unsigned int parts)
+{
+  pthread_mutex_lock(&g_stateLock);
+  if(g_state) {
+    sim_state_begin();
+    g_state->valid &= ~parts;
+    sim_state_end();
+  }
+  pthread_mutex_unlock(&g_stateLock);
+}
+
+// Refreshes sensors every 20 ms and motors every 60 ms, close to the
+// driver's sensor_refresh_ms and state_refresh_ms, over the simulated link
+// so the traffic competes with the program like it does on the board
+static void *sim_state_thread(void *arg)
+{
+  struct sensor_data sensors;
+  short port = 4, pwm[4];
+  int counter[4], users, tick = 0;
+
+  while(1) {
+    usleep(20000);
+
+    pthread_mutex_lock(&g_stateLock);
+    users = g_stateUsers;
+    pthread_mutex_unlock(&g_stateLock);
+    if(users == 0)
+      continue;
+
+    sim_sensors_get(&sensors, 0);
+    pthread_mutex_lock(&g_stateLock);
+    sim_state_begin();
+    g_state->sensors = sensors;
+    g_state->sensors_stamp = (unsigned int)(sim_now()*100);
+    g_state->valid |= CBOB_STATE_SENSORS;
+    sim_state_end();
+    pthread_mutex_unlock(&g_stateLock);
+
+    if(tick++ % 3)
+      continue;
+
+    bob_sim_message(CBOB_CMD_PID_READ, &port, 1, (short*)counter, 8);
+    bob_sim_message(CBOB_CMD_PWM_READ, &port, 1, pwm, 4);
+    pthread_mutex_lock(&g_stateLock);
+    sim_state_begin();
+    memcpy(g_state->pwm, pwm, sizeof(pwm));
+    memcpy(g_state->motor_counter, counter, sizeof(counter));
+    g_state->motors_stamp = (unsigned int)(sim_now()*100);
+    g_state->valid |= CBOB_STATE_MOTORS;
+    sim_state_end();
+    pthread_mutex_unlock(&g_stateLock);
+  }
+  return 0;
+}
+
+static int sim_state_init()
+{
+  char name[] = "/tmp/cbob_sim_stateXXXXXX";
+  pthread_t thread;
+  long page = sysconf(_SC_PAGESIZE);
+
+  if(g_state) return 0;
+
+  g_stateFd = mkstemp(name);
+  if(g_stateFd < 0) return -1;
+  unlink(name);
+
+  if(ftruncate(g_stateFd, page) != 0)
+    return -1;
+  g_state = real_mmap(0, page, PROT_READ | PROT_WRITE, MAP_SHARED, g_stateFd, 0);
+  if(g_state == MAP_FAILED) {
+    g_state = 0;
+    return -1;
+  }
+
+  pthread_create(&thread, 0, sim_state_thread, 0);
+  pthread_detach(thread);
+  return 0;
+}
+
+/////////////////////////////////////////////////////////////
+// File ops, one per kernel/cbob/cbob_*.c
+
+static ssize_t sim_read(struct sim_file *f, void *buf, size_t count)
+{
+  struct sensor_data sensors;
+  short data[9];
+  signed char pwm[4];
+  int counter[4], i;
+  char version;
+
+  memset(data, 0, sizeof(data));
+
+  switch(f->type) {
+  case SIM_DIGITAL:
+    sim_sensors_get(&sensors, f->live);
+    data[0] = f->port <= 8 ? (sensors.digitals >> f->port) & 1 : sensors.digitals;
+    if(count > 2) count = 2;
+    memcpy(buf, data, count);
+    return count;
+  case SIM_ANALOG:
+    sim_sensors_get(&sensors, f->live);
+    if(f->port < 8)
+      data[0] = sensors.analog[f->port];
+    else if(f->port == 8)
+      data[0] = sensors.battery;
+    else {
+      memcpy(data, sensors.analog, sizeof(sensors.analog));
+      data[8] = sensors.battery;
+    }
+    if(count > 18) count = 18;
+    memcpy(buf, data, count);
+    return count;
+  case SIM_SENSORS:
+    sim_sensors_get(&sensors, f->live);
+    if(count > sizeof(sensors)) count = sizeof(sensors);
+    memcpy(buf, &sensors, count);
+    return count;
+  case SIM_ACCEL:
+    sim_sensors_get(&sensors, f->live);
+    if(f->port <= 2)
+      data[0] = (&sensors.accel_x)[f->port];
+    else
+      memcpy(data, &sensors.accel_x, 3*sizeof(short));
+    if(count > 6) count = 6;
+    memcpy(buf, data, count);
+    return count;
+  case SIM_PWM:
+    bob_sim_message(CBOB_CMD_PWM_READ, &f->port, 1, data, 4);
+    for(i = 0;i < 4;i++)
+      pwm[i] = data[i];
+    if(count > 4) count = 4;
+    memcpy(buf, pwm, count);
+    return count;
+  case SIM_PID:
+    memset(counter, 0, sizeof(counter));
+    bob_sim_message(CBOB_CMD_PID_READ, &f->port, 1, (short*)counter, 8);
+    if(count > 16) count = 16;
+    memcpy(buf, counter, count);
+    return count;
+  case SIM_SERVO:
+    bob_sim_message(CBOB_CMD_SERVO_READ, &f->port, 1, data, 4);
+    if(count > 8) count = 8;
+    memcpy(buf, data, count);
+    return count;
+  case SIM_STATUS:
+    bob_sim_message(CBOB_CMD_STATUS_READ, 0, 0, data, 1);
+    version = data[0];
+    if(count > 1) count = 1;
+    memcpy(buf, &version, count);
+    return count;
+  case SIM_STATE:
+    pthread_mutex_lock(&g_stateLock);
+    if(count > sizeof(struct cbob_state)) count = sizeof(struct cbob_state);
+    memcpy(buf, g_state, count);
+    pthread_mutex_unlock(&g_stateLock);
+    return count;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+static ssize_t sim_write(struct sim_file *f, const void *buf, size_t count)
+{
+  short data[5];
+  const char *bytes = buf;
+  size_t i;
+
+  memset(data, 0, sizeof(data));
+  data[0] = f->port;
+
+  switch(f->type) {
+  case SIM_DIGITAL:
+    if(count == 0) return 0;
+    data[1] = bytes[0];
+    bob_sim_message(CBOB_CMD_DIGITAL_WRITE, data, 2, 0, 0);
+    sim_sensors_invalidate();
+    return 1;
+  case SIM_PWM:
+    if(count == 0) return 0;
+    if(count > 4) count = 4;
+    for(i = 0;i < count;i++)
+      data[i+1] = (signed char)bytes[i];
+    bob_sim_message(CBOB_CMD_PWM_WRITE, data, 1 + count, 0, 0);
+    sim_state_invalidate(CBOB_STATE_MOTORS);
+    return 0;
+  case SIM_PID:
+    if(count > 6) count = 6;
+    memcpy(&(data[1]), buf, count);
+    bob_sim_message(CBOB_CMD_PID_WRITE, data, (count>>1)+1, 0, 0);
+    sim_state_invalidate(CBOB_STATE_MOTORS);
+    return 0;
+  case SIM_SERVO:
+    if(count > 2) count = 2;
+    memcpy(&(data[1]), buf, count);
+    bob_sim_message(CBOB_CMD_SERVO_WRITE, data, 2, 0, 0);
+    return count;
+  }
+  errno = EINVAL;
+  return -1;
+}
+
+// No event interrupt to drain the log early, read it straight off the BoB
+static int sim_read_edges(struct cbob_edges *edges)
+{
+  short req = CBOB_CAPTURE_READ_MAX;
+  short data[2 + 3*CBOB_CAPTURE_READ_MAX];
+  int max, count = 0, i, n;
+
+  max = edges->count;
+  if(max < 0 || max > CBOB_EDGES_MAX) max = CBOB_EDGES_MAX;
+  edges->dropped = 0;
+
+  while(count < max) {
+    req = max - count < CBOB_CAPTURE_READ_MAX ? max - count : CBOB_CAPTURE_READ_MAX;
+    bob_sim_message(CBOB_CMD_CAPTURE_READ, &req, 1, data, 2 + 3*CBOB_CAPTURE_READ_MAX);
+    n = data[0];
+    edges->dropped += data[1];
+    for(i = 0;i < n;i++, count++) {
+      memcpy(&(edges->edges[count].stamp), &(data[2+3*i]), 4);
+      edges->edges[count].port = data[4+3*i] & 0xff;
+      edges->edges[count].level = (data[4+3*i] >> 8) & 1;
+    }
+    if(n < req)
+      break;
+  }
+  edges->count = count;
+  return 0;
+}
+
+static int sim_read_stream(struct cbob_analog_stream *stream)
+{
+  short req;
+  short data[4 + CBOB_STREAM_READ_MAX];
+  int max, n, ports = 0, i;
+
+  req = 1;
+  bob_sim_message(CBOB_CMD_STREAM_CONFIG, &req, 1, data, 2);
+  stream->mask = data[0];
+  stream->rate = data[1];
+  for(i = 0;i < 8;i++)
+    if(stream->mask & (1<<i)) ports++;
+
+  max = stream->count;
+  if(max < 0 || max > CBOB_STREAM_MAX) max = CBOB_STREAM_MAX;
+  if(max > CBOB_STREAM_READ_MAX) max = CBOB_STREAM_READ_MAX;
+  req = max;
+  stream->count = 0;
+  stream->dropped = 0;
+  stream->first = 0;
+  if(ports == 0)
+    return 0;
+
+  // one BoB read keeps the frames consecutive without a ring in between
+  bob_sim_message(CBOB_CMD_STREAM_READ, &req, 1, data, 4 + CBOB_STREAM_READ_MAX);
+  n = data[0];
+  stream->dropped = data[1];
+  memcpy(&(stream->first), &(data[2]), 4);
+  memcpy(stream->samples, &(data[4]), n*sizeof(short));
+  stream->count = n;
+  return 0;
+}
+
+// ANALOG or ACCEL CONFIG filter sub-command for port, like the driver
+static int sim_filter(short cmd, short sub, int set, short port, int *config)
+{
+  short req[4], result[2];
+
+  req[0] = sub;
+  req[1] = port;
+  if(set) {
+    req[2] = config[0];
+    req[3] = config[1];
+  }
+  bob_sim_message(cmd, req, set ? 4 : 2, result, 2);
+  if(set)
+    sim_sensors_invalidate();
+  config[0] = result[0];
+  config[1] = result[1];
+  return 0;
+}
+
+static int sim_ioctl(struct sim_file *f, unsigned long request, void *arg)
+{
+  struct sensor_data sensors;
+  short req[8], result[8];
+  struct cbob_batch *batch;
+  int value = 0, n;
+
+  memset(req, 0, sizeof(req));
+  memset(result, 0, sizeof(result));
+
+  switch(f->type) {
+  case SIM_DIGITAL:
+    // takes no argument
+    if(request == CBOB_DIGITAL_CLEAR_COUNT) {
+      req[0] = 3;
+      req[1] = f->port;
+      bob_sim_message(CBOB_CMD_CAPTURE_CONFIG, req, 2, 0, 0);
+      return 0;
+    }
+    memcpy(&value, arg, sizeof(int));
+    if(request == CBOB_DIGITAL_SET_DIR) {
+      req[0] = 0;
+      req[1] = value;
+      bob_sim_message(CBOB_CMD_DIGITAL_CONFIG, req, 2, 0, 0);
+      sim_sensors_invalidate();
+    }
+    else if(request == CBOB_DIGITAL_GET_DIR) {
+      req[0] = 1;
+      bob_sim_message(CBOB_CMD_DIGITAL_CONFIG, req, 1, result, 1);
+      value = result[0];
+    }
+    else if(request == CBOB_DIGITAL_SET_LIVE)
+      f->live = value ? 1 : 0;
+    else if(request == CBOB_DIGITAL_WAIT) {
+      // no event interrupt here, poll like the driver does on old firmware
+      if(f->port > 8) {
+        errno = EINVAL;
+        return -1;
+      }
+      for(;;) {
+        sim_sensors_get(&sensors, f->live);
+        if(((sensors.digitals >> f->port) & 1) == (value ? 1 : 0))
+          break;
+        usleep(20000);
+      }
+    }
+    else if(request == CBOB_DIGITAL_SET_CAPTURE) {
+      req[0] = 0;
+      req[1] = f->port;
+      req[2] = value;
+      bob_sim_message(CBOB_CMD_CAPTURE_CONFIG, req, 3, 0, 0);
+    }
+    else if(request == CBOB_DIGITAL_GET_COUNT) {
+      req[0] = 2;
+      req[1] = f->port;
+      bob_sim_message(CBOB_CMD_CAPTURE_CONFIG, req, 2, result, 2);
+      memcpy(&value, result, sizeof(int));
+    }
+    else if(request == CBOB_DIGITAL_READ_EDGES)
+      return sim_read_edges((struct cbob_edges*)arg);
+    memcpy(arg, &value, sizeof(int));
+    return 0;
+  case SIM_ANALOG:
+    if(request == CBOB_ANALOG_STREAM_STOP) {
+      req[0] = 0;
+      bob_sim_message(CBOB_CMD_STREAM_CONFIG, req, 3, 0, 0);
+      return 0;
+    }
+    if(request == CBOB_ANALOG_STREAM_START) {
+      req[0] = 0;
+      req[1] = ((int*)arg)[0];
+      req[2] = ((int*)arg)[1];
+      bob_sim_message(CBOB_CMD_STREAM_CONFIG, req, 3, result, 1);
+      ((int*)arg)[1] = result[0];
+      return 0;
+    }
+    if(request == CBOB_ANALOG_STREAM_READ)
+      return sim_read_stream((struct cbob_analog_stream*)arg);
+    if(request == CBOB_ANALOG_SET_FILTER || request == CBOB_ANALOG_GET_FILTER)
+      return sim_filter(CBOB_CMD_ANALOG_CONFIG, request == CBOB_ANALOG_SET_FILTER ? 2 : 3,
+                        request == CBOB_ANALOG_SET_FILTER, (f->port >= 0 && f->port <= 8) ? f->port : -1, (int*)arg);
+    memcpy(&value, arg, sizeof(int));
+    if(request == CBOB_ANALOG_SET_PULLUPS) {
+      req[0] = 0;
+      req[1] = value;
+      bob_sim_message(CBOB_CMD_ANALOG_CONFIG, req, 2, 0, 0);
+      sim_sensors_invalidate();
+    }
+    else if(request == CBOB_ANALOG_GET_PULLUPS) {
+      req[0] = 1;
+      bob_sim_message(CBOB_CMD_ANALOG_CONFIG, req, 1, result, 1);
+      value = result[0];
+    }
+    else if(request == CBOB_ANALOG_SET_LIVE)
+      f->live = value ? 1 : 0;
+    memcpy(arg, &value, sizeof(int));
+    return 0;
+  case SIM_SENSORS:
+    if(request == CBOB_SENSORS_SET_LIVE) {
+      memcpy(&value, arg, sizeof(int));
+      f->live = value ? 1 : 0;
+      return 0;
+    }
+    if(request == CBOB_SENSORS_GET_ROBOT_STATE) {
+      sim_sensors_get_robot((struct cbob_robot_state*)arg);
+      return 0;
+    }
+    break;
+  case SIM_ACCEL:
+    if(request == CBOB_ACCEL_RECALIBRATE) {
+      req[0] = 0;
+      bob_sim_message(CBOB_CMD_ACCEL_CONFIG, req, 1, 0, 0);
+      sim_sensors_invalidate();
+    }
+    else if(request == CBOB_ACCEL_GET_CAL) {
+      req[0] = 1;
+      bob_sim_message(CBOB_CMD_ACCEL_CONFIG, req, 1, result, 3);
+      memcpy(arg, result, sizeof(short)*3);
+    }
+    else if(request == CBOB_ACCEL_SET_CAL) {
+      req[0] = 2;
+      memcpy(&(req[1]), arg, sizeof(short)*3);
+      bob_sim_message(CBOB_CMD_ACCEL_CONFIG, req, 4, 0, 0);
+      sim_sensors_invalidate();
+    }
+    else if(request == CBOB_ACCEL_SET_LIVE) {
+      memcpy(&value, arg, sizeof(int));
+      f->live = value ? 1 : 0;
+    }
+    else if(request == CBOB_ACCEL_SET_FILTER || request == CBOB_ACCEL_GET_FILTER)
+      return sim_filter(CBOB_CMD_ACCEL_CONFIG, request == CBOB_ACCEL_SET_FILTER ? 3 : 4,
+                        request == CBOB_ACCEL_SET_FILTER, (f->port >= 0 && f->port <= 2) ? f->port : -1, (int*)arg);
+    return 0;
+  case SIM_PID:
+    req[1] = f->port;
+    if(request == CBOB_PID_CLEAR_COUNTER) {
+      req[0] = 0;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, 0, 0);
+      sim_state_invalidate(CBOB_STATE_MOTORS);
+    }
+    else if(request == CBOB_PID_SET_GAINS) {
+      req[0] = 2;
+      memcpy(&(req[2]), arg, sizeof(short)*6);
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 8, 0, 0);
+    }
+    else if(request == CBOB_PID_GET_GAINS) {
+      req[0] = 3;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, result, 6);
+      memcpy(arg, result, 14);
+    }
+    else if(request == CBOB_PID_GET_DONE) {
+      req[0] = 4;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, result, 1);
+      value = result[0];
+      memcpy(arg, &value, sizeof(int));
+    }
+    else if(request == CBOB_PID_WAIT_DONE) {
+      req[0] = 4;
+      for(;;) {
+        bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, result, 1);
+        if(result[0])
+          break;
+        usleep(20000);
+      }
+    }
+    else if(request == CBOB_PID_RESET_GAINS) {
+      req[0] = 5;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, 0, 0);
+    }
+    else if(request == CBOB_PID_RECALIBRATE) {
+      req[0] = 6;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 1, 0, 0);
+    }
+    else if(request == CBOB_PID_GET_CAL) {
+      req[0] = 7;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 1, result, 4);
+      memcpy(arg, result, sizeof(short)*4);
+    }
+    else if(request == CBOB_PID_SET_CAL) {
+      req[0] = 8;
+      memcpy(&(req[1]), arg, sizeof(short)*4);
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 5, 0, 0);
+    }
+    else if(request == CBOB_PID_SET_PERIOD || request == CBOB_PID_GET_PERIOD) {
+      memcpy(&value, arg, sizeof(int));
+      req[0] = request == CBOB_PID_SET_PERIOD ? 9 : 10;
+      req[1] = value;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, result, 1);
+      value = result[0];
+      memcpy(arg, &value, sizeof(int));
+    }
+    else if(request == CBOB_PID_SET_PROFILE) {
+      req[0] = 11;
+      memcpy(&(req[2]), arg, sizeof(int)*2);
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 6, 0, 0);
+    }
+    else if(request == CBOB_PID_GET_PROFILE) {
+      req[0] = 12;
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 2, result, 4);
+      memcpy(arg, result, sizeof(int)*2);
+    }
+    else if(request == CBOB_PID_MOVE_PROFILED) {
+      req[0] = 13;
+      memcpy(&value, arg, sizeof(int));
+      req[2] = value;
+      memcpy(&(req[3]), ((int*)arg)+1, sizeof(int));
+      bob_sim_message(CBOB_CMD_PID_CONFIG, req, 5, 0, 0);
+      sim_state_invalidate(CBOB_STATE_MOTORS);
+    }
+    return 0;
+  case SIM_STATUS:
+    if(request == CBOB_STATUS_BATCH) {
+      batch = arg;
+      if(batch->outcount < 1 || batch->outcount > CBOB_BATCH_SIZE) {
+        errno = EINVAL;
+        return -1;
+      }
+      // the simulated BoB always has BATCH, an empty one is only a probe
+      batch->incount = 0;
+      if(batch->outbuf[0] == 0)
+        return 0;
+      n = bob_sim_message(CBOB_CMD_BATCH, batch->outbuf, batch->outcount, batch->inbuf, CBOB_BATCH_SIZE);
+      batch->incount = n < CBOB_BATCH_SIZE ? n : CBOB_BATCH_SIZE;
+      sim_sensors_invalidate();
+      sim_state_invalidate(CBOB_STATE_MOTORS);
+      return 0;
+    }
+    break;
+  case SIM_PWM:
+  case SIM_SERVO:
+    return 0;
+  }
+  errno = ENOTTY;
+  return -1;
+}
+
+/////////////////////////////////////////////////////////////
+// libc entry points
+
+static int sim_open(const char *path, int flags, mode_t mode, int large)
+{
+  struct sim_file f;
+  char *env;
+  int fd;
+
+  sim_resolve();
+
+  if(strncmp(path, "/dev/cbc/", 9) != 0)
+    return real_open(path, flags | (large ? O_LARGEFILE : 0), mode);
+
+  memset(&f, 0, sizeof(f));
+  if(sim_lookup(path + 9, &f.type, &f.port) < 0) {
+    errno = ENODEV;
+    return -1;
+  }
+  if(f.type == SIM_STATE && (flags & O_ACCMODE) != O_RDONLY) {
+    errno = EPERM;
+    return -1;
+  }
+
+  bob_sim_init();
+  if((env = getenv("CBOB_SIM_MAX_AGE_MS")))
+    g_maxAge = atoi(env)/1000.0;
+
+  // a real fd so the number is ours until close
+  fd = real_open("/dev/null", O_RDWR);
+  if(fd < 0 || fd >= SIM_MAX_FDS) {
+    if(fd >= 0) real_close(fd);
+    errno = EMFILE;
+    return -1;
+  }
+
+  if(f.type == SIM_STATE) {
+    pthread_mutex_lock(&g_stateLock);
+    if(sim_state_init() < 0) {
+      pthread_mutex_unlock(&g_stateLock);
+      real_close(fd);
+      errno = ENOMEM;
+      return -1;
+    }
+    g_stateUsers++;
+    pthread_mutex_unlock(&g_stateLock);
+  }
+
+  pthread_mutex_lock(&g_filesLock);
+  g_files[fd] = f;
+  pthread_mutex_unlock(&g_filesLock);
+
+  return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+  mode_t mode = 0;
+  va_list ap;
+
+  if(flags & O_CREAT) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  return sim_open(path, flags, mode, 0);
+}
+
+int open64(const char *path, int flags, ...)
+{
+  mode_t mode = 0;
+  va_list ap;
+
+  if(flags & O_CREAT) {
+    va_start(ap, flags);
+    mode = va_arg(ap, mode_t);
+    va_end(ap);
+  }
+  return sim_open(path, flags, mode, 1);
+}
+
+int close(int fd)
+{
+  struct sim_file *f;
+
+  sim_resolve();
+
+  pthread_mutex_lock(&g_filesLock);
+  f = sim_file(fd);
+  if(f) {
+    if(f->type == SIM_STATE) {
+      pthread_mutex_lock(&g_stateLock);
+      g_stateUsers--;
+      pthread_mutex_unlock(&g_stateLock);
+    }
+    f->type = SIM_NONE;
+  }
+  pthread_mutex_unlock(&g_filesLock);
+
+  return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+  struct sim_file *f;
+
+  sim_resolve();
+  if((f = sim_file(fd)))
+    return sim_read(f, buf, count);
+  return real_read(fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+  struct sim_file *f;
+
+  sim_resolve();
+  if((f = sim_file(fd)))
+    return sim_write(f, buf, count);
+  return real_write(fd, buf, count);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+  struct sim_file *f;
+  void *arg;
+  va_list ap;
+
+  va_start(ap, request);
+  arg = va_arg(ap, void*);
+  va_end(ap);
+
+  sim_resolve();
+  if((f = sim_file(fd)))
+    return sim_ioctl(f, request, arg);
+  return real_ioctl(fd, request, arg);
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+  struct sim_file *f;
+
+  sim_resolve();
+  if(!(f = sim_file(fd)))
+    return real_mmap(addr, length, prot, flags, fd, offset);
+
+  if(f->type != SIM_STATE || offset != 0 || length > (size_t)sysconf(_SC_PAGESIZE)) {
+    errno = EINVAL;
+    return MAP_FAILED;
+  }
+  if(prot & PROT_WRITE) {
+    errno = EPERM;
+    return MAP_FAILED;
+  }
+  return real_mmap(addr, length, prot, MAP_SHARED, g_stateFd, 0);
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+  return mmap(addr, length, prot, flags, fd, offset);
+}